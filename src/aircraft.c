@@ -20,8 +20,46 @@
  * The name of Aircraft SQL file is based on the name of `Modes.aircraft_db`.
  */
 static mg_file_path aircraft_sql  = { "?" };
+static mg_file_path aircraft_sql_tmp;
 static bool         have_sql_file = false;
 
+/**
+ * The prepared `INSERT` statement used while building `aircraft_sql_tmp`.
+ */
+static sqlite3_stmt *sql_insert_stmt = NULL;
+
+/**
+ * \typedef json_ws_entry
+ *
+ * An aircraft in the previous WebSocket update.
+ */
+typedef struct json_ws_entry {
+        uint32_t  addr;        /**< the ICAO address */
+        uint32_t  crc;         /**< CRC of it's JSON in the last update */
+      } json_ws_entry;
+
+/**
+ * \typedef json_snapshot
+ *
+ * The latest JSON descriptions of the aircrafts as served by the network thread.
+ * Built by the main thread in `aircraft_json_update()` and referenced by the
+ * network thread in `aircraft_json_get()`. Thus the network thread never
+ * walks `Modes.aircrafts` while the decoder is modifying it.
+ */
+typedef struct json_snapshot {
+        SRWLOCK        lock;
+        json_data     *data [JSON_KINDS];   /**< The snapshots for each `json_kind` */
+        uint64_t       data_time;  /**< When `data` was last built */
+        uint32_t       data_seq;   /**< The sequence number of `data` */
+        char          *ws_full;    /**< The WebSocket message with all aircrafts in the last update */
+        char          *delta;      /**< The WebSocket message with the changes since the previous update */
+        uint32_t       seq;        /**< The sequence number of `delta`. 0 before the first */
+        json_ws_entry *sent;       /**< The aircrafts in the previous update. Sorted on address. Only used by the main thread */
+        uint32_t       sent_num;   /**< The number of elements in `sent` */
+      } json_snapshot;
+
+static json_snapshot g_json = { SRWLOCK_INIT };
+
 /**
  * \def DB_COLUMNS
  * The Sqlite columns we define.
@@ -40,17 +78,69 @@ static bool         have_sql_file = false;
  */
 #define DB_INSERT  "INSERT INTO aircrafts (" DB_COLUMNS ") VALUES"
 
-static bool sql_init (const char *what, int flags);
+/**
+ * \def DB_PRAGMAS
+ * The pragmas used while bulk-loading into `aircraft_sql_tmp`.
+ * Since a crash will only leave a partial temp-file behind,
+ * no journal or syncing is needed.
+ */
+#define DB_PRAGMAS "PRAGMA journal_mode=OFF; PRAGMA synchronous=OFF; " \
+                   "PRAGMA locking_mode=EXCLUSIVE; PRAGMA cache_size=-65536;"
+
+static bool sql_init (const char *db_file, const char *what, int flags);
 static bool sql_create (void);
 static bool sql_open (void);
 static bool sql_begin (void);
-static bool sql_end (void);
+static bool sql_end (bool ok);
 static bool sql_add_entry (uint32_t num, const aircraft_info *rec);
 
 static aircraft *aircraft_find (uint32_t addr);
 static const     aircraft_info *CSV_lookup_entry (uint32_t addr);
 static const     aircraft_info *SQL_lookup_entry (uint32_t addr);
 static bool      is_helicopter_type (const char *type);
+static bool      CSV_index_build (void);
+static void      CSV_index_free (void);
+
+/**
+ * \typedef CSV_index
+ * A search-index over the sorted `Modes.aircraft_list_CSV`.
+ *
+ * The ICAO keys are stored in Eytzinger (BFS) order in a 1-based array.
+ * So the first probes of a search all fall in the same few cache-lines
+ * and the search loop needs no compare callback and no branches
+ * depending on the result. `idx[k]` is the record number for `keys[k]`.
+ */
+typedef struct CSV_index {
+        uint32_t *keys;   /**< `num + 1` ICAO keys in Eytzinger order; `keys[0]` is unused */
+        uint32_t *idx;    /**< `num + 1` indices into `Modes.aircraft_list_CSV` */
+        uint32_t  num;    /**< Number of keys in the index */
+      } CSV_index;
+
+static CSV_index CSV_idx;
+
+/**
+ * An exact bitset over all 2^24 ICAO addresses (2 MByte).
+ * A bit is set for each address in the CSV or SQL database.
+ * Built in `aircraft_CSV_load()` and used in `aircraft_lookup()` to
+ * skip the CSV / SQL lookup for addresses definitely not in the database.
+ */
+static uint8_t *ICAO_known = NULL;
+
+#define ICAO_KNOWN_SIZE  ((0xFFFFFF + 1) / 8)
+
+static void ICAO_filter_add (uint32_t addr)
+{
+  addr &= 0xFFFFFF;
+  ICAO_known [addr >> 3] |= (1 << (addr & 7));
+}
+
+static bool ICAO_filter_maybe (uint32_t addr)
+{
+  if (!ICAO_known)
+     return (true);     /* no filter; must do the lookup */
+  addr &= 0xFFFFFF;
+  return (ICAO_known [addr >> 3] & (1 << (addr & 7))) != 0;
+}
 
 /**
  * Lookup an aircraft in the CSV `Modes.aircraft_list_CSV` or
@@ -63,6 +153,13 @@ static const aircraft_info *aircraft_lookup (uint32_t addr, bool *from_sql)
   if (from_sql)
      *from_sql = false;
 
+  if (!ICAO_filter_maybe(addr))
+  {
+    Modes.stat.ICAO_filter_hits++;
+    return (NULL);
+  }
+  Modes.stat.ICAO_filter_misses++;
+
   if (Modes.aircraft_list_CSV)
      ai = CSV_lookup_entry (addr);
   else
@@ -170,6 +267,42 @@ aircraft *aircraft_find_or_create (uint32_t addr, uint64_t now)
   return (a);
 }
 
+/**
+ * With several `upstream` sources, the same message is likely received from
+ * more than one. The first to arrive wins; a copy from another source within
+ * 1 sec is a duplicate. Each aircraft remembers the last messages in a ring,
+ * so interleaved messages from 3 or more sources are also caught.
+ */
+bool aircraft_is_duplicate (const modeS_message *mm, uint64_t now)
+{
+  aircraft *a;
+  uint32_t  hash = 2166136261U;   /* FNV-1a of the message bytes */
+  int       i;
+
+  if (!mm->source || !mm->CRC_ok)
+     return (false);
+
+  a = aircraft_find_or_create (aircraft_get_addr(mm->AA[0], mm->AA[1], mm->AA[2]), now);
+  if (!a)
+     return (false);
+
+  for (i = 0; i < mm->msg_bits / 8; i++)
+      hash = (hash ^ mm->msg[i]) * 16777619U;
+
+  for (i = 0; i < DIM(a->recent_hash); i++)
+  {
+    if (a->recent_hash[i] == hash && a->recent_source[i] != mm->source &&
+        a->recent_time[i] && now - a->recent_time[i] < 1000)
+       return (true);
+  }
+
+  a->recent_hash   [a->recent_idx] = hash;
+  a->recent_time   [a->recent_idx] = now;
+  a->recent_source [a->recent_idx] = mm->source;
+  a->recent_idx = (a->recent_idx + 1) % DIM(a->recent_hash);
+  return (false);
+}
+
 /**
  * Return the number of aircrafts we have now.
  */
@@ -237,10 +370,139 @@ static int CSV_compare_on_addr (const void *_a, const void *_b)
   return (0);
 }
 
+/**
+ * Recursively fill the `CSV_idx` arrays in Eytzinger order.
+ * An in-order walk of the implicit tree visits the sorted records
+ * in sequence.
+ *
+ * \param in rec_num  the next record number in `Modes.aircraft_list_CSV`.
+ * \param in k        the 1-based node in the implicit tree.
+ * \retval           the next record number to place.
+ */
+static uint32_t CSV_index_fill (uint32_t rec_num, uint32_t k)
+{
+  if (k <= CSV_idx.num)
+  {
+    rec_num = CSV_index_fill (rec_num, 2*k);
+    CSV_idx.keys [k] = Modes.aircraft_list_CSV [rec_num].addr;
+    CSV_idx.idx [k]  = rec_num++;
+    rec_num = CSV_index_fill (rec_num, 2*k + 1);
+  }
+  return (rec_num);
+}
+
+/**
+ * Build the `CSV_idx` from the sorted `Modes.aircraft_list_CSV`.
+ * Called once after the `qsort()` in `aircraft_CSV_load()`.
+ */
+static bool CSV_index_build (void)
+{
+  uint32_t num = Modes.aircraft_num_CSV;
+
+  CSV_index_free();
+  if (num == 0)
+     return (false);
+
+  CSV_idx.keys = malloc ((num + 1) * sizeof(*CSV_idx.keys));
+  CSV_idx.idx  = malloc ((num + 1) * sizeof(*CSV_idx.idx));
+  if (!CSV_idx.keys || !CSV_idx.idx)
+  {
+    CSV_index_free();
+    return (false);
+  }
+  CSV_idx.num      = num;
+  CSV_idx.keys [0] = 0;
+  CSV_idx.idx [0]  = 0;
+  CSV_index_fill (0, 1);
+  return (true);
+}
+
+static void CSV_index_free (void)
+{
+  FREE (CSV_idx.keys);
+  FREE (CSV_idx.idx);
+  CSV_idx.num = 0;
+}
+
+/**
+ * The `sqlite3_exec()` callback for `ICAO_filter_build()`.
+ */
+static int ICAO_filter_callback (void *cb_arg, int argc, char **argv, char **col_name)
+{
+  if (argc == 1 && argv[0])
+     ICAO_filter_add (mg_unhexn(argv[0], strlen(argv[0])));
+  (void) cb_arg;
+  (void) col_name;
+  return (0);
+}
+
+/**
+ * Build the `ICAO_known` bitset from `Modes.aircraft_list_CSV` if loaded.
+ * Otherwise from all `icao24` values in the SQL-database.
+ */
+static bool ICAO_filter_build (void)
+{
+  uint32_t i;
+  int      rc;
+  char    *err_msg = NULL;
+
+  FREE (ICAO_known);
+
+  if (!Modes.aircraft_list_CSV && !Modes.sql_db)
+     return (false);
+
+  ICAO_known = calloc (ICAO_KNOWN_SIZE, 1);
+  if (!ICAO_known)
+     return (false);
+
+  if (Modes.aircraft_list_CSV)
+  {
+    for (i = 0; i < Modes.aircraft_num_CSV; i++)
+        ICAO_filter_add (Modes.aircraft_list_CSV[i].addr);
+    return (true);
+  }
+
+  rc = sqlite3_exec (Modes.sql_db, "SELECT icao24 FROM aircrafts;", ICAO_filter_callback, NULL, &err_msg);
+  if (rc != SQLITE_OK)
+  {
+    TRACE ("SQL error: rc: %d, %s", rc, err_msg);
+    sqlite3_free (err_msg);
+    FREE (ICAO_known);
+    return (false);
+  }
+  return (true);
+}
+
+/**
+ * Search the `CSV_idx` for `addr`.
+ *
+ * Descend the implicit tree going right when `keys[k] < addr`.
+ * At the end, `k` has the path to the lower-bound encoded in it's
+ * low bits; strip the trailing 1-bits (the right turns) and 1 more
+ * to get the node of the lower-bound. 0 means "not found".
+ */
+static const aircraft_info *CSV_index_lookup (uint32_t addr)
+{
+  const uint32_t *keys = CSV_idx.keys;
+  uint32_t        num  = CSV_idx.num;
+  uint32_t        k    = 1;
+
+  while (k <= num)
+    k = 2*k + (keys[k] < addr);
+
+  while (k & 1)
+    k >>= 1;
+  k >>= 1;
+
+  if (k == 0 || keys[k] != addr)
+     return (NULL);
+  return (Modes.aircraft_list_CSV + CSV_idx.idx[k]);
+}
+
 /**
  * Do a binary search for an aircraft in `Modes.aircraft_list_CSV`.
  */
-static const aircraft_info *CSV_lookup_entry (uint32_t addr)
+static const aircraft_info *CSV_bsearch_entry (uint32_t addr)
 {
   aircraft_info key = { addr, "" };
 
@@ -250,6 +512,19 @@ static const aircraft_info *CSV_lookup_entry (uint32_t addr)
                   sizeof(*Modes.aircraft_list_CSV), CSV_compare_on_addr);
 }
 
+/**
+ * Lookup an aircraft in `Modes.aircraft_list_CSV`.
+ * Use the `CSV_idx` if built, otherwise do a `bsearch()`.
+ */
+static const aircraft_info *CSV_lookup_entry (uint32_t addr)
+{
+  if (!Modes.aircraft_list_CSV)
+     return (NULL);
+  if (CSV_idx.keys)
+     return CSV_index_lookup (addr);
+  return CSV_bsearch_entry (addr);
+}
+
 /**
  * Do a simple test on the `Modes.aircraft_list_CSV`.
  *
@@ -474,10 +749,72 @@ static void aircraft_test_3 (void)
   aircraft_dump_json (aircraft_make_json(true), "json-4.txt");
 }
 
+/**
+ * Compare the speed of the `bsearch()` lookup against the `CSV_idx` lookup.
+ *
+ * Use 2 streams of ICAO addresses:
+ *  \li a "random" stream where most addresses are not in the CSV-file.
+ *  \li a "realistic" stream of addresses picked from the CSV-file.
+ *
+ * Both lookups must return the same record.
+ */
+static void aircraft_test_4 (void)
+{
+  #define NUM_LOOKUPS 1000000
+  static const char *streams[] = { "random", "realistic" };
+  uint32_t *addr;
+  uint32_t  i, s, found, mismatch;
+  double    usec_bsearch, usec_index;
+
+  LOG_STDOUT ("\n%s(): Comparing 'bsearch()' and 'CSV_idx' lookup speed:\n", __FUNCTION__);
+
+  if (!Modes.aircraft_list_CSV || !CSV_idx.keys)
+  {
+    LOG_STDOUT ("  cannot do this with an empty 'aircraft_list_CSV'\n");
+    return;
+  }
+
+  addr = malloc (NUM_LOOKUPS * sizeof(*addr));
+  if (!addr)
+     return;
+
+  for (s = 0; s < DIM(streams); s++)
+  {
+    for (i = 0; i < NUM_LOOKUPS; i++)
+    {
+      if (s == 0)
+           addr [i] = random_range (1, 0xFFFFFF);
+      else addr [i] = Modes.aircraft_list_CSV [random_range(0, Modes.aircraft_num_CSV-1)].addr;
+    }
+
+    found = 0;
+    usec_bsearch = get_usec_now();
+    for (i = 0; i < NUM_LOOKUPS; i++)
+        found += (CSV_bsearch_entry(addr[i]) != NULL);
+    usec_bsearch = get_usec_now() - usec_bsearch;
+
+    usec_index = get_usec_now();
+    for (i = 0; i < NUM_LOOKUPS; i++)
+        found -= (CSV_index_lookup(addr[i]) != NULL);
+    usec_index = get_usec_now() - usec_index;
+
+    for (i = mismatch = 0; i < NUM_LOOKUPS; i++)
+        if (CSV_bsearch_entry(addr[i]) != CSV_index_lookup(addr[i]))
+           mismatch++;
+
+    LOG_STDOUT ("  %-9s: %u lookups, bsearch: %7.0f usec, CSV_idx: %7.0f usec (%.2f times faster). %u mismatches.\n",
+                streams[s], NUM_LOOKUPS, usec_bsearch, usec_index,
+                usec_index > 0.0 ? usec_bsearch / usec_index : 0.0, mismatch + found);
+  }
+  free (addr);
+  #undef NUM_LOOKUPS
+}
+
 static bool aircraft_tests (void)
 {
   aircraft_test_1();
   aircraft_test_2();
+  aircraft_test_4();   /* before 'aircraft_test_3()' frees the CSV-list */
   aircraft_test_3();
   return (true);
 }
@@ -549,7 +886,7 @@ bool aircraft_CSV_update (const char *db_file, const char *url)
 
   if (download_to_file(url, zip_file) <= 0)
   {
-    LOG_STDERR ("Failed to download '%s': '%s'\n", zip_file, Modes.wininet_last_error);
+    LOG_STDERR ("Failed to download '%s': '%s'\n", zip_file, wininet_last_error());
     return (false);
   }
 
@@ -640,6 +977,7 @@ bool aircraft_SQL_set_name (void)
 
     memset (&st, '\0', sizeof(st));
     snprintf (aircraft_sql, sizeof(aircraft_sql), "%s.sqlite", Modes.aircraft_db);
+    snprintf (aircraft_sql_tmp, sizeof(aircraft_sql_tmp), "%s.sqlite.tmp", Modes.aircraft_db);
     have_sql_file = (stat (aircraft_sql, &st) == 0) && (st.st_size > 8*1024);
     TRACE ("Aircraft Sqlite database \"%s\", size: %ld", aircraft_sql, have_sql_file ? st.st_size : 0);
 
@@ -754,6 +1092,8 @@ bool aircraft_CSV_load (void)
     {
       qsort (Modes.aircraft_list_CSV, Modes.aircraft_num_CSV, sizeof(*Modes.aircraft_list_CSV),
              CSV_compare_on_addr);
+      if (!CSV_index_build())
+         LOG_STDERR ("Failed to build the CSV-index. Using 'bsearch()'.\n");
       csv_load_t = get_usec_now() - usec;
     }
   }
@@ -765,19 +1105,29 @@ bool aircraft_CSV_load (void)
 
     LOG_STDOUT ("Creating SQL-database '%s'... ", aircraft_sql);
     usec = get_usec_now();
-    sql_begin();
-
-    for (i = 0; i < Modes.aircraft_num_CSV; i++, a++)
-        if (!sql_add_entry (i, a))
-           break;
+    i = 0;
+    if (sql_begin())
+    {
+      for (i = 0; i < Modes.aircraft_num_CSV; i++, a++)
+          if (!sql_add_entry (i, a))
+             break;
+    }
 
-    sql_end();
+    sql_end (i == Modes.aircraft_num_CSV);
     sql_create_t = get_usec_now() - usec;
 
     if (i != Modes.aircraft_num_CSV)
-         LOG_STDOUT ("\nCreated only %u out of %u records!\n", i, Modes.aircraft_num_CSV);
+         LOG_STDOUT ("\nCreated only %u out of %u records! Not using '%s'.\n", i, Modes.aircraft_num_CSV, aircraft_sql);
     else LOG_STDOUT ("\nCreated %u records\n", Modes.aircraft_num_CSV);
   }
+  else if (sql_created)
+  {
+    sql_end (false);   /* Nothing to add. Remove the temp-file */
+  }
+
+  usec = get_usec_now();
+  if (ICAO_filter_build())
+     TRACE ("ICAO-filter built in %.3f ms", (get_usec_now() - usec)/1E3);
 
   if (test_contains(Modes.tests, "aircraft"))
   {
@@ -1229,7 +1579,7 @@ static void sql_log (void *cb_arg, int err, const char *str)
   (void) cb_arg;
 }
 
-static bool sql_init (const char *what, int flags)
+static bool sql_init (const char *db_file, const char *what, int flags)
 {
   int rc;
 
@@ -1239,7 +1589,7 @@ static bool sql_init (const char *what, int flags)
   if (!strcmp(what, "load"))
      return (true);
 
-  rc = sqlite3_open_v2 (aircraft_sql, &Modes.sql_db, flags, NULL);
+  rc = sqlite3_open_v2 (db_file, &Modes.sql_db, flags, NULL);
   if (rc != SQLITE_OK)
   {
     TRACE ("Can't %s database: rc: %d, %s", what, rc, sqlite3_errmsg(Modes.sql_db));
@@ -1250,19 +1600,22 @@ static bool sql_init (const char *what, int flags)
 }
 
 /**
- * Create the `aircraft_sql` database with 5 columns.
+ * Create the `aircraft_sql_tmp` database with 5 columns.
  *
- * And make the CSV callback add the records into the `aircraft_sql` file.
+ * The records gets added into this file and `sql_end()` renames
+ * it to `aircraft_sql` when all went well.
  */
 static bool sql_create (void)
 {
   char *err_msg = NULL;
   int   rc;
 
-  if (!sql_init("create", SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE))
+  DeleteFileA (aircraft_sql_tmp);   /* a left-over from a crash? */
+
+  if (!sql_init(aircraft_sql_tmp, "create", SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE))
      return (false);
 
-  rc = sqlite3_exec (Modes.sql_db, "CREATE TABLE aircrafts (" DB_COLUMNS ");",
+  rc = sqlite3_exec (Modes.sql_db, DB_PRAGMAS "CREATE TABLE aircrafts (" DB_COLUMNS ");",
                      NULL, NULL, &err_msg);
 
   if (rc != SQLITE_OK &&
@@ -1278,9 +1631,12 @@ static bool sql_create (void)
 
 static bool sql_open (void)
 {
-  return sql_init ("open", SQLITE_OPEN_READONLY);
+  return sql_init (aircraft_sql, "open", SQLITE_OPEN_READONLY);
 }
 
+/**
+ * Start a transaction and prepare the `sql_insert_stmt`.
+ */
 static bool sql_begin (void)
 {
   char *err_msg = NULL;
@@ -1290,50 +1646,92 @@ static bool sql_begin (void)
   {
     TRACE ("rc: %d, %s", rc, err_msg);
     sqlite3_free (err_msg);
+    return (false);
+  }
+
+  rc = sqlite3_prepare_v2 (Modes.sql_db, DB_INSERT " (?,?,?,?,?);", -1, &sql_insert_stmt, NULL);
+  if (rc != SQLITE_OK)
+  {
+    TRACE ("rc: %d, %s", rc, sqlite3_errmsg(Modes.sql_db));
+    sql_insert_stmt = NULL;
   }
   return (rc == SQLITE_OK);
 }
 
-static bool sql_end (void)
+/**
+ * Finish the bulk-load into `aircraft_sql_tmp`:
+ *  \li commit the transaction (or roll it back if `ok == false`).
+ *  \li create the `icao24` index now that all records are added.
+ *  \li close it and rename it to `aircraft_sql`. `MoveFileExA()` is
+ *      atomic on the same volume; a crash never leaves a partial `aircraft_sql`.
+ *  \li open `aircraft_sql` read-only for the lookups.
+ */
+static bool sql_end (bool ok)
 {
   char *err_msg = NULL;
-  int   rc = sqlite3_exec (Modes.sql_db, "END;", NULL, NULL, &err_msg);
+  int   rc;
 
-  if (rc != SQLITE_OK)
+  if (sql_insert_stmt)
+     sqlite3_finalize (sql_insert_stmt);
+  sql_insert_stmt = NULL;
+
+  if (!Modes.sql_db)
+     ok = false;
+  else
   {
-    TRACE ("rc: %d, %s", rc, err_msg);
-    sqlite3_free (err_msg);
+    rc = sqlite3_exec (Modes.sql_db, ok ? "END; CREATE INDEX icao24_index ON aircrafts (icao24);" : "ROLLBACK;",
+                       NULL, NULL, &err_msg);
+    if (rc != SQLITE_OK)
+    {
+      TRACE ("rc: %d, %s", rc, err_msg);
+      sqlite3_free (err_msg);
+      ok = false;
+    }
+    sqlite3_close (Modes.sql_db);
+    Modes.sql_db = NULL;
   }
-  return (rc == SQLITE_OK);
+
+  if (ok && !MoveFileExA(aircraft_sql_tmp, aircraft_sql, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+  {
+    LOG_STDERR ("MoveFileExA (\"%s\", \"%s\") failed: %s\n",
+                aircraft_sql_tmp, aircraft_sql, win_strerror(GetLastError()));
+    ok = false;
+  }
+
+  if (!ok)
+  {
+    DeleteFileA (aircraft_sql_tmp);
+    have_sql_file = false;
+    return (false);
+  }
+  return sql_open();
 }
 
 /**
- * Add a CSV-record to the SQlite database.
+ * Add a CSV-record to the SQlite database using the `sql_insert_stmt`.
  *
- * Use the `%m` format and `mg_print_esc()` to escape some possible control characters.
- * The `%m` format adds double-quotes around the strings. Hence single-quotes needs no
- * ESCaping.
+ * Since the values are bound as parameters, no ESCaping is needed.
  *
  * Another "feature" of Sqlite is that upper-case hex values are turned into lower-case
- * when 'SELECT * FROM' is done!
+ * when 'SELECT * FROM' is done! Hence store `icao24` as lower-case text.
  */
 static bool sql_add_entry (uint32_t num, const aircraft_info *rec)
 {
-  char   buf [sizeof(*rec) + sizeof(DB_INSERT) + 100];
-  char  *values, *err_msg = NULL;
-  int    rc;
+  char addr [7];
+  int  rc;
 
-  mg_snprintf (buf, sizeof(buf),
-               DB_INSERT " ('%06x',%m,%m,%m,%m)",
-               rec->addr,
-               mg_print_esc, 0, rec->reg_num,
-               mg_print_esc, 0, rec->manufact,
-               mg_print_esc, 0, rec->type,
-               mg_print_esc, 0, rec->call_sign);
+  if (!sql_insert_stmt)
+     return (false);
 
-  values = buf + sizeof(DB_INSERT) + 1;
+  snprintf (addr, sizeof(addr), "%06x", rec->addr);
+  sqlite3_bind_text (sql_insert_stmt, 1, addr,           -1, SQLITE_STATIC);
+  sqlite3_bind_text (sql_insert_stmt, 2, rec->reg_num,   -1, SQLITE_STATIC);
+  sqlite3_bind_text (sql_insert_stmt, 3, rec->manufact,  -1, SQLITE_STATIC);
+  sqlite3_bind_text (sql_insert_stmt, 4, rec->type,      -1, SQLITE_STATIC);
+  sqlite3_bind_text (sql_insert_stmt, 5, rec->call_sign, -1, SQLITE_STATIC);
 
-  rc = sqlite3_exec (Modes.sql_db, buf, NULL, NULL, &err_msg);
+  rc = sqlite3_step (sql_insert_stmt);
+  sqlite3_reset (sql_insert_stmt);
 
   if (((num + 1) % 1000) == 0)
   {
@@ -1345,10 +1743,9 @@ static bool sql_add_entry (uint32_t num, const aircraft_info *rec)
        printf ("%u\b\b\b\b", num);
   }
 
-  if (rc != SQLITE_OK)
+  if (rc != SQLITE_DONE)
   {
-    TRACE ("\nError at record %u: rc:%d, err_msg: %s\nvalues: '%s'", num, rc, err_msg, values);
-    sqlite3_free (err_msg);
+    TRACE ("\nError at record %u: rc:%d, err_msg: %s\naddr: '%s'", num, rc, sqlite3_errmsg(Modes.sql_db), addr);
     return (false);
   }
   return (true);
@@ -1460,7 +1857,7 @@ char *aircraft_make_json (bool extended_client)
   static uint32_t json_file_num = 0;
   struct timeval tv_now;
   aircraft      *a = Modes.aircrafts;
-  int            size, left = 1024;    /* The initial buffer is incremented as needed */
+  int            size, left = 1024;    /* The initial buffer is doubled as needed */
   uint32_t       aircrafts = 0;
   char          *buf = malloc (left);
   char          *p = buf;
@@ -1494,13 +1891,17 @@ char *aircraft_make_json (bool extended_client)
 
     if (left < 256)    /* Resize 'buf' if needed */
     {
-      int used = p - buf;
-
-      left += 1024;    /* Our increment */
-      buf = realloc (buf, used + left);
-      if (!buf)
-         return (NULL);
+      int   used = p - buf;
+      char *more;
 
+      left = used + 2 * left;    /* double the size */
+      more = realloc (buf, used + left);
+      if (!more)
+      {
+        free (buf);
+        return (NULL);
+      }
+      buf = more;
       p = buf + used;
     }
   }
@@ -1528,6 +1929,430 @@ char *aircraft_make_json (bool extended_client)
   return (buf);
 }
 
+static int json_ws_compare (const void *_a, const void *_b)
+{
+  const json_ws_entry *a = _a;
+  const json_ws_entry *b = _b;
+
+  return (a->addr < b->addr ? -1 : a->addr > b->addr ? 1 : 0);
+}
+
+/**
+ * Return a malloced WebSocket message with the changes since the previous update:
+ * ```
+ *  {"type":"delta", "now":1656176445.123, "aircraft":[{"hex":"47807D", ...}],
+ *   "removed":["4CA7B5"]}
+ * ```
+ *
+ * An aircraft is in `"aircraft"` if the JSON in `aircraft_make_1_json()` changed.
+ * And in `"removed"` if it was in the previous update, but not in this.
+ * Returns NULL if nothing changed.
+ *
+ * Otherwise `*full` is set to a malloced snapshot message of all aircrafts:
+ * ```
+ *  {"type":"snapshot", "aircraft":[{"hex":"47807D", ...}]}
+ * ```
+ */
+static char *aircraft_make_json_delta (char **full)
+{
+  const aircraft      *a;
+  json_ws_entry       *list, *e;
+  const json_ws_entry *prev;
+  uint32_t             num = 0, changed = 0, removed = 0, i;
+  struct timeval       tv_now;
+  mg_iobuf             io, all;
+  char                 line [512];
+  int                  len;
+
+  *full = NULL;
+
+  for (a = Modes.aircrafts; a; a = a->next)
+      if (VALID_POS(a->position))
+         num++;
+
+  list = calloc (num + 1, sizeof(*list));
+  if (!list)
+     return (NULL);
+
+  _gettimeofday (&tv_now, NULL);
+  mg_iobuf_init (&io, 0, 1024);
+  mg_iobuf_init (&all, 0, 1024);
+  mg_iobuf_add (&all, 0, "{\"type\":\"snapshot\", \"aircraft\":[\n", 33);
+  len = mg_snprintf (line, sizeof(line), "{\"type\":\"delta\", \"now\":%lu.%03lu, \"aircraft\":[\n",
+                     tv_now.tv_sec, tv_now.tv_usec/1000);
+  mg_iobuf_add (&io, io.len, line, len);
+
+  for (i = 0, a = Modes.aircrafts; a; a = a->next)
+  {
+    if (!VALID_POS(a->position))
+       continue;
+
+    len = (int) aircraft_make_1_json (a, false, line, sizeof(line));
+    e = list + i++;
+    e->addr = a->addr;
+    e->crc  = mg_crc32 (0, line, len);
+    mg_iobuf_add (&all, all.len, line, len);
+
+    prev = bsearch (e, g_json.sent, g_json.sent_num, sizeof(*e), json_ws_compare);
+    if (prev && prev->crc == e->crc)
+       continue;
+
+    mg_iobuf_add (&io, io.len, line, len);
+    changed++;
+  }
+
+  if (changed > 0)   /* ignore the last ",\n" */
+     io.len -= 2;
+  if (num > 0)
+     all.len -= 2;
+  mg_iobuf_add (&all, all.len, "]}", 3);
+
+  qsort (list, num, sizeof(*list), json_ws_compare);
+  mg_iobuf_add (&io, io.len, "],\n\"removed\":[", 14);
+
+  for (i = 0; i < g_json.sent_num; i++)
+  {
+    if (bsearch(g_json.sent + i, list, num, sizeof(*list), json_ws_compare))
+       continue;
+    len = mg_snprintf (line, sizeof(line), "%s\"%06X\"", removed++ ? "," : "", g_json.sent[i].addr);
+    mg_iobuf_add (&io, io.len, line, len);
+  }
+  mg_iobuf_add (&io, io.len, "]}", 3);   /* incl. the 0-terminator */
+
+  free (g_json.sent);
+  g_json.sent     = list;
+  g_json.sent_num = num;
+
+  if (changed + removed == 0 || !io.buf || !all.buf)
+  {
+    mg_iobuf_free (&io);
+    mg_iobuf_free (&all);
+    return (NULL);
+  }
+  *full = (char*) all.buf;
+  return ((char*) io.buf);
+}
+
+/**
+ * Return a new `json_data` with a reference-count of 1 for a malloced `json`.
+ * `json` is freed.
+ */
+static json_data *aircraft_json_new (char *json, uint32_t seq)
+{
+  json_data *j;
+  size_t     len;
+
+  if (!json)
+     return (NULL);
+
+  len = strlen (json);
+  j = malloc (sizeof(*j) + len);
+  if (j)
+  {
+    j->refs     = 1;
+    j->seq      = seq;
+    j->len      = len;
+    j->gzip     = NULL;
+    j->gzip_len = 0;
+    memcpy (j->data, json, len + 1);
+  }
+  free (json);
+  return (j);
+}
+
+/**
+ * \def BINCRAFT_STRIDE
+ * Size of the header and of each aircraft record made by `aircraft_make_binCraft()`.
+ *
+ * \def BINCRAFT_VERSION
+ * The readsb binCraft version we follow.
+ */
+#define BINCRAFT_STRIDE   112
+#define BINCRAFT_VERSION  20240218
+
+/**
+ * \typedef binCraft_rec
+ *
+ * An aircraft record in the readsb "binCraft" format as decoded by `wqi()`
+ * in `web_root-Tar1090/formatter.js`. All values are little-endian.
+ * Only the fields we know are set. The rest are 0.
+ */
+#pragma pack(push, 1)
+typedef struct binCraft_rec {
+        uint32_t  addr;           /**<   0: ICAO address. Bit 24 set for a non-ICAO address */
+        int32_t   seen;           /**<   4: seconds since the last message * 10 */
+        int32_t   lon;            /**<   8: longitude * 1E6 */
+        int32_t   lat;            /**<  12: latitude * 1E6 */
+        int16_t   baro_rate;      /**<  16: feet/min / 8 */
+        int16_t   geom_rate;      /**<  18: feet/min / 8 */
+        int16_t   alt_baro;       /**<  20: feet / 25 */
+        int16_t   alt_geom;       /**<  22: feet / 25 */
+        uint16_t  nav [4];        /**<  24: nav_altitude_mcp, nav_altitude_fms, nav_qnh, nav_heading */
+        uint16_t  squawk;         /**<  32: the 4 octal digits as hex-digits */
+        int16_t   gs;             /**<  34: ground-speed in knots * 10 */
+        int16_t   mach;           /**<  36: mach * 1000 */
+        int16_t   roll;           /**<  38: degrees * 100 */
+        int16_t   track;          /**<  40: degrees * 90 */
+        int16_t   other16 [10];   /**<  42: track_rate .. rc */
+        uint16_t  messages;       /**<  62: number of messages */
+        uint8_t   other8 [9];     /**<  64: category .. SIL bits */
+        uint8_t   valid [5];      /**<  73: validity bits */
+        char      flight [8];     /**<  78: call-sign; not 0-terminated if 8 characters */
+        uint16_t  db_flags;       /**<  86: military etc. */
+        char      type [4];       /**<  88: ICAO type-code */
+        char      reg [12];       /**<  92: registration */
+        uint8_t   receivers;      /**< 104: number of receivers */
+        uint8_t   rssi;           /**< 105: sqrt (signal power) * 255 */
+        uint8_t   extra_flags;    /**< 106 */
+        uint8_t   reserved;       /**< 107 */
+        int32_t   seen_pos;       /**< 108: seconds since the last position * 10 */
+      } binCraft_rec;
+#pragma pack(pop)
+
+/**
+ * Return a squawk in base10 (as in `aircraft::identity`) as 4 hex-digits.
+ */
+static uint16_t binCraft_squawk (int identity)
+{
+  return (uint16_t) ((((identity / 1000) % 10) << 12) + (((identity / 100) % 10) << 8) +
+                     (((identity / 10) % 10) << 4) + (identity % 10));
+}
+
+/**
+ * Fill a binCraft record for one aircraft.
+ * Returns true if it has a valid position.
+ */
+static bool aircraft_make_1_binCraft (const aircraft *a, binCraft_rec *rec, uint64_t now)
+{
+  const aircraft_info *info = a->SQL ? a->SQL : a->CSV;
+  uint64_t             pos_time = max (a->odd_CPR_time, a->even_CPR_time);
+  bool                 valid_pos = VALID_POS (a->position);
+
+  rec->addr     = a->addr & 0xFFFFFF;
+  rec->seen     = (int32_t) ((now - a->seen_last) / 100);
+  rec->alt_baro = (int16_t) (a->altitude / 25);
+  rec->gs       = (int16_t) (10 * a->speed);
+  rec->track    = (int16_t) (90 * a->heading);
+  rec->squawk   = binCraft_squawk (a->identity);
+  rec->messages = (uint16_t) min (a->messages, 0xFFFF);
+  rec->receivers = 1;
+  strncpy (rec->flight, a->call_sign, sizeof(rec->flight));
+
+  rec->valid [0] = 16 | 128;           /* alt_baro, gs */
+  if (a->call_sign[0])
+     rec->valid [0] |= 8;              /* flight */
+  if (a->heading_is_valid)
+     rec->valid [1] |= 8;              /* track */
+  if (a->identity)
+     rec->valid [3] |= 4;              /* squawk */
+
+  if (valid_pos)
+  {
+    rec->lon       = (int32_t) (1E6 * a->position.lon);
+    rec->lat       = (int32_t) (1E6 * a->position.lat);
+    rec->seen_pos  = (int32_t) ((now - min(pos_time, now)) / 100);
+    rec->valid [0] |= 64;              /* lat, lon, seen_pos */
+  }
+
+  if (info)
+  {
+    strncpy (rec->type, info->type, sizeof(rec->type));
+    strncpy (rec->reg, info->reg_num, sizeof(rec->reg));
+  }
+  if (aircraft_is_military(a->addr, NULL))
+     rec->db_flags = 1;
+  return (valid_pos);
+}
+
+/**
+ * Return a new `json_data` with all aircrafts in the readsb "binCraft" format.
+ * A header of `BINCRAFT_STRIDE` bytes followed by a `binCraft_rec` for each aircraft.
+ *
+ * The Tar1090 web-client gets this from "/data/aircraft.binCraft" since
+ * "/data/receiver.json" says `"binCraft": true`.
+ */
+static json_data *aircraft_make_binCraft (bool header_only, uint32_t seq)
+{
+  const aircraft *a;
+  json_data      *j;
+  binCraft_rec   *rec;
+  uint32_t       *hdr;
+  uint32_t        num = 0, with_pos = 0;
+  uint64_t        now = MSEC_TIME();
+  uint64_t        now_ms;
+  struct timeval  tv_now;
+  size_t          len;
+
+  if (!header_only)
+     for (a = Modes.aircrafts; a; a = a->next)
+         num++;
+
+  len = BINCRAFT_STRIDE * (num + 1);
+  j = calloc (sizeof(*j) + len, 1);
+  if (!j)
+     return (NULL);
+
+  j->refs = 1;
+  j->seq  = seq;
+  j->len  = len;
+
+  rec = (binCraft_rec*) (j->data + BINCRAFT_STRIDE);
+  for (a = header_only ? NULL : Modes.aircrafts; a; a = a->next, rec++)
+      if (aircraft_make_1_binCraft(a, rec, now))
+         with_pos++;
+
+  _gettimeofday (&tv_now, NULL);
+  now_ms = 1000ULL * tv_now.tv_sec + tv_now.tv_usec / 1000;
+
+  hdr = (uint32_t*) j->data;
+  hdr [0] = (uint32_t) now_ms;
+  hdr [1] = (uint32_t) (now_ms >> 32);
+  hdr [2] = BINCRAFT_STRIDE;
+  hdr [3] = with_pos;
+  hdr [7] = (uint32_t) Modes.stat.messages_total;
+  if (Modes.home_pos_ok)
+  {
+    hdr [8] = (uint32_t) (int32_t) (1E6 * Modes.home_pos.lat);
+    hdr [9] = (uint32_t) (int32_t) (1E6 * Modes.home_pos.lon);
+  }
+  hdr [10] = BINCRAFT_VERSION;
+  return (j);
+}
+
+/**
+ * Forget the WebSocket messages and the aircrafts sent in them.
+ * Then the first new client gets a fresh snapshot.
+ */
+static void aircraft_json_ws_reset (void)
+{
+  AcquireSRWLockExclusive (&g_json.lock);
+  FREE (g_json.delta);
+  FREE (g_json.ws_full);
+  ReleaseSRWLockExclusive (&g_json.lock);
+  FREE (g_json.sent);
+  g_json.sent_num = 0;
+}
+
+/**
+ * Called from `background_tasks()` 4 times per second.
+ *
+ * Build the delta for the WebSocket clients in the main thread. Only if the
+ * network thread has any "/ws/aircraft" clients.
+ * And every `Modes.json_interval` msec, the JSON snapshots for the HTTP-server.
+ * These are shared by all HTTP-clients until the next snapshot.
+ */
+void aircraft_json_update (void)
+{
+  json_data *data [JSON_KINDS] = { NULL, NULL, NULL };
+  char      *delta = NULL, *full = NULL;
+  uint64_t   now = MSEC_TIME();
+  int        i;
+
+  if (!Modes.http_out)
+     return;
+
+  if (Modes.ws_clients > 0)
+     delta = aircraft_make_json_delta (&full);
+  else if (g_json.sent || g_json.ws_full)
+     aircraft_json_ws_reset();
+
+  if (now - g_json.data_time >= Modes.json_interval)
+  {
+    g_json.data_time = now;
+    g_json.data_seq++;
+    data [JSON_DUMP1090] = aircraft_json_new (aircraft_make_json(false), g_json.data_seq);
+    data [JSON_EXTENDED] = aircraft_json_new (aircraft_make_json(true), g_json.data_seq);
+    data [JSON_BINCRAFT] = aircraft_make_binCraft (false, g_json.data_seq);
+  }
+
+  AcquireSRWLockExclusive (&g_json.lock);
+  for (i = 0; i < DIM(data); i++)
+  {
+    if (!data[i])
+       continue;
+    aircraft_json_put (g_json.data[i]);
+    g_json.data [i] = data [i];
+  }
+  if (delta)
+  {
+    free (g_json.delta);
+    free (g_json.ws_full);
+    g_json.delta   = delta;
+    g_json.ws_full = full;
+    g_json.seq++;
+  }
+  ReleaseSRWLockExclusive (&g_json.lock);
+}
+
+/**
+ * Return a malloced WebSocket message for a client which has seen the update `*seq`.
+ * Called from the network thread.
+ *
+ * If the client has seen the previous update, return the delta. Otherwise
+ * a snapshot of all aircrafts like:
+ * ```
+ *  {"type":"snapshot", "aircraft":[{"hex":"47807D", ...}]}
+ * ```
+ *
+ * Returns NULL if nothing changed. Otherwise `*seq` is set to the update returned.
+ */
+char *aircraft_json_ws (uint32_t *seq)
+{
+  char *data = NULL;
+
+  AcquireSRWLockShared (&g_json.lock);
+  if (g_json.seq != *seq)
+  {
+    if (g_json.seq == *seq + 1 && g_json.delta)
+         data = strdup (g_json.delta);
+    else if (g_json.ws_full)
+         data = strdup (g_json.ws_full);
+    *seq = g_json.seq;
+  }
+  ReleaseSRWLockShared (&g_json.lock);
+  return (data);
+}
+
+/**
+ * Return a reference to the latest JSON snapshot.
+ * Called from the network thread. Release it with `aircraft_json_put()`.
+ *
+ * Before the first `aircraft_json_update()`, return an empty array.
+ */
+json_data *aircraft_json_get (json_kind kind)
+{
+  json_data *j;
+
+  AcquireSRWLockShared (&g_json.lock);
+  j = g_json.data [kind];
+  if (j)
+     InterlockedIncrement (&j->refs);
+  ReleaseSRWLockShared (&g_json.lock);
+
+  if (j)
+     return (j);
+
+  if (kind == JSON_BINCRAFT)
+     return aircraft_make_binCraft (true, 0);
+  if (kind == JSON_EXTENDED)
+     return aircraft_json_new (mg_mprintf("{\"now\":%llu, \"messages\":%llu, \"aircraft\":\n[]\n}",
+                                          (uint64_t) time (NULL), Modes.stat.messages_total), 0);
+  return aircraft_json_new (strdup("[]"), 0);
+}
+
+/**
+ * Release a reference from `aircraft_json_get()`.
+ * The last reference frees it.
+ */
+void aircraft_json_put (json_data *j)
+{
+  if (j && InterlockedDecrement(&j->refs) == 0)
+  {
+    free (j->gzip);
+    free (j);
+  }
+}
+
 /**
  * Called from `background_tasks()` 4 times per second.
  *
@@ -1643,6 +2468,14 @@ void aircraft_show_stats (void)
 
   LOG_STDOUT (" %8llu unique aircrafts of which %llu was in CSV-file and %llu in SQL-file.\n",
               Modes.stat.unique_aircrafts, Modes.stat.unique_aircrafts_CSV, Modes.stat.unique_aircrafts_SQL);
+  interactive_clreol();
+
+  if (ICAO_known)
+  {
+    LOG_STDOUT (" %8llu ICAO-filter hits (not in database), %llu misses (database lookups).\n",
+                Modes.stat.ICAO_filter_hits, Modes.stat.ICAO_filter_misses);
+    interactive_clreol();
+  }
 
 #if 0  /**\todo print details on unique aircrafts */
   const ac_unique *a;
@@ -1665,6 +2498,11 @@ void aircraft_show_stats (void)
 void aircraft_exit (bool free_aircrafts)
 {
   aircraft *a, *a_next;
+  int       i;
+
+  if (sql_insert_stmt)
+     sqlite3_finalize (sql_insert_stmt);
+  sql_insert_stmt = NULL;
 
   if (Modes.sql_db)
      sqlite3_close (Modes.sql_db);
@@ -1673,6 +2511,15 @@ void aircraft_exit (bool free_aircrafts)
   if (!free_aircrafts)
      return;
 
+  for (i = 0; i < JSON_KINDS; i++)
+  {
+    aircraft_json_put (g_json.data[i]);
+    g_json.data [i] = NULL;
+  }
+  FREE (g_json.ws_full);
+  FREE (g_json.delta);
+  FREE (g_json.sent);
+
   /* Remove all active aircrafts from the list.
    */
   for (a = Modes.aircrafts; a; a = a_next)
@@ -1686,4 +2533,6 @@ void aircraft_exit (bool free_aircrafts)
   if (Modes.aircraft_list_CSV)
      free (Modes.aircraft_list_CSV);
   Modes.aircraft_list_CSV = NULL;
+  CSV_index_free();
+  FREE (ICAO_known);
 }
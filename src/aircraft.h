@@ -82,6 +82,11 @@ typedef struct aircraft {
         char      EST_distance_buf [20];  /**< Buffer for `get_est_home_distance()` */
         double    sig_levels [4];         /**< RSSI signal-levels from the last 4 messages */
         int       sig_idx;
+        uint8_t   source;                 /**< The `upstream` source of the last message. 0 if local or not an upstream */
+        uint32_t  recent_hash   [8];      /**< Hash of the last 8 upstream messages; for `aircraft_is_duplicate()` */
+        uint64_t  recent_time   [8];      /**< Tick-time of those */
+        uint8_t   recent_source [8];      /**< And the `upstream` source of those */
+        int       recent_idx;
 
         /* Encoded latitude and longitude as extracted by odd and even
          * CPR encoded messages.
@@ -94,17 +99,48 @@ typedef struct aircraft {
         uint64_t  even_CPR_time;          /**< Tick-time for reception of an even CPR message */
         pos_t     position;               /**< Coordinates obtained from decoded CPR data */
         pos_t     EST_position;           /**< Estimated position based on last `speed` and `heading` */
+        pos_t     nearest_pos;            /**< `position` at the last nearest-airport query */
+        char      nearest_airport [10];   /**< ICAO code of the nearest airport */
+        double    nearest_distance;       /**< Distance (in meters) to `nearest_airport` */
+        bool      near_airport;           /**< Approaching or departing `nearest_airport` */
 
         aircraft_info       *SQL;         /**< A pointer to a SQL record (or NULL) */
         const aircraft_info *CSV;         /**< A pointer to a CSV record in `Modes.aircraft_list_CSV` (or NULL) */
         struct aircraft     *next;        /**< Next aircraft in our linked list */
       } aircraft;
 
+/**
+ * \enum json_kind
+ * The kinds of aircraft snapshots for the HTTP-clients.
+ */
+typedef enum json_kind {
+        JSON_DUMP1090 = 0,     /**< JSON for the default web-page */
+        JSON_EXTENDED,         /**< JSON for an extended web-client */
+        JSON_BINCRAFT,         /**< binary records for the Tar1090 web-client */
+        JSON_KINDS
+      } json_kind;
+
+/**
+ * \typedef json_data
+ *
+ * A reference-counted snapshot of the aircrafts shared by all HTTP-clients.
+ * Get it with `aircraft_json_get()` and release it with `aircraft_json_put()`.
+ */
+typedef struct json_data {
+        volatile LONG refs;       /**< The reference-count */
+        uint32_t      seq;        /**< Incremented for each new snapshot. Used in the ETag */
+        size_t        len;        /**< Length of `data` */
+        char         *gzip;       /**< `data` gzip compressed. Made once by the network thread when needed */
+        size_t        gzip_len;   /**< Length of `gzip` */
+        char          data [1];   /**< The JSON text. Or the binCraft records */
+      } json_data;
+
 
 bool        aircraft_CSV_load (void);
 bool        aircraft_CSV_update (const char *db_file, const char *url);
 bool        aircraft_SQL_set_name (void);
 aircraft   *aircraft_find_or_create (uint32_t addr, uint64_t now);
+bool        aircraft_is_duplicate (const modeS_message *mm, uint64_t now);
 int         aircraft_numbers (void);
 uint32_t    aircraft_get_addr (uint8_t a0, uint8_t a1, uint8_t a2);
 const char *aircraft_get_details (const uint8_t *_a);
@@ -113,6 +149,10 @@ bool        aircraft_is_military (uint32_t addr, const char **country);
 bool        aircraft_is_helicopter (uint32_t addr, const char **code);
 void        aircraft_set_est_home_distance (aircraft *a, uint64_t now);
 char       *aircraft_make_json (bool extended_client);
+json_data  *aircraft_json_get (json_kind kind);
+void        aircraft_json_put (json_data *j);
+char       *aircraft_json_ws (uint32_t *seq);
+void        aircraft_json_update (void);
 void        aircraft_remove_stale (uint64_t now);
 void        aircraft_show_stats (void);
 void        aircraft_exit (bool free_aircrafts);
@@ -8,10 +8,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <ctype.h>
+#include <math.h>
+#include <float.h>
 #include <locale.h>
 #include <mbstring.h>
 
 #include "misc.h"
+#include "zip.h"
 #include "interactive.h"
 #include "routes.h"
 #include "airports.h"
@@ -19,11 +23,29 @@
 #define API_SERVICE_URL     "https://vrs-standing-data.adsb.lol/routes/%.2s/%s.json"
 #define API_SERVICE_503     "<html><head><title>503 Service Temporarily Unavailable"
 
-#define API_AIRPORT_IATA    "\"_airport_codes_iata\": "    /* what to look for in response */
-#define API_AIRPORT_ICAO    "\"airport_codes\": "          /* todo: look for these ICAO codes too */
+#define API_ROUTESET_URL    "https://api.adsb.lol/api/0/routeset"
+#define API_AIRPORT_IATA    "\"_airport_codes_iata\":"     /* what to look for in response */
+#define API_AIRPORT_ICAO    "\"airport_codes\":"           /* todo: look for these ICAO codes too */
 #define API_SLEEP_MS        100                            /* Sleep() granularity */
 #define API_MAX_AGE         (10 * 60 * 10000000ULL)        /* 10 min in 100 nsec units */
-#define API_CACHE_PERIOD    (5 * 60 * 1000)                /* Save the cache every 5 min */
+#define API_CACHE_PERIOD    (5 * 60 * 1000)                /* Check the cache journal every 5 min */
+#define API_JOURNAL_HEADER  "# type,callsign,departure,destination,icao,timestamp\n"
+#define API_JOURNAL_FIELDS  6                              /* Fields in a journal line */
+#define API_JOURNAL_MIN     1000                           /* Min records in the journal before a compaction */
+#define API_JOURNAL_GARBAGE 50                             /* Compact when more than 50% of the journal is garbage */
+#define API_MAX_THREADS     16                             /* Max value of `Modes.adsb_lol_requests` */
+#define API_REQUESTS        4                              /* Default number of concurrent requests */
+#define API_RATE            5                              /* Default max requests per second */
+#define API_BURST           10                             /* Max requests in a burst (token-bucket depth) */
+#define API_BACKOFF_MIN     1000                           /* First backoff (msec) after a HTTP 429/503 */
+#define API_BACKOFF_MAX     64000                          /* Max backoff (msec) */
+#define API_MAX_RETRIES     5                              /* Max retries for a call-sign after a HTTP 429/503 */
+#define API_EXIT_WAIT       500                            /* Max msec to wait for the API-threads to exit */
+#define API_BATCH           50                             /* Default max call-signs in a routeset request */
+#define API_BATCH_MAX       100                            /* Max value of `Modes.adsb_lol_batch` */
+#define API_BATCH_WAIT      250                            /* Max msec to collect call-signs for a routeset request */
+#define FLIGHT_HASH_SIZE    4096                           /* Buckets in each `flight_store` hash-table */
+#define FLIGHT_INFO_MAX     10000                          /* Max records in the `flight_store` before evicting */
 #define ICAO_UNKNOWN        0xFFFFFFFF                     /* mark an unused ICAO address */
 
 /**
@@ -59,14 +81,74 @@ typedef struct airport {
         char            full_name [50];  /**< Full name */
         pos_t           pos;             /**< latitude & longitude */
         airport_t       type;            /**< source of this record */
-        struct airport *next;            /**< next airport in our linked list */
       } airport;
 
+/**
+ * \typedef airport_index
+ *
+ * The hash-indices on ICAO and IATA codes for `g_data.airport_CSV`.
+ * Both are open-addressing tables in one block of `2 * (mask + 1)` slots.
+ * A slot holds an index into `g_data.airport_CSV` + 1. 0 == an empty slot.
+ */
+typedef struct airport_index {
+        const uint32_t *ICAO_slots;   /**< hash-table on ICAO code */
+        const uint32_t *IATA_slots;   /**< hash-table on IATA code; the first airport for a code */
+        uint32_t        mask;         /**< number of slots in each table - 1 */
+      } airport_index;
+
+/**
+ * \typedef airport_snapshot_hdr
+ *
+ * The header of the binary snapshot `Modes.airport_db` + ".bin".
+ * It is followed by the sorted `airport` records and then the `airport_index` slots.
+ * It is rebuilt when `Modes.airport_db` changes.
+ */
+typedef struct airport_snapshot_hdr {
+        char      magic [8];      /**< `AIRPORT_SNAPSHOT_MAGIC` */
+        uint32_t  version;        /**< `AIRPORT_SNAPSHOT_VERSION` */
+        uint32_t  rec_size;       /**< `sizeof(airport)` */
+        uint32_t  num_records;    /**< number of `airport` records */
+        uint32_t  num_ICAO;       /**< of which have an ICAO code */
+        uint32_t  num_IATA;       /**< of which have an IATA code */
+        uint32_t  index_size;     /**< number of slots in each `airport_index` table */
+        uint64_t  csv_size;       /**< size of the `Modes.airport_db` this was built from */
+        uint64_t  csv_mtime;      /**< and its modification time */
+      } airport_snapshot_hdr;
+
+#define AIRPORT_SNAPSHOT_MAGIC    "D1090APT"
+#define AIRPORT_SNAPSHOT_VERSION  1
+
+/**
+ * \typedef airport_kd_node
+ *
+ * A node in the k-d tree of airport positions.
+ * The tree is implicit; the median of a range `[lo, hi)` is the node splitting it.
+ * The split axis is `c_x`, `c_y` or `c_z` by the depth in the tree.
+ */
+typedef struct airport_kd_node {
+        cartesian_t cart;   /**< the airport position on Cartesian form */
+        uint32_t    idx;    /**< index into `g_data.airport_CSV` */
+      } airport_kd_node;
+
+/**
+ * \def AIRPORT_NEAREST_MOVE
+ * Do a new nearest-airport query for an aircraft when it has moved this far (meters).
+ *
+ * \def AIRPORT_NEAR_RADIUS
+ * An aircraft inside this radius (meters) of it's nearest airport is approaching or departing.
+ *
+ * \def AIRPORT_NEAR_ALTITUDE
+ * And below this altitude (feet).
+ */
+#define AIRPORT_NEAREST_MOVE   2000.0
+#define AIRPORT_NEAR_RADIUS   10000.0
+#define AIRPORT_NEAR_ALTITUDE  5000
+
 /**
  * \typedef airport_freq
  *
  * Data for a single airport frequency.
- * Also contains a link to a `g_data.airports_priv.airports` node.
+ * Also contains a link to a `g_data.airport_CSV` record.
  */
 typedef struct airport_freq {
         char           freq_id [3];
@@ -93,9 +175,36 @@ typedef struct flight_info {
         FILETIME            created;           /**< time when this record was created and requested (UTC) */
         FILETIME            responded;         /**< time when this record had a response (UTC) */
         int                 http_status;       /**< the HTTP status-code (or 0) */
-        struct flight_info *next;              /**< next flight in our linked list */
+        uint32_t            retries;           /**< number of retries after a HTTP 429/503 */
+        volatile LONG       referenced;        /**< looked up since the last eviction pass */
+        struct flight_info *q_next;            /**< next flight in the `API_queue` */
+        struct flight_info *cs_next;           /**< next flight in a `flight_store::by_call_sign` bucket */
+        struct flight_info *addr_next;         /**< next flight in a `flight_store::by_addr` bucket */
+        struct flight_info *next;              /**< next flight in the `flight_store` list; oldest first */
       } flight_info;
 
+/**
+ * \typedef flight_store
+ *
+ * The store of all `flight_info` records with hash-indices on call-sign and ICAO address.
+ *
+ * \li Lookups take `lock` shared. Inserts, state changes and evictions take it exclusive.
+ * \li Only the main-thread evicts records (in `airports_background()`). Hence a
+ *     `AIRPORT_API_LIVE` or `AIRPORT_API_CACHED` record found by the main-thread
+ *     stays valid until then. The API-threads never change such a record.
+ * \li The list is in approximate LRU order. A record looked up since the last
+ *     eviction pass gets a second chance at the tail (the CLOCK algorithm).
+ */
+typedef struct flight_store {
+        SRWLOCK       lock;
+        flight_info  *head;                             /**< the oldest record */
+        flight_info  *tail;                             /**< the newest record */
+        flight_info  *by_call_sign [FLIGHT_HASH_SIZE];  /**< hash-table on call-sign */
+        flight_info  *by_addr      [FLIGHT_HASH_SIZE];  /**< hash-table on ICAO address */
+        uint32_t      num;                              /**< number of records */
+        uint32_t      evicted;                          /**< number of records evicted */
+      } flight_store;
+
 /**
  * \typedef flight_info_stats
  *
@@ -124,9 +233,20 @@ typedef struct airports_stats {
         uint32_t  API_response_recv;   /**< Count of ANY responses received in API-thread */
         uint32_t  API_service_404;     /**< Count of "404 Not found" responses */
         uint32_t  API_service_503;     /**< Count of "503 Service Temporarily Unavailable" responses */
-        uint32_t  API_added_CSV;       /**< Count of cached flight-info record in `g_data.flight_info`. */
+        uint32_t  API_service_429;     /**< Count of "429 Too Many Requests" responses */
+        uint32_t  API_retries;         /**< Count of requests retried after a HTTP 429/503 */
+        uint32_t  API_dedup;           /**< Count of call-signs already queued or in-flight */
+        uint32_t  API_queue_max;       /**< Max length of the `API_queue` */
+        uint32_t  API_batches;         /**< Count of routeset requests sent */
+        uint32_t  API_batched;         /**< Count of call-signs in these requests */
+        uint32_t  API_added_CSV;       /**< Count of cached flight-info record in `g_data.flights`. */
         uint32_t  API_used_CSV;        /**< Count of cached flight-info record that was used in a lookup. */
         uint32_t  routes_records_used;
+        uint32_t  routes_hash_hits;      /**< Count of call-signs found in the `route_index::hash` */
+        uint32_t  routes_blocks_decoded; /**< Count of route blocks decompressed */
+        uint32_t  routes_cache_hits;     /**< Count of route blocks found in the LRU cache */
+        uint32_t  nearest_queries;     /**< Count of nearest-airport queries in the k-d tree */
+        uint32_t  nearest_skipped;     /**< Count of position updates not moving an aircraft `AIRPORT_NEAREST_MOVE` */
       } airports_stats;
 
 /**
@@ -139,23 +259,139 @@ typedef struct airport_names {
         const char *IATA;
       } airport_names;
 
+/**
+ * \def ROUTES_CACHE_BLOCKS
+ * Number of decompressed blocks of routes in the LRU cache.
+ */
+#define ROUTES_CACHE_BLOCKS  16
+#define ROUTES_NO_BLOCK      0xFFFFFFFF
+
+/**
+ * \typedef route_cache
+ *
+ * A decompressed and decoded block of `routes.bin` in the `route_index::cache`.
+ */
+typedef struct route_cache {
+        uint32_t      block;       /**< the block number. `ROUTES_NO_BLOCK` == an unused entry */
+        uint32_t      num;         /**< number of `records` */
+        uint64_t      last_used;   /**< `route_index::tick` when this block was last used */
+        route_record *records;     /**< the decoded routes */
+      } route_cache;
+
+/**
+ * \def ROUTES_HASH_SIZE
+ * Number of slots in the `route_index::hash`. Must be a power of 2.
+ */
+#define ROUTES_HASH_SIZE  4096
+
+/**
+ * \typedef route_slot
+ *
+ * A call-sign looked up in the route blocks. With the departure and destination
+ * airports resolved. A call-sign without a route is kept too.
+ * Only a miss in the `route_index::hash` needs a block search.
+ */
+typedef struct route_slot {
+        uint32_t       hash;              /**< `upper_hash()` of `call_sign` */
+        bool           found;             /**< the call-sign has a route */
+        char           call_sign   [10];  /**< "" == an unused slot */
+        char           departure   [10];  /**< ICAO departure airport */
+        char           destination [10];  /**< ICAO destination airport */
+        const airport *dep;               /**< the departure airport in `g_data.airport_CSV` or NULL */
+        const airport *dest;              /**< the destination airport in `g_data.airport_CSV` or NULL */
+      } route_slot;
+
+/**
+ * \typedef route_index
+ *
+ * The memory-mapped `Modes.routes_db`, the LRU cache of decoded blocks
+ * and the hash of looked up call-signs.
+ * Setup in `routes_init_index()`. Only used from the main-thread.
+ */
+typedef struct route_index {
+        const uint8_t         *view;       /**< the mapped view of `Modes.routes_db` */
+        const routes_file_hdr *hdr;        /**< the header at the start of `view` */
+        const routes_block    *blocks;     /**< the block index following `hdr` */
+        uint64_t               size;       /**< size of `Modes.routes_db` */
+        uint8_t               *raw;        /**< buffer for a decompressed block */
+        uint32_t               raw_size;   /**< size of `raw`; the largest `routes_block::raw_size` + 1 */
+        uint64_t               tick;       /**< the LRU clock */
+        route_cache            cache [ROUTES_CACHE_BLOCKS];
+        route_slot            *hash;       /**< direct-mapped on `upper_hash()`; `ROUTES_HASH_SIZE` slots */
+      } route_index;
+
+/**
+ * \typedef API_queue
+ *
+ * The FIFO work-queue of `AIRPORT_API_PENDING` records for the API-threads.
+ * Requests are rate-limited by a token-bucket and paused (with an exponential
+ * backoff) when the service says we sent too many requests.
+ * All fields are protected by `lock`.
+ */
+typedef struct API_queue {
+        CRITICAL_SECTION    lock;
+        CONDITION_VARIABLE  wakeup;                      /**< signalled on a new record or at exit */
+        flight_info        *head;                        /**< next record to request */
+        flight_info        *tail;                        /**< last record queued */
+        uint32_t            len;                         /**< number of records in the queue */
+        flight_info        *in_flight [API_MAX_THREADS]; /**< the records being requested now; a `q_next` chain per API-thread */
+        uint64_t            first_queued;                /**< time the oldest record was queued (msec) */
+        uint32_t            batch;                       /**< max call-signs in one request. 1 == no routeset requests */
+        uint32_t            rate;                        /**< the token-bucket refill rate; requests per sec */
+        double              tokens;                      /**< tokens in the token-bucket */
+        uint64_t            last_refill;                 /**< time of last refill (msec) */
+        uint32_t            backoff;                     /**< the current backoff (msec). 0 if none */
+        uint64_t            backoff_until;               /**< no requests are sent before this time (msec) */
+        bool                quit;                        /**< tell the API-threads to exit */
+        bool                stopped;                     /**< all API-threads have exited */
+      } API_queue;
+
+/**
+ * \typedef API_journal
+ *
+ * The append-only journal of resolved flight-information in `Modes.airport_cache`.
+ * The API-threads add records to `buf` as they resolve. The main-thread appends
+ * them to `file` and compacts it when the garbage ratio gets high.
+ * At startup the journal is replayed; a later record for a call-sign
+ * replaces an earlier one.
+ */
+typedef struct API_journal {
+        FILE      *file;         /**< the journal opened for appending */
+        char      *buf;          /**< resolved records not yet written. Protected by `API_queue::lock` */
+        size_t     buf_len;      /**< length of `buf` */
+        size_t     buf_size;     /**< allocated size of `buf` */
+        uint32_t   buf_records;  /**< number of records in `buf` */
+        uint32_t   records;      /**< number of records in `file`; including garbage */
+        uint32_t   replaced;     /**< number of records replaced by a later record at replay */
+        uint32_t   appended;     /**< number of records appended in this session */
+        uint32_t   compactions;  /**< number of compactions in this session */
+      } API_journal;
+
 /**
  * \typedef airports_priv
  *
  * Private data for this module.
  */
 typedef struct airports_priv {
-        airport          *airports;       /**< Linked list of airports */
-        airport          *airport_CSV;    /**< List of airports sorted on ICAO address. From CSV-file only */
-        char            **IATA_to_ICAO;   /**< List of IATA to ICAO airport codes sorted on IATA address */
-        flight_info      *flight_info;    /**< Linked list of flights information */
+        airport          *airport_CSV;    /**< List of airports sorted on ICAO address. Read-only if mapped */
+        airport_index     airport_idx;    /**< Hash-indices for `airport_CSV` */
+        const uint8_t    *snapshot;       /**< The mapped view of the snapshot; `airport_CSV` is in it */
+        mg_file_path      snapshot_file;  /**< The name of the snapshot */
+        airport_kd_node  *kd_tree;        /**< k-d tree of airport positions */
+        uint32_t          kd_num;         /**< number of nodes in `kd_tree` */
+        flight_store      flights;        /**< All flights information */
         airport_freq     *freq_CSV;       /**< List of airport freuency information. Not yet */
         CSV_context       csv_ctx;        /**< Structure for the CSV parser */
         airports_stats    ap_stats;       /**< Accumulated statistics for airports */
         flight_info_stats fs_stats;       /**< Accumulated statistics for flight-info */
-        uintptr_t         thread_hnd;     /**< Thread-handle from `_beginthreadex()` */
-        HANDLE            thread_event;   /**< Thread-event for `API_thread_func()` to signal on */
-        unsigned          thread_id;      /**< Thread-ID from `_beginthreadex()` */
+        route_index       routes;         /**< The mapped `Modes.routes_db` */
+        API_queue         API_queue;      /**< The work-queue for the API-threads */
+        API_journal       journal;        /**< The journal for the `Modes.airport_cache` */
+        HANDLE            thread_hnd [API_MAX_THREADS];  /**< Thread-handles from `_beginthreadex()` */
+        unsigned          thread_id  [API_MAX_THREADS];  /**< Thread-IDs from `_beginthreadex()` */
+        uint32_t          num_threads;    /**< Number of API-threads running */
+        const char       *API_url;        /**< `Modes.adsb_lol_url` or `API_SERVICE_URL` */
+        const char       *API_routeset_url; /**< `Modes.adsb_lol_routeset_url` or `API_ROUTESET_URL` */
         bool              do_trace;       /**< Use `API_TRACE()` macro? */
         bool              do_trace_LOL;   /**< or use `API_TRACE_LOL()` macro? */
         bool              init_done;
@@ -178,11 +414,16 @@ static void         airport_CSV_test_3 (void);
 static void         airport_CSV_test_4 (void);
 static void         airport_loc_test_1 (void);
 static void         airport_loc_test_2 (void);
+static void         airport_kd_test_1 (void);
+static bool         airports_build_kd_tree (void);
 static void         airport_print_header (unsigned line, bool use_usec);
 static void         locale_test (void);
-static void         flight_info_exit (FILE *f);
+static void         flight_info_exit (void);
+static void         flight_store_evict (void);
 static flight_info *flight_info_create (const char *call_sign, uint32_t addr, airport_t type);
+static flight_info *flight_info_find_by_callsign (const char *call_sign);
 static bool         flight_info_write (FILE *file, const flight_info *f);
+static size_t       flight_info_format (char *buf, size_t size, const flight_info *f);
 static void         flight_stats_now (flight_info_stats *stats);
 static const char  *find_airport_location (const char *IATA_or_ICAO);
 
@@ -386,64 +627,88 @@ static double   hit_rate;
 const char     *usec_fmt;
 
 /**
- * The compare function for `qsort()` and `bsearch()`.
+ * The FNV-1a hash of an upper-cased string; a call-sign or an airport code.
+ */
+static uint32_t upper_hash (const char *str)
+{
+  uint32_t hash = 2166136261U;
+
+  while (*str)
+  {
+    hash ^= (uint8_t) toupper ((uint8_t) *str++);
+    hash *= 16777619U;
+  }
+  return (hash);
+}
+
+/**
+ * The compare function for `qsort()`.
  */
 static int CSV_compare_on_ICAO (const void *_a, const void *_b)
 {
   const airport *a = (const airport*) _a;
   const airport *b = (const airport*) _b;
-  int   rc = stricmp (a->ICAO, b->ICAO);
 
-  num_lookups++;
-  if (rc)
-     num_misses++;
-  return (rc);
+  return stricmp (a->ICAO, b->ICAO);
 }
 
 /**
- * Do a binary search for an ICAO airport-name in `g_data.airport_CSV`.
+ * Probe one of the `g_data.airport_idx` hash-tables for an airport code.
+ * Update the `hit_rate` for the number of slots probed.
+ *
+ * \param[in] slots   the `ICAO_slots` or `IATA_slots` table.
+ * \param[in] code    the airport code to look for.
+ * \param[in] is_ICAO true if `code` is an ICAO code.
  */
-static const airport *CSV_lookup_ICAO (const char *ICAO)
+static const airport *CSV_lookup_code (const uint32_t *slots, const char *code, bool is_ICAO)
 {
-  const airport *a = NULL;
+  uint32_t i;
 
   num_lookups = num_misses = 0;
   hit_rate = 0.0;
 
-  if (g_data.airport_CSV)
+  if (!slots || !code || !code[0])
+     return (NULL);
+
+  for (i = upper_hash(code) & g_data.airport_idx.mask; slots[i]; i = (i + 1) & g_data.airport_idx.mask)
   {
-    airport key;
+    const airport *a = g_data.airport_CSV + slots[i] - 1;
 
-    strcpy_s (key.ICAO, sizeof(key.ICAO), ICAO);
-    a = bsearch (&key, g_data.airport_CSV, g_data.ap_stats.CSV_numbers,
-                 sizeof(*g_data.airport_CSV), CSV_compare_on_ICAO);
-    if (num_lookups)
+    num_lookups++;
+    if (!stricmp(code, is_ICAO ? a->ICAO : a->IATA))
     {
-      if (num_misses == 0)
-           hit_rate = 1.0F;
-      else hit_rate = 1.0F - ((double)num_misses / (double)num_lookups);
-      hit_rate *= 100.0F;
+      hit_rate = 100.0F / (double) num_lookups;
+      return (a);
     }
+    num_misses++;
   }
-  return (a);
+  return (NULL);
+}
+
+/**
+ * Do a hash-lookup for an ICAO airport-name in `g_data.airport_CSV`.
+ */
+static const airport *CSV_lookup_ICAO (const char *ICAO)
+{
+  return CSV_lookup_code (g_data.airport_idx.ICAO_slots, ICAO, true);
 }
 
-static int CSV_compare_on_ICAO_str (const void *a, const void *b)
+/**
+ * Do a hash-lookup for an IATA airport-name in `g_data.airport_CSV`.
+ */
+static const airport *CSV_lookup_IATA (const char *IATA)
 {
-  return stricmp ((const char*)a, (const char*)b);
+  return CSV_lookup_code (g_data.airport_idx.IATA_slots, IATA, false);
 }
 
 /**
- * Do a binary search for an IATA to ICAO airport-name mapping.
- * Does not work.
+ * Return the ICAO airport-name for an IATA airport-name.
  */
 static const char *IATA_to_ICAO (const char *IATA)
 {
-  if (!g_data.IATA_to_ICAO || !IATA)
-     return (NULL);
+  const airport *a = CSV_lookup_IATA (IATA);
 
-  return bsearch (IATA, g_data.IATA_to_ICAO, g_data.ap_stats.CSV_numbers,
-                  sizeof(char*), CSV_compare_on_ICAO_str);
+  return (a && a->ICAO[0] ? a->ICAO : NULL);
 }
 
 /**
@@ -470,15 +735,195 @@ static const char *airport_t_str (airport_t type)
   return (buf);
 }
 
+/**
+ * Build the ICAO and IATA hash-indices for the sorted `g_data.airport_CSV`.
+ * Both tables are in one block of `2 * size` slots.
+ * For a duplicated code, the first airport in `g_data.airport_CSV` is indexed.
+ */
+static uint32_t *airports_build_index (uint32_t *size_p)
+{
+  uint32_t *slots, *ICAO_slots, *IATA_slots;
+  uint32_t  i, j, size = 1024;
+
+  while (size < 2 * g_data.ap_stats.CSV_numbers)
+        size <<= 1;
+
+  slots = calloc (2 * size, sizeof(*slots));
+  if (!slots)
+     return (NULL);
+
+  ICAO_slots = slots;
+  IATA_slots = slots + size;
+
+  for (i = 0; i < g_data.ap_stats.CSV_numbers; i++)
+  {
+    const airport *a = g_data.airport_CSV + i;
+
+    if (a->ICAO[0])
+    {
+      for (j = upper_hash(a->ICAO) & (size - 1); ICAO_slots[j]; j = (j + 1) & (size - 1))
+          if (!stricmp(a->ICAO, g_data.airport_CSV[ICAO_slots[j] - 1].ICAO))
+             break;
+      if (!ICAO_slots[j])
+         ICAO_slots [j] = i + 1;
+    }
+    if (a->IATA[0])
+    {
+      for (j = upper_hash(a->IATA) & (size - 1); IATA_slots[j]; j = (j + 1) & (size - 1))
+          if (!stricmp(a->IATA, g_data.airport_CSV[IATA_slots[j] - 1].IATA))
+             break;
+      if (!IATA_slots[j])
+         IATA_slots [j] = i + 1;
+    }
+  }
+  *size_p = size;
+  return (slots);
+}
+
+/**
+ * Get the size and modification time of `Modes.airport_db`.
+ */
+static bool airports_CSV_stat (uint64_t *size, uint64_t *mtime)
+{
+  WIN32_FILE_ATTRIBUTE_DATA attr;
+
+  if (!GetFileAttributesExA(Modes.airport_db, GetFileExInfoStandard, &attr))
+     return (false);
+
+  *size  = ((uint64_t)attr.nFileSizeHigh << 32) + attr.nFileSizeLow;
+  *mtime = ((uint64_t)attr.ftLastWriteTime.dwHighDateTime << 32) + attr.ftLastWriteTime.dwLowDateTime;
+  return (true);
+}
+
+/**
+ * Try to memory-map a snapshot built from the current `Modes.airport_db`.
+ * If it is valid, `g_data.airport_CSV` and `g_data.airport_idx` points into the view.
+ */
+static bool airports_snapshot_map (uint64_t csv_size, uint64_t csv_mtime)
+{
+  const airport_snapshot_hdr *hdr;
+  const uint8_t *view;
+  HANDLE         file, map;
+  LARGE_INTEGER  fsize;
+  uint64_t       need;
+
+  file = CreateFileA (g_data.snapshot_file, GENERIC_READ, FILE_SHARE_READ, NULL,
+                      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE)
+     return (false);
+
+  if (!GetFileSizeEx(file, &fsize) || fsize.QuadPart < (LONGLONG)sizeof(*hdr))
+  {
+    CloseHandle (file);
+    return (false);
+  }
+
+  map = CreateFileMappingA (file, NULL, PAGE_READONLY, 0, 0, NULL);
+  CloseHandle (file);
+  if (!map)
+     return (false);
+
+  view = MapViewOfFile (map, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle (map);    /* the view keeps the mapping open */
+  if (!view)
+     return (false);
+
+  hdr  = (const airport_snapshot_hdr*) view;
+  need = sizeof(*hdr) + (uint64_t)hdr->num_records * sizeof(airport) +
+         2 * (uint64_t)hdr->index_size * sizeof(uint32_t);
+
+  if (memcmp(hdr->magic, AIRPORT_SNAPSHOT_MAGIC, sizeof(hdr->magic)) ||
+      hdr->version   != AIRPORT_SNAPSHOT_VERSION ||
+      hdr->rec_size  != sizeof(airport) ||
+      hdr->csv_size  != csv_size ||
+      hdr->csv_mtime != csv_mtime ||
+      hdr->index_size == 0 || (hdr->index_size & (hdr->index_size - 1)) ||
+      need != (uint64_t)fsize.QuadPart)
+  {
+    TRACE ("Snapshot \"%s\" is stale or invalid", g_data.snapshot_file);
+    UnmapViewOfFile (view);
+    return (false);
+  }
+
+  g_data.snapshot                = view;
+  g_data.airport_CSV             = (airport*) (view + sizeof(*hdr));
+  g_data.airport_idx.ICAO_slots  = (const uint32_t*) (g_data.airport_CSV + hdr->num_records);
+  g_data.airport_idx.IATA_slots  = g_data.airport_idx.ICAO_slots + hdr->index_size;
+  g_data.airport_idx.mask        = hdr->index_size - 1;
+  g_data.ap_stats.CSV_numbers    = hdr->num_records;
+  g_data.ap_stats.CSV_num_ICAO   = hdr->num_ICAO;
+  g_data.ap_stats.CSV_num_IATA   = hdr->num_IATA;
+  return (true);
+}
+
+/**
+ * Write a snapshot of the sorted `g_data.airport_CSV` and it's hash-indices.
+ * Write to a temporary file first and rename it; a failure here is not fatal.
+ */
+static void airports_snapshot_write (uint64_t csv_size, uint64_t csv_mtime)
+{
+  airport_snapshot_hdr hdr;
+  mg_file_path         tmp_file;
+  FILE                *f;
+  uint32_t             size = g_data.airport_idx.mask + 1;
+  bool                 ok;
+
+  memset (&hdr, '\0', sizeof(hdr));
+  memcpy (hdr.magic, AIRPORT_SNAPSHOT_MAGIC, sizeof(hdr.magic));
+  hdr.version     = AIRPORT_SNAPSHOT_VERSION;
+  hdr.rec_size    = sizeof(airport);
+  hdr.num_records = g_data.ap_stats.CSV_numbers;
+  hdr.num_ICAO    = g_data.ap_stats.CSV_num_ICAO;
+  hdr.num_IATA    = g_data.ap_stats.CSV_num_IATA;
+  hdr.index_size  = size;
+  hdr.csv_size    = csv_size;
+  hdr.csv_mtime   = csv_mtime;
+
+  snprintf (tmp_file, sizeof(tmp_file), "%s.tmp", g_data.snapshot_file);
+  f = fopen (tmp_file, "wb");
+  if (!f)
+  {
+    LOG_STDERR ("Failed to create \"%s\": %s\n", tmp_file, strerror(errno));
+    return;
+  }
+
+  ok = (fwrite (&hdr, sizeof(hdr), 1, f) == 1 &&
+        fwrite (g_data.airport_CSV, sizeof(airport), hdr.num_records, f) == hdr.num_records &&
+        fwrite (g_data.airport_idx.ICAO_slots, sizeof(uint32_t), 2 * size, f) == 2 * size);
+  ok = (fclose(f) == 0) && ok;
+
+  if (!ok || !MoveFileExA(tmp_file, g_data.snapshot_file, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+  {
+    LOG_STDERR ("Failed to write \"%s\": %s\n", g_data.snapshot_file, win_strerror(GetLastError()));
+    DeleteFileA (tmp_file);
+    return;
+  }
+  TRACE ("Wrote %u records to \"%s\"", hdr.num_records, g_data.snapshot_file);
+}
+
 /*
- * Open and parse 'airport-codes.cvs' into the linked list `g_data.airport_CSV`.
+ * Open and parse 'airport-codes.cvs' into the array `g_data.airport_CSV`
+ * and build the ICAO and IATA hash-indices for it.
  *
- * Also create a mapping of "IATA to ICAO" names (`g_data.IATA_to_ICAO`).
+ * Or if `Modes.airport_db` has not changed since the last time,
+ * simply memory-map the snapshot `g_data.snapshot_file` of these.
  */
 static bool airports_init_CSV (void)
 {
   double   start_t = get_usec_now();
-  uint32_t i;
+  uint64_t csv_size = 0, csv_mtime = 0;
+  bool     have_stat;
+  uint32_t i, size;
+
+  snprintf (g_data.snapshot_file, sizeof(g_data.snapshot_file), "%s.bin", Modes.airport_db);
+  have_stat = airports_CSV_stat (&csv_size, &csv_mtime);
+
+  if (have_stat && airports_snapshot_map(csv_size, csv_mtime))
+  {
+    TRACE ("Mapped %u records in %.3f msec from: \"%s\"",
+           g_data.ap_stats.CSV_numbers, (get_usec_now() - start_t) / 1E3, g_data.snapshot_file);
+    return airports_build_kd_tree();
+  }
 
   memset (&g_data.csv_ctx, '\0', sizeof(g_data.csv_ctx));
   g_data.csv_ctx.file_name  = Modes.airport_db;
@@ -500,588 +945,2072 @@ static bool airports_init_CSV (void)
 
   if (g_data.ap_stats.CSV_numbers > 0)
   {
-    airport *a = g_data.airport_CSV + 0;
+    uint32_t *slots;
 
     qsort (g_data.airport_CSV, g_data.ap_stats.CSV_numbers, sizeof(*g_data.airport_CSV),
            CSV_compare_on_ICAO);
 
-    for (i = 0; i < g_data.ap_stats.CSV_numbers; i++, a++)
-    {
-      a->type = AIRPORT_CSV;
-      LIST_ADD_TAIL (airport, &g_data.airports, a);
-    }
+    for (i = 0; i < g_data.ap_stats.CSV_numbers; i++)
+        g_data.airport_CSV [i].type = AIRPORT_CSV;
 
-    g_data.IATA_to_ICAO = malloc (sizeof(char*) * g_data.ap_stats.CSV_numbers);
-    if (g_data.IATA_to_ICAO)
+    slots = airports_build_index (&size);
+    if (!slots)
     {
-      for (i = 0, a = g_data.airports; a; a = a->next, i++)
-          g_data.IATA_to_ICAO [i] = a->IATA;
-      qsort (g_data.IATA_to_ICAO, g_data.ap_stats.CSV_numbers, sizeof(char*),
-             CSV_compare_on_ICAO_str);
+      LOG_STDERR ("Failed to allocate the airport indices.\n");
+      return (false);
     }
+    g_data.airport_idx.ICAO_slots = slots;
+    g_data.airport_idx.IATA_slots = slots + size;
+    g_data.airport_idx.mask       = size - 1;
+
+    if (have_stat)
+       airports_snapshot_write (csv_size, csv_mtime);
   }
-  return (true);
+  return airports_build_kd_tree();
 }
 
 /*
- * Free memory allocated above.
+ * Free or unmap the memory from above.
  */
 static void airports_exit_CSV (void)
 {
-  if (g_data.airport_CSV)
-     free (g_data.airport_CSV);
-
+  if (g_data.snapshot)
+     UnmapViewOfFile (g_data.snapshot);
+  else
+  {
+    free (g_data.airport_CSV);
+    free ((void*)g_data.airport_idx.ICAO_slots);
+  }
+  free (g_data.kd_tree);
+  g_data.kd_tree     = NULL;
+  g_data.kd_num      = 0;
+  g_data.snapshot    = NULL;
   g_data.airport_CSV = NULL;
+  memset (&g_data.airport_idx, '\0', sizeof(g_data.airport_idx));
   g_data.ap_stats.CSV_numbers = 0;
 }
 
 /**
- * \todo
- * Open and parse `Modes.airport_freq_db` into the linked list `g_data.airport_freq_CSV`
+ * Return the coordinate of a k-d node for an `axis`.
  */
-static bool airports_init_freq_CSV (void)
+static double kd_coord (const cartesian_t *cart, unsigned axis)
 {
-  return (true);
+  if (axis == 0)
+     return (cart->c_x);
+  if (axis == 1)
+     return (cart->c_y);
+  return (cart->c_z);
 }
 
-static void airports_exit_freq_CSV (void)
+/**
+ * The squared straight-line distance between 2 Cartesian points.
+ * Unlike `cartesian_distance()`, this includes the `c_z` axis.
+ */
+static double kd_dist2 (const cartesian_t *a, const cartesian_t *b)
 {
-}
+  double dx = a->c_x - b->c_x;
+  double dy = a->c_y - b->c_y;
+  double dz = a->c_z - b->c_z;
 
-#if defined(USE_GEN_ROUTES)
-static int routes_compare (const void *a, const void *b)
-{
-  return stricmp ((const char*)a, (const char*)b);
+  return (dx*dx + dy*dy + dz*dz);
 }
 
 /**
- * Look in `route_records[]` before posting a requst to the ADSB-LOL API.
+ * Partition `nodes [lo, hi)` so the node at `mid` is the median on `axis`.
+ * A quick-select; no need for a full sort.
  */
-static flight_info *routes_find_by_callsign (const char *call_sign)
+static void kd_select (airport_kd_node *nodes, uint32_t lo, uint32_t hi, uint32_t mid, unsigned axis)
 {
-  static flight_info  f;
-  const route_record *r = NULL;
-  const airport      *dep, *dest;
-
-  if (route_records_num > 0)
-     r = bsearch (call_sign, route_records, route_records_num,
-                  sizeof(route_records[0]), routes_compare);
+  airport_kd_node tmp;
 
-  if (!r)
-     return (NULL);
-
-  /* Rewrite 'r' into a 'f' record.
-   * Convert ICAO names to IATA if possible.
-   * Ignoring the 5 possible stop-over airports
-   */
-  memset (&f, '\0', sizeof(f));
-  strncpy (f.call_sign, r->call_sign, sizeof(f.call_sign)-1);
-  f.type    = AIRPORT_API_CACHED;
-  f.created = Modes.start_FILETIME;
-  dep  = CSV_lookup_ICAO (r->departure);
-  dest = CSV_lookup_ICAO (r->destination);
-
-  strncpy (f.departure,   dep  ? dep->IATA  : r->departure, sizeof(f.departure)-1);
-  strncpy (f.destination, dest ? dest->IATA : r->destination, sizeof(f.destination)-1);
-
-#if 0
-  flight_info *f2 = memdup (&f, sizeof(f));
-  if (f2)
-     LIST_ADD_TAIL (flight_info, &g_data.flight_info, f2);
-#endif
+  while (hi - lo > 1)
+  {
+    double   pivot = kd_coord (&nodes[(lo + hi) / 2].cart, axis);
+    uint32_t i = lo, j = hi - 1;
 
-  return (&f);
+    while (i <= j)
+    {
+      while (kd_coord(&nodes[i].cart, axis) < pivot)
+            i++;
+      while (kd_coord(&nodes[j].cart, axis) > pivot)
+            j--;
+      if (i <= j)
+      {
+        tmp = nodes[i];
+        nodes [i] = nodes[j];
+        nodes [j] = tmp;
+        i++;
+        if (j == 0)
+           break;
+        j--;
+      }
+    }
+    if (mid <= j)
+       hi = j + 1;
+    else if (mid >= i)
+       lo = i;
+    else break;
+  }
 }
-#endif /* USE_GEN_ROUTES */
 
-static void routes_find_test_1 (void)
+static void kd_build (airport_kd_node *nodes, uint32_t lo, uint32_t hi, unsigned depth)
 {
-#if !defined(USE_GEN_ROUTES)
-  printf ("%s(): '-DUSE_GEN_ROUTES' not defined.\n", __FUNCTION__);
-
-#else
-  size_t num = min (10, route_records_num);
-  size_t i, rec_num;
-
-  printf ("%s():\n  Checking %zu random records among %zu records.\n", __FUNCTION__, num, route_records_num);
-  printf ("  Record  call-sign  DEP     DEST    (departure        -> destination)\n"
-          "  ---------------------------------------------------------------------------------\n");
-
-  for (i = 0; i < num; i++)
-  {
-    const flight_info *f;
-    const char        *dep, *dest;
-    const char        *call_sign;
-
-    rec_num   = (size_t) random_range (0, route_records_num - 1);
-    call_sign = route_records [rec_num].call_sign;
-
-    f = routes_find_by_callsign (call_sign);
+  uint32_t mid;
 
-    /* `f` should never be NULL here
-     */
-    dep  = find_airport_location (f->departure);
-    dest = find_airport_location (f->destination);
+  if (hi - lo <= 1)
+     return;
 
-    printf ("  %6zu  %-7s    %-7s %-7s (%-16s -> %s)\n",
-            rec_num, f->call_sign, f->departure, f->destination,
-            dep ? dep : "?", dest ? dest : "?");
-  }
-#endif /* USE_GEN_ROUTES */
-  puts ("");
+  mid = lo + (hi - lo) / 2;
+  kd_select (nodes, lo, hi, mid, depth % 3);
+  kd_build (nodes, lo, mid, depth + 1);
+  kd_build (nodes, mid + 1, hi, depth + 1);
 }
 
 /**
- * Add a cached flight-info record to `g_data.flight_info`.
+ * Build the k-d tree `g_data.kd_tree` over all airports with a valid position.
+ * Done at load time of `g_data.airport_CSV`; the records themselves are not moved.
  */
-static int API_add_entry (const flight_info *rec)
+static bool airports_build_kd_tree (void)
 {
-  flight_info *f = flight_info_create (rec->call_sign, rec->ICAO_addr, AIRPORT_API_CACHED);
+  double   start_t = get_usec_now();
+  uint32_t i;
 
-  if (f)
+  free (g_data.kd_tree);
+  g_data.kd_num  = 0;
+  g_data.kd_tree = malloc (sizeof(*g_data.kd_tree) * (g_data.ap_stats.CSV_numbers + 1));
+  if (!g_data.kd_tree)
   {
-    ULONGLONG ft_diff;
+    LOG_STDERR ("Failed to allocate the airport k-d tree.\n");
+    return (false);
+  }
 
-    f->created = rec->created;
-    strcpy (f->departure, rec->departure);
-    strcpy (f->destination, rec->destination);
-    g_data.ap_stats.API_added_CSV++;
+  for (i = 0; i < g_data.ap_stats.CSV_numbers; i++)
+  {
+    const airport *a = g_data.airport_CSV + i;
 
-    /* Check if 'Modes.start_FILETIME - rec->created > API_MAX_AGE'.
-     */
-    ft_diff = *(ULONGLONG*) &Modes.start_FILETIME - *(ULONGLONG*) &rec->created;
-    if (ft_diff > API_MAX_AGE)
-       f->type = AIRPORT_API_EXPIRED;
+    if (!VALID_POS(a->pos))
+       continue;
+    spherical_to_cartesian (&a->pos, &g_data.kd_tree[g_data.kd_num].cart);
+    g_data.kd_tree [g_data.kd_num++].idx = i;
   }
-  return (f ? 1 : 0);
+
+  kd_build (g_data.kd_tree, 0, g_data.kd_num, 0);
+  TRACE ("Built k-d tree of %u airports in %.3f msec", g_data.kd_num, (get_usec_now() - start_t) / 1E3);
+  return (true);
 }
 
-static int API_cache_callback (struct CSV_context *ctx, const char *value)
+static void kd_nearest (uint32_t lo, uint32_t hi, unsigned depth, const cartesian_t *target,
+                        uint32_t *best, double *best_d2)
 {
-  static flight_info rec;
-  int    rc = 1;
+  const airport_kd_node *n;
+  double   d2, diff;
+  uint32_t mid;
 
-  if (ctx->field_num == 0)
-     rec.type = atoi (value);
+  if (lo >= hi)
+     return;
 
-  else if (ctx->field_num == 1)
-     strncpy (rec.call_sign, value, sizeof(rec.call_sign)-1);
+  mid = lo + (hi - lo) / 2;
+  n   = g_data.kd_tree + mid;
+  d2  = kd_dist2 (&n->cart, target);
+  if (d2 < *best_d2)
+  {
+    *best_d2 = d2;
+    *best    = n->idx;
+  }
 
-  else if (ctx->field_num == 2)
-     strncpy (rec.departure, value, sizeof(rec.departure)-1);
+  diff = kd_coord (target, depth % 3) - kd_coord (&n->cart, depth % 3);
+  if (diff < 0.0)
+  {
+    kd_nearest (lo, mid, depth + 1, target, best, best_d2);
+    if (diff * diff < *best_d2)
+       kd_nearest (mid + 1, hi, depth + 1, target, best, best_d2);
+  }
+  else
+  {
+    kd_nearest (mid + 1, hi, depth + 1, target, best, best_d2);
+    if (diff * diff < *best_d2)
+       kd_nearest (lo, mid, depth + 1, target, best, best_d2);
+  }
+}
 
-  else if (ctx->field_num == 3)
-     strncpy (rec.destination, value, sizeof(rec.destination)-1);
+static void kd_within (uint32_t lo, uint32_t hi, unsigned depth, const cartesian_t *target,
+                       double max_d2, const airport **result, uint32_t max, uint32_t *num)
+{
+  const airport_kd_node *n;
+  double   diff;
+  uint32_t mid;
 
-  else if (ctx->field_num == 4)
-     rec.ICAO_addr = mg_unhexn (value, 6);
+  if (lo >= hi)
+     return;
 
-  else if (ctx->field_num == 5)
+  mid = lo + (hi - lo) / 2;
+  n   = g_data.kd_tree + mid;
+  if (kd_dist2(&n->cart, target) <= max_d2)
   {
-    char     *end;
-    ULONGLONG val = strtoull (value, &end, 10);
-
-    if (end > value)
-       rec.created = *(FILETIME*) &val;
-
-    rc = API_add_entry (&rec);
-    memset (&rec, '\0', sizeof(rec));    /* ready for a new record. */
+    if (*num < max)
+       result [*num] = g_data.airport_CSV + n->idx;
+    (*num)++;
   }
-  return (rc);
+
+  diff = kd_coord (target, depth % 3) - kd_coord (&n->cart, depth % 3);
+  if (diff < 0.0 || diff * diff <= max_d2)
+     kd_within (lo, mid, depth + 1, target, max_d2, result, max, num);
+  if (diff >= 0.0 || diff * diff <= max_d2)
+     kd_within (mid + 1, hi, depth + 1, target, max_d2, result, max, num);
 }
 
-static void API_trace (unsigned line, const char *fmt, ...)
+/**
+ * Return the airport nearest to `pos` (or NULL if none are loaded).
+ *
+ * \param[in]  pos       the position to search from.
+ * \param[out] distance  the great-circle distance (in meters) to the airport found.
+ */
+static const airport *airports_nearest (const pos_t *pos, double *distance)
 {
-  char    buf [200], *ptr = buf;
-  int     len, left = (int)sizeof(buf);
-  va_list args;
-
-  EnterCriticalSection (&Modes.print_mutex);
+  const airport *a;
+  cartesian_t    target;
+  uint32_t       best    = 0;
+  double         best_d2 = DBL_MAX;
 
-  len = snprintf (ptr, left, "%s(%u, %s): ",
-                  __FILE__, line, GetCurrentThreadId() == g_data.thread_id ?
-                  "API-thread" : "main-thread");
-  ptr  += len;
-  left -= len;
+  if (g_data.kd_num == 0 || !VALID_POS((*pos)))
+     return (NULL);
 
-  va_start (args, fmt);
-  vsnprintf (ptr, left, fmt, args);
-  va_end (args);
-  modeS_flogf (stdout, "%s\n", buf);
+  spherical_to_cartesian (pos, &target);
+  kd_nearest (0, g_data.kd_num, 0, &target, &best, &best_d2);
+  g_data.ap_stats.nearest_queries++;
 
-  LeaveCriticalSection (&Modes.print_mutex);
+  a = g_data.airport_CSV + best;
+  if (distance)
+     *distance = great_circle_dist (*pos, a->pos);
+  return (a);
 }
 
-static void API_trace_LOL (const char *req_resp, uint32_t num, const char *str, const flight_info *f)
+/**
+ * Find the airports within `radius` meters of `pos`.
+ *
+ * \param[in]  pos     the position to search from.
+ * \param[in]  radius  the great-circle radius in meters.
+ * \param[out] result  an array of at most `max` airports found (in no particular order).
+ * \param[in]  max     the size of `result`.
+ * \retval     the number of airports within `radius`. May be larger than `max`.
+ */
+static uint32_t airports_within (const pos_t *pos, double radius, const airport **result, uint32_t max)
 {
-  char        http_status [20] = "";
-  const char *more = "";
-  size_t      len = strlen (str);
+  cartesian_t target;
+  double      chord;
+  uint32_t    num = 0;
 
-  EnterCriticalSection (&Modes.print_mutex);
+  if (g_data.kd_num == 0 || !VALID_POS((*pos)))
+     return (0);
 
-  if (!strcmp(req_resp, "response") && f->http_status > 0)
+  /* The chord for a great-circle arc of length `radius`.
+   */
+  chord = 2.0 * EARTH_RADIUS * sin (min(radius, EARTH_RADIUS * M_PI) / (2.0 * EARTH_RADIUS));
+  spherical_to_cartesian (pos, &target);
+  kd_within (0, g_data.kd_num, 0, &target, chord * chord, result, max, &num);
+  return (num);
+}
+
+/**
+ * Called when the position of aircraft `a` was updated.
+ *
+ * Set it's nearest airport unless it has moved less than `AIRPORT_NEAREST_MOVE`
+ * since the last query. Log when it enters or leaves the `AIRPORT_NEAR_RADIUS`
+ * of this airport below `AIRPORT_NEAR_ALTITUDE`; an approach or a departure.
+ */
+void airports_nearest_update (aircraft *a)
+{
+  const airport *ap;
+  double         distance;
+  bool           is_near;
+
+  if (!Modes.airports_priv || g_data.kd_num == 0 || !VALID_POS(a->position))
+     return;
+
+  if (VALID_POS(a->nearest_pos) &&
+      great_circle_dist(a->position, a->nearest_pos) < AIRPORT_NEAREST_MOVE)
   {
-    snprintf (http_status, sizeof(http_status), "HTTP %d:\n", f->http_status);
-    if (f->http_status >= 400 && f->http_status <= 599)   /* limit 40x - 50x responses to 400 bytes */
-    {
-      if (len > 400)
-         more = "\n...";
-      len = 400;
-    }
+    g_data.ap_stats.nearest_skipped++;
+    return;
   }
 
-  modeS_flogf (Modes.log, "%s # %u (ICAO: 0x%06X): %s", req_resp, num, f->ICAO_addr, http_status);
+  ap = airports_nearest (&a->position, &distance);
+  if (!ap)
+     return;
 
-  /* Do this since `str` could contain `%s` etc.
+  a->nearest_pos      = a->position;
+  a->nearest_distance = distance;
+  is_near = (distance < AIRPORT_NEAR_RADIUS && a->altitude < AIRPORT_NEAR_ALTITUDE);
+
+  /* A new nearest airport; no approach or departure yet.
    */
-  fprintf (Modes.log, "%.*s%s", (int)len, str, more);
-  fputs ("\n-------------------------------------------------------"
-         "---------------------------------------------------------\n",
-         Modes.log);
+  if (stricmp(ap->ICAO, a->nearest_airport))
+  {
+    strcpy_s (a->nearest_airport, sizeof(a->nearest_airport), ap->ICAO);
+    a->near_airport = is_near;
+    return;
+  }
 
-  LeaveCriticalSection (&Modes.print_mutex);
+  if (is_near && !a->near_airport)
+  {
+    LOG_FILEONLY ("plane %06X approaching %s (%s), %.1f km\n",
+                  a->addr, ap->ICAO, ap->location, distance / 1000.0);
+    a->near_airport = true;
+  }
+  else if (a->near_airport && distance >= AIRPORT_NEAR_RADIUS)
+  {
+    LOG_FILEONLY ("plane %06X departing %s (%s), %.1f km\n",
+                  a->addr, ap->ICAO, ap->location, distance / 1000.0);
+    a->near_airport = false;
+  }
 }
 
 /**
- * Return number of PENDING records to resolve.
+ * \todo
+ * Open and parse `Modes.airport_freq_db` into the linked list `g_data.airport_freq_CSV`
  */
-static int API_num_pending (void)
+static bool airports_init_freq_CSV (void)
 {
-  const flight_info *f;
-  int   num = 0;
+  return (true);
+}
 
-  for (f = g_data.flight_info; f; f = f->next)
-      if (f->type == AIRPORT_API_PENDING)
-         num++;
-  return (num);
+static void airports_exit_freq_CSV (void)
+{
 }
 
+#if defined(USE_GEN_ROUTES)
 /**
- * Dump records of all types.
+ * Compare 2 call-signs like `strcmp()` on their upper-case values.
+ * The same order as `tools/gen_routes_data.py` sorts the routes.
  */
-static void API_dump_records (void)
+static int routes_compare (const char *a, const char *b)
 {
-  const flight_info *f;
-  flight_info_stats  fs;
-  int    i = 0;
+  int diff;
 
-  puts ("   #  Call-sign  DEP -> DEST  Type    Created (local)           Resp-time (ms)   HTTP\n"
-        "  -----------------------------------------------------------------------------------");
+  while (*a || *b)
+  {
+    diff = toupper (*(const uint8_t*)a) - toupper (*(const uint8_t*)b);
+    if (diff)
+       return (diff);
+    a++;
+    b++;
+  }
+  return (0);
+}
+
+/**
+ * Decode a line `"call-sign,DEP-STOP-..-DEST"` into a `route_record`.
+ * Handle max 5 possible stop-overs.
+ */
+static void routes_decode_line (char *line, route_record *r)
+{
+  char *airports = strchr (line, ',');
+  char *tok_end, *code;
+  int   num = 0;
+  char  codes [7][10];
 
-  for (f = g_data.flight_info; f; f = f->next)
+  memset (r, '\0', sizeof(*r));
+  if (airports)
+     *airports++ = '\0';
+  strncpy (r->call_sign, line, sizeof(r->call_sign)-1);
+
+  for (code = airports; code && num < DIM(codes); code = tok_end)
   {
-    ULONGLONG ft_diff;
-    char      dtime [20] = "N/A";
-    char      http_status [10] = " - ";
+    tok_end = strchr (code, '-');
+    if (tok_end)
+       *tok_end++ = '\0';
+    strncpy (codes[num], code, sizeof(codes[0])-1);
+    codes [num++][sizeof(codes[0])-1] = '\0';
+  }
+  if (num == 0)
+     return;
 
-    if (*(ULONGLONG*)&f->responded)
+  strcpy (r->departure, codes[0]);
+  strcpy (r->destination, codes[num-1]);
+  for (int i = 1; i < num - 1 && i <= 5; i++)
+      strcpy (r->stop_over[i-1], codes[i]);
+}
+
+/**
+ * Return the decoded routes of `block` from the LRU cache.
+ * Decompress and decode it into the least recently used entry on a miss.
+ */
+static const route_cache *routes_get_block (uint32_t block)
+{
+  route_index        *ri = &g_data.routes;
+  route_cache        *c, *lru = ri->cache + 0;
+  const routes_block *b  = ri->blocks + block;
+  char               *line, *next;
+  size_t              len;
+  uint32_t            i;
+
+  ri->tick++;
+  for (i = 0, c = ri->cache; i < ROUTES_CACHE_BLOCKS; i++, c++)
+  {
+    if (c->block == block)
     {
-      ft_diff = *(ULONGLONG*) &f->responded - *(ULONGLONG*) &f->created;
-      snprintf (dtime, sizeof(dtime), "%.3lf", (double)ft_diff / 1E4);
+      c->last_used = ri->tick;
+      g_data.ap_stats.routes_cache_hits++;
+      return (c);
     }
-    if (f->http_status > 0)
-       _itoa (f->http_status, http_status, 10);
+    if (c->last_used < lru->last_used)
+       lru = c;
+  }
 
-    printf ("  %2d: %-8s   %-5s  %-5s %-7s %s  %8s         %s\n",
-            i++, f->call_sign, f->departure, f->destination,
-            airport_t_str(f->type),
-            modeS_FILETIME_to_loc_str(&f->created, true), dtime, http_status);
+  if ((uint64_t)b->offset + b->comp_size > ri->size || b->raw_size >= ri->raw_size ||
+      b->num > ri->hdr->block_records)
+     return (NULL);
+
+  len = zip_inflate_mem (ri->raw, ri->raw_size, ri->view + b->offset, b->comp_size);
+  if (len != b->raw_size)
+  {
+    LOG_STDERR ("Failed to decompress block %u of \"%s\".\n", block, Modes.routes_db);
+    return (NULL);
   }
-  flight_stats_now (&fs);
-  printf ("  Total: %u, pending: %u, live: %u, cached: %u\n\n", fs.total, fs.pending, fs.live, fs.cached);
+  ri->raw [len] = '\0';
+
+  if (!lru->records)
+  {
+    lru->records = malloc (ri->hdr->block_records * sizeof(*lru->records));
+    if (!lru->records)
+       return (NULL);
+  }
+
+  lru->block = ROUTES_NO_BLOCK;
+  lru->num   = 0;
+  for (line = (char*)ri->raw; *line && lru->num < b->num; line = next)
+  {
+    next = strchr (line, '\n');
+    if (next)
+         *next++ = '\0';
+    else next = line + strlen (line);
+    routes_decode_line (line, lru->records + lru->num++);
+  }
+  lru->block     = block;
+  lru->last_used = ri->tick;
+  g_data.ap_stats.routes_blocks_decoded++;
+  return (lru);
 }
 
 /**
- * Called from show_statistics() to print statistics collected here.
+ * Return the global index of the first route with a call-sign >= `key`.
+ * Or `routes_file_hdr::num_routes` if there is none.
  */
-void airports_show_stats (void)
+static uint32_t routes_lower_bound (const char *key)
 {
-  LOG_STDOUT ("Airports statistics:\n");
-  interactive_clreol();
+  const route_index *ri = &g_data.routes;
+  const route_cache *c;
+  uint32_t lo = 0, hi = ri->hdr->num_blocks, mid;
 
-  LOG_STDOUT ("  %6u CSV records in list.\n", g_data.ap_stats.CSV_numbers);
-  interactive_clreol();
+  /* Find the last block with a first call-sign < `key`.
+   */
+  while (lo < hi)
+  {
+    mid = lo + (hi - lo) / 2;
+    if (routes_compare(ri->blocks[mid].first, key) < 0)
+         lo = mid + 1;
+    else hi = mid;
+  }
+  if (lo == 0)
+     return (0);
 
-  LOG_STDOUT ("  %6u API records in list (%u dead).\n",
-              g_data.fs_stats.live + g_data.fs_stats.cached, g_data.fs_stats.dead);
-  interactive_clreol();
+  c = routes_get_block (lo - 1);
+  if (!c)
+     return (ri->hdr->num_routes);
 
-  LOG_STDOUT ("  %6u API requests sent. %u received (HTTP 404: %u)\n",
-              g_data.ap_stats.API_requests_sent,
-              g_data.ap_stats.API_response_recv,
-              g_data.ap_stats.API_service_404);
-  interactive_clreol();
+  hi  = c->num;
+  mid = lo - 1;
+  lo  = 0;
+  while (lo < hi)
+  {
+    uint32_t i = lo + (hi - lo) / 2;
 
-  LOG_STDOUT ("  %6u API records cached. Used %u times.\n",
-              g_data.ap_stats.API_added_CSV, g_data.ap_stats.API_used_CSV);
-  interactive_clreol();
+    if (routes_compare(c->records[i].call_sign, key) < 0)
+         lo = i + 1;
+    else hi = i;
+  }
+  return (mid * ri->hdr->block_records + lo);
+}
 
-#if defined(USE_GEN_ROUTES)
-  LOG_STDOUT ("  %6zu Route records. Used %u times.\n",
-              route_records_num, g_data.ap_stats.routes_records_used);
-  interactive_clreol();
-#endif
+/**
+ * Return the route at global index `rec_num`.
+ * Only valid until the next call to `routes_get_block()`.
+ */
+static const route_record *routes_record_at (uint32_t rec_num)
+{
+  const route_index *ri = &g_data.routes;
+  const route_cache *c;
+
+  if (!ri->hdr || rec_num >= ri->hdr->num_routes)
+     return (NULL);
+
+  c = routes_get_block (rec_num / ri->hdr->block_records);
+  if (!c || rec_num % ri->hdr->block_records >= c->num)
+     return (NULL);
+  return (c->records + rec_num % ri->hdr->block_records);
+}
+
+static void routes_exit_index (void)
+{
+  route_index *ri = &g_data.routes;
+  uint32_t     i;
+
+  for (i = 0; i < ROUTES_CACHE_BLOCKS; i++)
+      FREE (ri->cache[i].records);
+  FREE (ri->raw);
+  FREE (ri->hash);
+  if (ri->view)
+     UnmapViewOfFile (ri->view);
+  memset (ri, '\0', sizeof(*ri));
 }
 
 /**
- * Parse the response from `API_thread_func()` and populate `f`.
+ * Memory-map `Modes.routes_db` and check it's header and block index.
+ * Nothing is decompressed until a route is looked up.
  *
- * \todo Handle `API_AIRPORT_ICAO` too.
+ * If it's missing, routes are not used and all call-signs are
+ * looked up with the ADSB-LOL API.
  */
-static bool airports_API_parse_response (flight_info *f, char *resp)
+static bool routes_init_index (void)
 {
-  flight_info tmp;
-  int         num;
-  char       *codes;
-  bool        rc;
+  route_index  *ri = &g_data.routes;
+  HANDLE        file, map;
+  LARGE_INTEGER fsize;
+  uint32_t      i;
+
+  memset (ri, '\0', sizeof(*ri));
+  for (i = 0; i < ROUTES_CACHE_BLOCKS; i++)
+      ri->cache [i].block = ROUTES_NO_BLOCK;
+
+  file = CreateFileA (Modes.routes_db, GENERIC_READ, FILE_SHARE_READ, NULL,
+                      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE)
+  {
+    TRACE ("No routes in \"%s\": %s", Modes.routes_db, win_strerror(GetLastError()));
+    return (false);
+  }
 
-  codes = strstr (resp, API_AIRPORT_IATA);
-  if (!codes || !*codes)
+  map = NULL;
+  if (GetFileSizeEx(file, &fsize) && fsize.QuadPart > (LONGLONG)sizeof(*ri->hdr))
+     map = CreateFileMappingA (file, NULL, PAGE_READONLY, 0, 0, NULL);
+  CloseHandle (file);
+  if (!map)
      return (false);
 
-  memset (&tmp, '\0', sizeof(tmp));
-  codes += strlen (API_AIRPORT_IATA);
-  num = sscanf (codes, "\"%30[^-\"]-%30[^-\"]\"", tmp.departure, tmp.destination);
+  ri->view = MapViewOfFile (map, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle (map);    /* the view keeps the mapping open */
+  if (!ri->view)
+     return (false);
 
-  /* Support a response like this:
-   *  "_airport_codes_iata": "LAX-JED-RUH",
-   *
-   * i.e. final destination == "RUH" (Riyadh).
-   */
-  if (num != 2 && num != 3)
-  {
-    g_data.fs_stats.unknown++;
-    rc = false;   /* This request becomes a DEAD record */
-  }
-  else if (!strcmp(codes, "\"unknown\""))
+  ri->size   = fsize.QuadPart;
+  ri->hdr    = (const routes_file_hdr*) ri->view;
+  ri->blocks = (const routes_block*) (ri->hdr + 1);
+
+  if (memcmp(ri->hdr->magic, ROUTES_FILE_MAGIC, sizeof(ri->hdr->magic)) ||
+      ri->hdr->version != ROUTES_FILE_VERSION ||
+      ri->hdr->block_records == 0 ||
+      sizeof(*ri->hdr) + (uint64_t)ri->hdr->num_blocks * sizeof(*ri->blocks) > ri->size)
   {
-    g_data.fs_stats.unknown++;
-    strcpy (f->departure, "?");
-    strcpy (f->destination, "?");
-    rc = true;
+    LOG_STDERR ("\"%s\" is not a valid routes-file.\n", Modes.routes_db);
+    routes_exit_index();
+    return (false);
   }
-  else
+
+  for (i = 0; i < ri->hdr->num_blocks; i++)
+      ri->raw_size = max (ri->raw_size, ri->blocks[i].raw_size + 1);
+
+  ri->raw  = malloc (ri->raw_size);
+  ri->hash = calloc (ROUTES_HASH_SIZE, sizeof(*ri->hash));
+  if (!ri->raw || !ri->hash)
   {
-    strcpy (f->departure, tmp.departure);
-    strcpy (f->destination, tmp.destination);
-    rc = true;
+    LOG_STDERR ("Failed to allocate the route-buffer. Routes are not used.\n");
+    routes_exit_index();
+    return (false);
   }
-  API_TRACE ("num: %d, tmp.departure: '%s', tmp.destination: '%s'",
-             num, tmp.departure, tmp.destination);
 
-  return (rc);
+  TRACE ("Mapped %u routes in %u blocks from \"%s\"",
+         ri->hdr->num_routes, ri->hdr->num_blocks, Modes.routes_db);
+  return (true);
 }
 
-/*
- * This function blocks the `API_thread_func()` function.
+/**
+ * Lookup a call-sign in the `g_data.routes` blocks.
+ * Returns the route or NULL.
+ */
+static const route_record *routes_lookup (const char *call_sign)
+{
+  const route_record *r;
+  uint32_t            rec_num;
+
+  if (!g_data.routes.hdr)
+     return (NULL);
+
+  rec_num = routes_lower_bound (call_sign);
+  r = routes_record_at (rec_num);
+  if (r && !routes_compare(r->call_sign, call_sign))
+     return (r);
+  return (NULL);
+}
+
+/**
+ * Return the airline prefix for a call-sign as 3 upper-case characters.
+ * Or false if the call-sign does not start with 3 letters.
+ */
+static bool routes_airline_prefix (const char *call_sign, char *prefix)
+{
+  const uint8_t *cs = (const uint8_t*) call_sign;
+
+  if (!isalpha(cs[0]) || !isalpha(cs[1]) || !isalpha(cs[2]))
+     return (false);
+  prefix [0] = (char) toupper (cs[0]);
+  prefix [1] = (char) toupper (cs[1]);
+  prefix [2] = (char) toupper (cs[2]);
+  prefix [3] = '\0';
+  return (true);
+}
+
+/**
+ * Find the routes for the airline prefix of `call_sign` (a partial match).
  *
- * Send one request at a time for a call-sign to be resolved into
- * a `AIRPORT_API_LIVE` flight-record.
+ * The routes are sorted on call-sign. So these are the range from the lower-bound
+ * of the prefix up to the lower-bound of the next prefix. Both found via the
+ * `routes_block::first` call-signs in `routes_lower_bound()`.
+ *
+ * Returns the global index of the first route and the number of routes in `*num`.
  */
-static bool API_thread_worker (flight_info *f)
+static uint32_t routes_find_by_airline (const char *call_sign, uint32_t *num)
 {
-  char *response;
-  char  request [200];
-  bool  rc = false;
+  char     prefix [4];
+  uint32_t first, end;
 
-  /* A route for e.g. callsign "TVS4307" becomes:
-   * https://vrs-standing-data.adsb.lol/routes/TV/TVS4307.json
-   */
-  snprintf (request, sizeof(request), API_SERVICE_URL, f->call_sign, f->call_sign);
+  *num = 0;
+  if (!g_data.routes.hdr || !routes_airline_prefix(call_sign, prefix))
+     return (0);
 
-  /* Log complete request to log-file?
-   */
-  if (g_data.do_trace_LOL)
-       API_TRACE_LOL ("request", g_data.ap_stats.API_requests_sent, request, f);
-  else API_TRACE ("request # %lu: (ICAO: 0x%06X) '%s'\n", g_data.ap_stats.API_requests_sent, f->ICAO_addr, request);
+  first = routes_lower_bound (prefix);
+  prefix [2]++;               /* the next prefix; 'Z' + 1 == '[' still sorts last */
+  end = routes_lower_bound (prefix);
+  if (end > first)
+     *num = end - first;
+  return (first);
+}
 
-  g_data.ap_stats.API_requests_sent++;
+/**
+ * Return the `g_data.routes.hash` slot for a call-sign.
+ * On a miss, search the route blocks and resolve the airports into the slot.
+ */
+static const route_slot *routes_hash_lookup (const char *call_sign)
+{
+  const route_record *r;
+  uint32_t            hash = upper_hash (call_sign);
+  route_slot         *s = g_data.routes.hash + (hash & (ROUTES_HASH_SIZE - 1));
 
-  response = download_to_buf (request);  /* This function blocks */
+  if (s->hash == hash && s->call_sign[0] && !stricmp(s->call_sign, call_sign))
+  {
+    g_data.ap_stats.routes_hash_hits++;
+    return (s);
+  }
 
-  get_FILETIME_now (&f->responded);      /* Store time-stamp for ANY response (empty or not) */
+  memset (s, '\0', sizeof(*s));
+  s->hash = hash;
+  strncpy (s->call_sign, call_sign, sizeof(s->call_sign)-1);
 
-  if (!response)
+  r = routes_lookup (call_sign);
+  if (r)
   {
-    API_TRACE ("Downloaded no data for %s!", f->call_sign);
-    return (false);
+    s->found = true;
+    strcpy (s->departure, r->departure);
+    strcpy (s->destination, r->destination);
+    s->dep  = CSV_lookup_ICAO (r->departure);
+    s->dest = CSV_lookup_ICAO (r->destination);
   }
+  return (s);
+}
+
+/**
+ * Look in `g_data.routes` before posting a requst to the ADSB-LOL API.
+ */
+static flight_info *routes_find_by_callsign (const char *call_sign)
+{
+  static flight_info  f;
+  const route_slot   *s;
 
-  g_data.ap_stats.API_response_recv++;
+  if (!g_data.routes.hdr)
+     return (NULL);
 
-  f->http_status = download_status();
+  s = routes_hash_lookup (call_sign);
+  if (!s->found)
+     return (NULL);
 
-  /* Log complete response to log-file?
+  /* Rewrite 's' into a 'f' record.
+   * Use the IATA names of the airports if possible.
+   * Ignoring the 5 possible stop-over airports
    */
-  if (g_data.do_trace_LOL)
-       API_TRACE_LOL ("response", g_data.ap_stats.API_response_recv - 1, response, f);
-  else API_TRACE ("Downloaded %zu bytes data for '%06X/%s': '%.50s'...",
-                  strlen(response), f->ICAO_addr, f->call_sign, response);
+  memset (&f, '\0', sizeof(f));
+  strcpy (f.call_sign, s->call_sign);
+  f.type    = AIRPORT_API_CACHED;
+  f.created = Modes.start_FILETIME;
 
-  if (f->http_status == 404)
-  {
-    g_data.ap_stats.API_service_404++;
+  strncpy (f.departure,   s->dep  && s->dep->IATA[0]  ? s->dep->IATA  : s->departure, sizeof(f.departure)-1);
+  strncpy (f.destination, s->dest && s->dest->IATA[0] ? s->dest->IATA : s->destination, sizeof(f.destination)-1);
+  g_data.ap_stats.routes_records_used++;
+  return (&f);
+}
+
+/**
+ * Return true if the route at `rec_num` starts with the airline `prefix`.
+ */
+static bool routes_has_prefix (uint32_t rec_num, const char *prefix)
+{
+  const route_record *r = routes_record_at (rec_num);
+
+  return (r && !strnicmp(r->call_sign, prefix, 3));
+}
+
+/**
+ * Check `routes_find_by_airline()` for the call-signs of `num` random routes:
+ *  \li the route itself is in the range returned.
+ *  \li the first and last routes in the range have the prefix.
+ *  \li the routes just before and after the range do not.
+ */
+static void routes_find_test_airline (uint32_t num)
+{
+  const route_index *ri = &g_data.routes;
+  uint32_t i, rec_num, first, found, failed = 0, checked = 0;
+  char     prefix [4];
+
+  for (i = 0; i < num; i++)
+  {
+    rec_num = random_range (0, ri->hdr->num_routes - 1);
+    if (!routes_record_at(rec_num))
+       continue;
+
+    if (!routes_airline_prefix(routes_record_at(rec_num)->call_sign, prefix))
+       continue;
+
+    first = routes_find_by_airline (prefix, &found);
+    checked++;
+
+    if (found == 0 || rec_num < first || rec_num >= first + found ||
+        !routes_has_prefix(first, prefix) ||
+        !routes_has_prefix(first + found - 1, prefix) ||
+        (first > 0 && routes_has_prefix(first - 1, prefix)) ||
+        (first + found < ri->hdr->num_routes && routes_has_prefix(first + found, prefix)))
+    {
+      printf ("  Airline '%s': record %u not in routes %u - %u.\n", prefix, rec_num, first, first + found);
+      failed++;
+    }
+    else
+      printf ("  Airline '%s': %u routes from record %u. OK\n", prefix, found, first);
+  }
+  printf ("  %u of %u airline lookups failed.\n", failed, checked);
+}
+
+/**
+ * Time the lookups of all routes in call-sign order and in a random order.
+ * And show how well the LRU cache of decoded blocks works for these.
+ */
+static void routes_find_test_2 (void)
+{
+  const route_index  *ri = &g_data.routes;
+  const route_record *r;
+  char     call_sign [sizeof(r->call_sign)];
+  double   usec_seq, usec_rand;
+  uint32_t i, found_seq, found_rand, num_rand = min (10000, ri->hdr->num_routes);
+  uint32_t decoded = g_data.ap_stats.routes_blocks_decoded;
+
+  usec_seq = get_usec_now();
+  for (i = found_seq = 0; i < ri->hdr->num_routes; i++)
+  {
+    r = routes_record_at (i);
+    if (!r)
+       continue;
+    strcpy (call_sign, r->call_sign);
+    if (routes_lookup(call_sign))
+       found_seq++;
+  }
+  usec_seq = get_usec_now() - usec_seq;
+  printf ("\n  %u sequential lookups: %.0f usec (%u found), %u blocks decoded.\n",
+          ri->hdr->num_routes, usec_seq, found_seq, g_data.ap_stats.routes_blocks_decoded - decoded);
+
+  decoded   = g_data.ap_stats.routes_blocks_decoded;
+  usec_rand = get_usec_now();
+  for (i = found_rand = 0; i < num_rand; i++)
+  {
+    r = routes_record_at (random_range(0, ri->hdr->num_routes - 1));
+    if (!r)
+       continue;
+    strcpy (call_sign, r->call_sign);
+    if (routes_lookup(call_sign))
+       found_rand++;
+  }
+  usec_rand = get_usec_now() - usec_rand;
+  printf ("  %u random lookups: %.0f usec (%u found), %u blocks decoded.\n",
+          num_rand, usec_rand, found_rand, g_data.ap_stats.routes_blocks_decoded - decoded);
+}
+#endif /* USE_GEN_ROUTES */
+
+static void routes_find_test_1 (void)
+{
+#if !defined(USE_GEN_ROUTES)
+  printf ("%s(): '-DUSE_GEN_ROUTES' not defined.\n", __FUNCTION__);
+
+#else
+  uint32_t num = g_data.routes.hdr ? min (10, g_data.routes.hdr->num_routes) : 0;
+  uint32_t i, rec_num;
+
+  if (num == 0)
+  {
+    printf ("%s(): No routes in \"%s\".\n", __FUNCTION__, Modes.routes_db);
+    return;
+  }
+
+  printf ("%s():\n  Checking %u random records among %u records.\n", __FUNCTION__, num, g_data.routes.hdr->num_routes);
+  printf ("  Record  call-sign  DEP     DEST    (departure        -> destination)\n"
+          "  ---------------------------------------------------------------------------------\n");
+
+  for (i = 0; i < num; i++)
+  {
+    const flight_info  *f;
+    const route_record *r;
+    const char         *dep, *dest;
+    char                call_sign [sizeof(r->call_sign)];
+
+    rec_num = random_range (0, g_data.routes.hdr->num_routes - 1);
+    r = routes_record_at (rec_num);
+    if (!r)
+       continue;
+    strcpy (call_sign, r->call_sign);
+
+    f = routes_find_by_callsign (call_sign);
+
+    /* `f` should never be NULL here
+     */
+    dep  = find_airport_location (f->departure);
+    dest = find_airport_location (f->destination);
+
+    printf ("  %6u  %-7s    %-7s %-7s (%-16s -> %s)\n",
+            rec_num, f->call_sign, f->departure, f->destination,
+            dep ? dep : "?", dest ? dest : "?");
+  }
+  routes_find_test_airline (10);
+  routes_find_test_2();
+#endif /* USE_GEN_ROUTES */
+  puts ("");
+}
+
+/**
+ * Add a cached flight-info record to `g_data.flights`.
+ */
+static int API_add_entry (const flight_info *rec)
+{
+  flight_info *f;
+  airport_t    type = AIRPORT_API_CACHED;
+  ULONGLONG    ft_diff;
+
+  /* Check if 'Modes.start_FILETIME - rec->created > API_MAX_AGE'.
+   */
+  ft_diff = *(ULONGLONG*) &Modes.start_FILETIME - *(ULONGLONG*) &rec->created;
+  if (ft_diff > API_MAX_AGE)
+     type = AIRPORT_API_EXPIRED;
+
+  g_data.journal.records++;
+
+  /* A later record in the journal replaces an earlier one
+   */
+  AcquireSRWLockExclusive (&g_data.flights.lock);
+  f = flight_info_find_by_callsign (rec->call_sign);
+  if (f)
+  {
+    if (f->type == AIRPORT_API_EXPIRED)
+         g_data.fs_stats.expired--;
+    else g_data.fs_stats.cached--;
+    if (type == AIRPORT_API_EXPIRED)
+         g_data.fs_stats.expired++;
+    else g_data.fs_stats.cached++;
+
+    f->type      = type;
+    f->ICAO_addr = rec->ICAO_addr;
+    f->created   = rec->created;
+    strcpy (f->departure, rec->departure);
+    strcpy (f->destination, rec->destination);
+    g_data.journal.replaced++;
+  }
+  ReleaseSRWLockExclusive (&g_data.flights.lock);
+
+  if (f)
+     return (1);
+
+  f = flight_info_create (rec->call_sign, rec->ICAO_addr, type);
+  if (f)
+  {
+    /* Not yet seen by other threads.
+     */
+    f->created = rec->created;
+    strcpy (f->departure, rec->departure);
+    strcpy (f->destination, rec->destination);
+    g_data.ap_stats.API_added_CSV++;
+  }
+  return (f ? 1 : 0);
+}
+
+/**
+ * Parse a journal line written by `flight_info_format()` into `rec`.
+ *
+ * Reject a line without a '\n' (the end of a write interrupted by a crash)
+ * or with the wrong number of fields (a line glued onto such a partial line).
+ */
+static bool API_journal_parse (char *line, flight_info *rec)
+{
+  char     *field [API_JOURNAL_FIELDS + 1];
+  char     *p, *end;
+  unsigned  num;
+  ULONGLONG val;
+
+  end = strchr (line, '\n');
+  if (!end)
+     return (false);
+  *end = '\0';
+  if (end > line && end[-1] == '\r')
+     end[-1] = '\0';
+
+  for (num = 0, p = line; p && num < DIM(field); num++)
+  {
+    field [num] = p;
+    p = strchr (p, ',');
+    if (p)
+       *p++ = '\0';
+  }
+  if (num != API_JOURNAL_FIELDS || strlen(field[4]) != 6 || strspn(field[4], "0123456789abcdefABCDEF") != 6)
+     return (false);
+
+  val = strtoull (field[5], &end, 10);
+  if (end == field[5] || *end)
+     return (false);
+
+  memset (rec, '\0', sizeof(*rec));
+  rec->type = atoi (field[0]);
+  strncpy (rec->call_sign, field[1], sizeof(rec->call_sign)-1);
+  strncpy (rec->departure, field[2], sizeof(rec->departure)-1);
+  strncpy (rec->destination, field[3], sizeof(rec->destination)-1);
+  rec->ICAO_addr = mg_unhexn (field[4], 6);
+  rec->created   = *(FILETIME*) &val;
+  return (true);
+}
+
+/**
+ * Replay the journal into `g_data.flights`. Skip the lines `API_journal_parse()` rejects.
+ * These still count as records in the journal, so a compaction removes them.
+ */
+static bool API_journal_replay (void)
+{
+  FILE       *file = fopen (Modes.airport_cache, "rt");
+  char        line [256];
+  flight_info rec;
+  uint32_t    bad = 0;
+  bool        whole;
+  int         c;
+
+  if (!file)
+  {
+    LOG_STDERR ("Failed to open \"%s\": %s\n", Modes.airport_cache, strerror(errno));
+    return (false);
+  }
+
+  while (fgets(line, sizeof(line), file))
+  {
+    if (line[0] == '#' || line[0] == '\n')
+       continue;
+
+    whole = (strchr(line, '\n') != NULL);
+    if (API_journal_parse(line, &rec))
+    {
+      if (!API_add_entry(&rec))
+         break;
+      continue;
+    }
+
+    bad++;
+    g_data.journal.records++;
+    if (!whole)                     /* skip the rest of a too long line */
+       while ((c = fgetc(file)) != EOF && c != '\n')
+          ;
+  }
+  fclose (file);
+
+  if (bad > 0)
+     LOG_FILEONLY ("Skipped %u bad lines in \"%s\".\n", bad, Modes.airport_cache);
+  return (true);
+}
+
+/**
+ * Return the index of the calling API-thread or -1 for another thread.
+ */
+static int API_thread_index (void)
+{
+  DWORD    id = GetCurrentThreadId();
+  uint32_t i;
+
+  for (i = 0; i < g_data.num_threads; i++)
+      if (g_data.thread_id[i] == id)
+         return (int) i;
+  return (-1);
+}
+
+static void API_trace (unsigned line, const char *fmt, ...)
+{
+  char    buf [200], *ptr = buf;
+  char    thread [20] = "main-thread";
+  int     len, left = (int)sizeof(buf);
+  int     idx = API_thread_index();
+  va_list args;
+
+  if (idx >= 0)
+     snprintf (thread, sizeof(thread), "API-thread %d", idx);
+
+  EnterCriticalSection (&Modes.print_mutex);
+
+  len = snprintf (ptr, left, "%s(%u, %s): ", __FILE__, line, thread);
+  ptr  += len;
+  left -= len;
+
+  va_start (args, fmt);
+  vsnprintf (ptr, left, fmt, args);
+  va_end (args);
+  modeS_flogf (stdout, "%s\n", buf);
+
+  LeaveCriticalSection (&Modes.print_mutex);
+}
+
+static void API_trace_LOL (const char *req_resp, uint32_t num, const char *str, const flight_info *f)
+{
+  char        http_status [20] = "";
+  const char *more = "";
+  size_t      len = strlen (str);
+
+  EnterCriticalSection (&Modes.print_mutex);
+
+  if (!strcmp(req_resp, "response") && f->http_status > 0)
+  {
+    snprintf (http_status, sizeof(http_status), "HTTP %d:\n", f->http_status);
+    if (f->http_status >= 400 && f->http_status <= 599)   /* limit 40x - 50x responses to 400 bytes */
+    {
+      if (len > 400)
+         more = "\n...";
+      len = 400;
+    }
+  }
+
+  modeS_flogf (Modes.log, "%s # %u (ICAO: 0x%06X): %s", req_resp, num, f->ICAO_addr, http_status);
+
+  /* Do this since `str` could contain `%s` etc.
+   */
+  fprintf (Modes.log, "%.*s%s", (int)len, str, more);
+  fputs ("\n-------------------------------------------------------"
+         "---------------------------------------------------------\n",
+         Modes.log);
+
+  LeaveCriticalSection (&Modes.print_mutex);
+}
+
+/**
+ * Return number of PENDING records to resolve.
+ */
+static int API_num_pending (void)
+{
+  const flight_info *f;
+  int   num = 0;
+
+  AcquireSRWLockShared (&g_data.flights.lock);
+  for (f = g_data.flights.head; f; f = f->next)
+      if (f->type == AIRPORT_API_PENDING)
+         num++;
+  ReleaseSRWLockShared (&g_data.flights.lock);
+  return (num);
+}
+
+/**
+ * Dump records of all types.
+ */
+static void API_dump_records (void)
+{
+  const flight_info *f;
+  flight_info_stats  fs;
+  int    i = 0;
+
+  puts ("   #  Call-sign  DEP -> DEST  Type    Created (local)           Resp-time (ms)   HTTP\n"
+        "  -----------------------------------------------------------------------------------");
+
+  AcquireSRWLockShared (&g_data.flights.lock);
+  for (f = g_data.flights.head; f; f = f->next)
+  {
+    ULONGLONG ft_diff;
+    char      dtime [20] = "N/A";
+    char      http_status [10] = " - ";
+
+    if (*(ULONGLONG*)&f->responded)
+    {
+      ft_diff = *(ULONGLONG*) &f->responded - *(ULONGLONG*) &f->created;
+      snprintf (dtime, sizeof(dtime), "%.3lf", (double)ft_diff / 1E4);
+    }
+    if (f->http_status > 0)
+       _itoa (f->http_status, http_status, 10);
+
+    printf ("  %2d: %-8s   %-5s  %-5s %-7s %s  %8s         %s\n",
+            i++, f->call_sign, f->departure, f->destination,
+            airport_t_str(f->type),
+            modeS_FILETIME_to_loc_str(&f->created, true), dtime, http_status);
+  }
+  ReleaseSRWLockShared (&g_data.flights.lock);
+
+  flight_stats_now (&fs);
+  printf ("  Total: %u, pending: %u, live: %u, cached: %u\n\n", fs.total, fs.pending, fs.live, fs.cached);
+}
+
+/**
+ * Called from show_statistics() to print statistics collected here.
+ */
+void airports_show_stats (void)
+{
+  LOG_STDOUT ("Airports statistics:\n");
+  interactive_clreol();
+
+  LOG_STDOUT ("  %6u CSV records in list%s.\n", g_data.ap_stats.CSV_numbers,
+              g_data.snapshot ? " (mapped snapshot)" : "");
+  interactive_clreol();
+
+  LOG_STDOUT ("  %6u nearest-airport queries (%u skipped, %u airports in k-d tree).\n",
+              g_data.ap_stats.nearest_queries, g_data.ap_stats.nearest_skipped, g_data.kd_num);
+  interactive_clreol();
+
+  LOG_STDOUT ("  %6u API records in list (%u dead).\n",
+              g_data.fs_stats.live + g_data.fs_stats.cached, g_data.fs_stats.dead);
+  interactive_clreol();
+
+  LOG_STDOUT ("  %6u API requests sent. %u received (HTTP 404: %u, 429: %u, 503: %u)\n",
+              g_data.ap_stats.API_requests_sent,
+              g_data.ap_stats.API_response_recv,
+              g_data.ap_stats.API_service_404,
+              g_data.ap_stats.API_service_429,
+              g_data.ap_stats.API_service_503);
+  interactive_clreol();
+
+  LOG_STDOUT ("  %6u API requests retried. Max queue: %u, dedup: %u, threads: %u\n",
+              g_data.ap_stats.API_retries,
+              g_data.ap_stats.API_queue_max,
+              g_data.ap_stats.API_dedup,
+              g_data.num_threads);
+  interactive_clreol();
+
+  LOG_STDOUT ("  %6u API routeset requests with %u call-signs (max %u per request).\n",
+              g_data.ap_stats.API_batches,
+              g_data.ap_stats.API_batched,
+              g_data.API_queue.batch);
+  interactive_clreol();
+
+  LOG_STDOUT ("  %6u API records cached. Used %u times.\n",
+              g_data.ap_stats.API_added_CSV, g_data.ap_stats.API_used_CSV);
+  interactive_clreol();
+
+  LOG_STDOUT ("  %6u API records evicted (max %u).\n", g_data.flights.evicted, FLIGHT_INFO_MAX);
+  interactive_clreol();
+
+  LOG_STDOUT ("  %6u API records in journal. Appended %u, %u compactions.\n",
+              g_data.journal.records, g_data.journal.appended, g_data.journal.compactions);
+  interactive_clreol();
+
+#if defined(USE_GEN_ROUTES)
+  LOG_STDOUT ("  %6u Route records. Used %u times, %u hash hits. %u blocks decoded, %u cache hits.\n",
+              g_data.routes.hdr ? g_data.routes.hdr->num_routes : 0,
+              g_data.ap_stats.routes_records_used,
+              g_data.ap_stats.routes_hash_hits,
+              g_data.ap_stats.routes_blocks_decoded,
+              g_data.ap_stats.routes_cache_hits);
+  interactive_clreol();
+#endif
+}
+
+/**
+ * Parse the response from `API_thread_func()` and populate `f`.
+ *
+ * \todo Handle `API_AIRPORT_ICAO` too.
+ */
+static bool airports_API_parse_response (flight_info *f, char *resp)
+{
+  flight_info tmp;
+  int         num;
+  char       *codes;
+  bool        rc;
+
+  codes = strstr (resp, API_AIRPORT_IATA);
+  if (!codes || !*codes)
+     return (false);
+
+  memset (&tmp, '\0', sizeof(tmp));
+  codes += strlen (API_AIRPORT_IATA);
+  while (*codes == ' ')
+     codes++;
+  num = sscanf (codes, "\"%30[^-\"]-%30[^-\"]\"", tmp.departure, tmp.destination);
+
+  /* Support a response like this:
+   *  "_airport_codes_iata": "LAX-JED-RUH",
+   *
+   * i.e. final destination == "RUH" (Riyadh).
+   */
+  if (num != 2 && num != 3)
+  {
+    InterlockedIncrement ((volatile LONG*) &g_data.fs_stats.unknown);
+    rc = false;   /* This request becomes a DEAD record */
+  }
+  else if (!strncmp(codes, "\"unknown\"", 9))
+  {
+    InterlockedIncrement ((volatile LONG*) &g_data.fs_stats.unknown);
+    strcpy (f->departure, "?");
+    strcpy (f->destination, "?");
+    rc = true;
+  }
+  else
+  {
+    strcpy (f->departure, tmp.departure);
+    strcpy (f->destination, tmp.destination);
+    rc = true;
+  }
+  API_TRACE ("num: %d, tmp.departure: '%s', tmp.destination: '%s'",
+             num, tmp.departure, tmp.destination);
+
+  return (rc);
+}
+
+/*
+ * This function blocks the calling API-thread.
+ *
+ * Send one request for a call-sign to be resolved into
+ * a `AIRPORT_API_LIVE` flight-record.
+ *
+ * \param f          [in|out] the flight-record to request.
+ * \param req_num    [in]     the request number; for tracing only.
+ * \param throttled  [out]    set to true if the service said we sent too many requests.
+ */
+static bool API_thread_worker (flight_info *f, uint32_t req_num, bool *throttled)
+{
+  char *response;
+  char  request [200];
+  bool  rc = false;
+
+  *throttled = false;
+  f->http_status = 0;
+
+  /* A route for e.g. callsign "TVS4307" becomes:
+   * https://vrs-standing-data.adsb.lol/routes/TV/TVS4307.json
+   */
+  snprintf (request, sizeof(request), g_data.API_url, f->call_sign, f->call_sign);
+
+  /* Log complete request to log-file?
+   */
+  if (g_data.do_trace_LOL)
+       API_TRACE_LOL ("request", req_num, request, f);
+  else API_TRACE ("request # %u: (ICAO: 0x%06X) '%s'\n", req_num, f->ICAO_addr, request);
+
+  response = download_to_buf (request);  /* This function blocks */
+
+  get_FILETIME_now (&f->responded);      /* Store time-stamp for ANY response (empty or not) */
+
+  if (!response)
+  {
+    API_TRACE ("Downloaded no data for %s!", f->call_sign);
+    return (false);
+  }
+
+  f->http_status = download_status();
+
+  /* Log complete response to log-file?
+   */
+  if (g_data.do_trace_LOL)
+       API_TRACE_LOL ("response", req_num, response, f);
+  else API_TRACE ("Downloaded %zu bytes data for '%06X/%s': '%.50s'...",
+                  strlen(response), f->ICAO_addr, f->call_sign, response);
+
+  if (f->http_status == 429 ||         /* We sent too many requests! */
+      f->http_status == 503 ||
+      !strncmp(response, API_SERVICE_503, sizeof(API_SERVICE_503)-1))
+  {
+    *throttled = true;
+  }
+  else if (f->http_status != 404)
+  {
+    rc = airports_API_parse_response (f, response);
+  }
+
+  free (response);
+  return (rc);
+}
+
+/**
+ * Return the next object in a JSON array like `[{..}, {..}]` and
+ * 0-terminate it. Nested objects are part of the object returned.
+ */
+static char *API_json_next_object (char **pp)
+{
+  char *start = strchr (*pp, '{');
+  char *p;
+  int   depth = 0;
+  bool  in_str = false;
+
+  if (!start)
+     return (NULL);
+
+  for (p = start; *p; p++)
+  {
+    if (in_str)
+    {
+      if (*p == '\\' && p[1])
+         p++;
+      else if (*p == '"')
+         in_str = false;
+    }
+    else if (*p == '"')
+      in_str = true;
+    else if (*p == '{')
+      depth++;
+    else if (*p == '}' && --depth == 0)
+    {
+      *p  = '\0';
+      *pp = p + 1;
+      return (start);
+    }
+  }
+  return (NULL);
+}
+
+/**
+ * Get the string value of `"key": "value"` in a JSON object.
+ */
+static bool API_json_string (const char *obj, const char *key, char *buf, size_t size)
+{
+  char        pattern [30];
+  const char *p;
+  size_t      len = 0;
+
+  snprintf (pattern, sizeof(pattern), "\"%s\"", key);
+  p = strstr (obj, pattern);
+  if (!p)
+     return (false);
+
+  p += strlen (pattern);
+  while (*p == ' ' || *p == ':')
+     p++;
+  if (*p++ != '"')
+     return (false);
+
+  while (*p && *p != '"' && len < size - 1)
+     buf [len++] = *p++;
+  buf [len] = '\0';
+  return (*p == '"');
+}
+
+/*
+ * This function blocks the calling API-thread.
+ *
+ * Send one routeset request for `num` call-signs to be resolved into
+ * `AIRPORT_API_LIVE` flight-records. A call-sign missing in the response
+ * is handled like a "404 Not Found".
+ *
+ * \param res        [in|out] the flight-records to request.
+ * \param num        [in]     the number of records in `res`.
+ * \param req_num    [in]     the request number; for tracing only.
+ * \param rc         [out]    the result for each record in `res`.
+ * \param throttled  [out]    set to true if the service said we sent too many requests.
+ */
+static void API_routeset_worker (flight_info *res, uint32_t num, uint32_t req_num, bool *rc, bool *throttled)
+{
+  char     body [API_BATCH_MAX * (sizeof(res->call_sign) + 40) + 20];
+  char    *response, *p, *obj;
+  size_t   len;
+  uint32_t i;
+  int      http_status;
+
+  *throttled = false;
+
+  /* The planes position is not known here. `lat/lng` are only used
+   * for the `"plausible"` field in the response.
+   */
+  len = snprintf (body, sizeof(body), "{\"planes\":[");
+  for (i = 0; i < num; i++)
+  {
+    rc [i] = false;
+    res [i].http_status = 0;
+    len += snprintf (body + len, sizeof(body) - len, "%s{\"callsign\":\"%s\",\"lat\":0,\"lng\":0}",
+                     i > 0 ? "," : "", res[i].call_sign);
+  }
+  snprintf (body + len, sizeof(body) - len, "]}");
+
+  if (g_data.do_trace_LOL)
+       API_TRACE_LOL ("request", req_num, body, res);
+  else API_TRACE ("request # %u: %u call-signs to '%s'\n", req_num, num, g_data.API_routeset_url);
+
+  response = download_post_to_buf (g_data.API_routeset_url, "application/json", body);  /* This function blocks */
+
+  for (i = 0; i < num; i++)
+      get_FILETIME_now (&res[i].responded);
+
+  if (!response)
+  {
+    API_TRACE ("Downloaded no data for %u call-signs!", num);
+    return;
+  }
+
+  http_status = download_status();
+  for (i = 0; i < num; i++)
+      res [i].http_status = http_status;
+
+  if (g_data.do_trace_LOL)
+       API_TRACE_LOL ("response", req_num, response, res);
+  else API_TRACE ("Downloaded %zu bytes data for %u call-signs: '%.50s'...",
+                  strlen(response), num, response);
+
+  if (http_status == 429 || http_status == 503 ||
+      !strncmp(response, API_SERVICE_503, sizeof(API_SERVICE_503)-1))
+  {
+    *throttled = true;
+  }
+  else if (http_status == 200)
+  {
+    p = response;
+    while ((obj = API_json_next_object(&p)) != NULL)
+    {
+      char call_sign [sizeof(res->call_sign)];
+
+      if (!API_json_string(obj, "callsign", call_sign, sizeof(call_sign)))
+         continue;
+
+      for (i = 0; i < num; i++)
+          if (!rc[i] && !stricmp(res[i].call_sign, call_sign))
+          {
+            rc [i] = airports_API_parse_response (&res[i], obj);
+            break;
+          }
+    }
+  }
+  free (response);
+}
+
+/**
+ * In `--test`, `--debug` or `--raw` modes (`g_data.do_trace == true`),
+ * just trace current flight-stats.
+ */
+static void airports_API_show_stats (void)
+{
+  flight_info_stats fs;
+
+  if (test_contains(Modes.tests, "airport") || Modes.debug || Modes.raw)
+  {
+    flight_stats_now (&fs);
+    API_TRACE ("stats now: total=%u, live=%u, pending=%u, dead=%u, unknown=%u",
+               fs.total, fs.live, fs.pending, fs.dead, fs.unknown);
+  }
+}
+
+/**
+ * Return an already queued or in-flight record for `call_sign`.
+ * Called with `q->lock` held.
+ */
+static flight_info *API_queue_find (const API_queue *q, const char *call_sign)
+{
+  flight_info *f;
+  uint32_t     i;
+
+  for (f = q->head; f; f = f->q_next)
+      if (!stricmp(f->call_sign, call_sign))
+         return (f);
+
+  for (i = 0; i < g_data.num_threads; i++)
+      for (f = q->in_flight[i]; f; f = f->q_next)
+          if (!stricmp(f->call_sign, call_sign))
+             return (f);
+  return (NULL);
+}
+
+/**
+ * Create a `AIRPORT_API_PENDING` record for `call_sign` (or refresh an
+ * `AIRPORT_API_EXPIRED` record) and append it to the `API_queue`.
+ * Unless it's already queued or being requested now.
+ */
+static void API_enqueue (const char *call_sign, uint32_t addr)
+{
+  API_queue   *q = &g_data.API_queue;
+  flight_info *f;
+  bool         exists;
+
+  EnterCriticalSection (&q->lock);
+
+  if (API_queue_find(q, call_sign))
+  {
+    g_data.ap_stats.API_dedup++;
+    LeaveCriticalSection (&q->lock);
+    return;
+  }
+
+  AcquireSRWLockExclusive (&g_data.flights.lock);
+  f = flight_info_find_by_callsign (call_sign);
+  exists = (f != NULL);
+  if (f && f->type == AIRPORT_API_EXPIRED)
+  {
+    f->type    = AIRPORT_API_PENDING;
+    f->retries = 0;
+    get_FILETIME_now (&f->created);
+    g_data.fs_stats.expired--;
+    g_data.fs_stats.pending++;
+  }
+  else
+    f = NULL;
+  ReleaseSRWLockExclusive (&g_data.flights.lock);
+
+  if (!exists)
+     f = flight_info_create (call_sign, addr, AIRPORT_API_PENDING);
+  if (f)
+  {
+    if (q->tail)
+         q->tail->q_next = f;
+    else
+    {
+      q->head = f;
+      q->first_queued = MSEC_TIME();
+    }
+    q->tail = f;
+    if (++q->len > g_data.ap_stats.API_queue_max)
+       g_data.ap_stats.API_queue_max = q->len;
+    WakeConditionVariable (&q->wakeup);
+  }
+  LeaveCriticalSection (&q->lock);
+
+  if (f)
+     API_TRACE ("%s PENDING record for call_sign: '%s'", exists ? "Refreshed" : "Created", call_sign);
+}
+
+/**
+ * Add a resolved record to the `API_journal` buffer.
+ * Called with `API_queue::lock` held.
+ */
+static void API_journal_add (const flight_info *f)
+{
+  API_journal *j = &g_data.journal;
+  char         line [200];
+  size_t       len = flight_info_format (line, sizeof(line), f);
+
+  if (len == 0)
+     return;
+
+  if (j->buf_len + len > j->buf_size)
+  {
+    size_t size = j->buf_size ? 2 * j->buf_size : 4096;
+    char  *more = realloc (j->buf, size);
+
+    if (!more)
+       return;
+    j->buf      = more;
+    j->buf_size = size;
+  }
+  memcpy (j->buf + j->buf_len, line, len);
+  j->buf_len += len;
+  j->buf_records++;
+}
+
+/**
+ * Put a `q_next` chain of `num` throttled records (`first` to `last`) back
+ * at the head of the `API_queue`. As one unit, so they keep their order.
+ * Called with `q->lock` held.
+ */
+static void API_requeue (API_queue *q, flight_info *first, flight_info *last, uint32_t num)
+{
+  last->q_next = q->head;
+  q->head      = first;
+  if (!q->tail)
+     q->tail = last;
+  q->len += num;
+  q->first_queued = 0;    /* do not wait for more call-signs */
+  WakeConditionVariable (&q->wakeup);
+}
+
+/**
+ * Add tokens to the token-bucket for the time passed since last refill.
+ */
+static void API_refill (API_queue *q, uint64_t now)
+{
+  q->tokens += (double) (now - q->last_refill) * q->rate / 1000.0;
+  if (q->tokens > API_BURST)
+     q->tokens = API_BURST;
+  q->last_refill = now;
+}
+
+/**
+ * Wait for the next records an API-thread can request. Wait while
+ * the queue is empty, while backing off or while the token-bucket is empty.
+ * With routeset requests, wait up to `API_BATCH_WAIT` msec for `q->batch` records.
+ *
+ * Called with `q->lock` held.
+ * \retval NULL when the API-thread should exit.
+ *         Otherwise a `q_next` chain of `*num` records.
+ */
+static flight_info *API_dequeue (API_queue *q, uint32_t idx, uint32_t *req_num, uint32_t *num)
+{
+  while (!q->quit && !Modes.exit)
+  {
+    uint64_t now  = MSEC_TIME();
+    DWORD    wait = INFINITE;
+
+    if (q->head && now < q->backoff_until)
+    {
+      wait = (DWORD) (q->backoff_until - now);
+    }
+    else if (q->head && q->len < q->batch && now < q->first_queued + API_BATCH_WAIT)
+    {
+      wait = (DWORD) (q->first_queued + API_BATCH_WAIT - now);
+    }
+    else if (q->head)
+    {
+      API_refill (q, now);
+      if (q->tokens >= 1.0)
+      {
+        flight_info *f = q->head, *last = NULL;
+        uint32_t     i;
+
+        for (i = 0; i < q->batch && q->head; i++)
+        {
+          last    = q->head;
+          q->head = last->q_next;
+          q->len--;
+        }
+        last->q_next = NULL;
+        if (!q->head)
+           q->tail = NULL;
+
+        *num = i;
+        q->tokens -= 1.0;
+        q->in_flight [idx] = f;
+        *req_num = g_data.ap_stats.API_requests_sent++;
+        if (i > 1)
+        {
+          g_data.ap_stats.API_batches++;
+          g_data.ap_stats.API_batched += i;
+        }
+        return (f);
+      }
+      wait = 1 + (DWORD) ((1.0 - q->tokens) * 1000.0 / q->rate);
+    }
+    SleepConditionVariableCS (&q->wakeup, &q->lock, wait);
+  }
+  return (NULL);
+}
+
+/**
+ * Update the statistics for the response of one request.
+ * On a throttled request, double the backoff.
+ *
+ * Called with `q->lock` held.
+ */
+static void API_response (API_queue *q, int http_status, bool throttled)
+{
+  if (http_status != 0)
+     g_data.ap_stats.API_response_recv++;
+
+  if (http_status == 404)
+     g_data.ap_stats.API_service_404++;
+  else if (http_status == 429)
+     g_data.ap_stats.API_service_429++;
+  else if (throttled)
+     g_data.ap_stats.API_service_503++;
+
+  if (throttled)
+  {
+    q->backoff = q->backoff ? min (2 * q->backoff, API_BACKOFF_MAX) : API_BACKOFF_MIN;
+    q->backoff_until = MSEC_TIME() + q->backoff + random_range (0, q->backoff / 4);
+  }
+  else if (http_status != 0)  /* the service is responsive again */
+    q->backoff = 0;
+}
+
+/**
+ * Hand the result `res` of a request over to the record `f` in the `flight_store`.
+ *
+ * Called with `q->lock` held.
+ * \retval true  if the request was throttled and `f` should be retried later.
+ */
+static bool API_complete (const API_queue *q, flight_info *f, const flight_info *res, bool rc, bool throttled)
+{
+  AcquireSRWLockExclusive (&g_data.flights.lock);
+  f->http_status = res->http_status;
+  f->responded   = res->responded;
+
+  if (throttled)
+  {
+    if (f->retries++ < API_MAX_RETRIES)
+    {
+      ReleaseSRWLockExclusive (&g_data.flights.lock);
+      API_TRACE ("call_sign: '%s' throttled, backing off %u msec", f->call_sign, q->backoff);
+      g_data.ap_stats.API_retries++;
+      return (true);
+    }
+  }
+
+  /* Change the state to AIRPORT_API_LIVE even
+   * for an error-response like `"_airport_codes_iata": "unknown"`
+   */
+  if (rc)
+  {
+    strcpy (f->departure, res->departure);
+    strcpy (f->destination, res->destination);
+    f->type = AIRPORT_API_LIVE;
+    g_data.fs_stats.live++;
+    API_journal_add (f);
+  }
+  else   /* Otherwise it's a dead record */
+  {
+    f->type = AIRPORT_API_DEAD;
+    g_data.fs_stats.dead++;
+  }
+  g_data.fs_stats.pending--;
+  ReleaseSRWLockExclusive (&g_data.flights.lock);
+  return (false);
+}
+
+/**
+ * One of the `Modes.adsb_lol_requests` threads for handling flight-info API requests.
+ *
+ * Take the next `AIRPORT_API_PENDING` records from the `API_queue` and request them.
+ * A single record with a GET request, several with a routeset request.
+ */
+static unsigned int __stdcall API_thread_func (void *arg)
+{
+  API_queue   *q = &g_data.API_queue;
+  uint32_t     idx = (uint32_t) (uintptr_t) arg;
+  uint32_t     req_num, num;
+  flight_info *f;
+
+  EnterCriticalSection (&q->lock);
+
+  while ((f = API_dequeue(q, idx, &req_num, &num)) != NULL)
+  {
+    flight_info res [API_BATCH_MAX], *next, *retry = NULL, *retry_last = NULL;
+    bool        rc  [API_BATCH_MAX], throttled;
+    uint32_t    i, retries = 0;
+
+    /* Work on copies; the main-thread may read the records meanwhile
+     */
+    for (i = 0, next = f; next; next = next->q_next)
+        res [i++] = *next;
+
+    LeaveCriticalSection (&q->lock);
+    if (num == 1)
+         rc [0] = API_thread_worker (&res[0], req_num, &throttled);
+    else API_routeset_worker (res, num, req_num, rc, &throttled);
+    EnterCriticalSection (&q->lock);
+
+    q->in_flight [idx] = NULL;
+    API_response (q, res[0].http_status, throttled);
+
+    for (i = 0; f; f = next, i++)
+    {
+      next = f->q_next;
+      f->q_next = NULL;
+      if (!API_complete(q, f, &res[i], rc[i], throttled))
+         continue;
+
+      if (retry_last)
+           retry_last->q_next = f;
+      else retry = f;
+      retry_last = f;
+      retries++;
+    }
+    if (retry)
+       API_requeue (q, retry, retry_last, retries);
+  }
+  LeaveCriticalSection (&q->lock);
+  return (0);
+}
+
+/**
+ * Check that `url` has exactly 2 `%s` format specifiers (for the call-sign).
+ * A `%.Ns` precision is allowed.
+ */
+static bool API_url_valid (const char *url)
+{
+  const char *p = url;
+  int         num = 0;
+
+  while ((p = strchr(p, '%')) != NULL)
+  {
+    p++;
+    if (*p == '%')
+    {
+      p++;
+      continue;
+    }
+    if (*p == '.')
+    {
+      p++;
+      while (isdigit((unsigned char)*p))
+         p++;
+    }
+    if (*p != 's')
+       return (false);
+    num++;
+  }
+  return (num == 2);
+}
+
+/**
+ * Setup the `API_queue` and start the API-threads.
+ */
+static bool API_init_threads (void)
+{
+  API_queue *q = &g_data.API_queue;
+  uint32_t   i, num = Modes.adsb_lol_requests;
+
+  g_data.API_url = API_SERVICE_URL;
+  if (Modes.adsb_lol_url)
+  {
+    if (!API_url_valid(Modes.adsb_lol_url))
+    {
+      LOG_STDERR ("Illegal 'adsb-lol-url = %s'. Needs 2 '%%s' for the call-sign.\n", Modes.adsb_lol_url);
+      return (false);
+    }
+    g_data.API_url = Modes.adsb_lol_url;
+  }
+
+  if (num == 0)
+     num = API_REQUESTS;
+  else if (num > API_MAX_THREADS)
+     num = API_MAX_THREADS;
+
+  g_data.API_routeset_url = Modes.adsb_lol_routeset_url ? Modes.adsb_lol_routeset_url : API_ROUTESET_URL;
+
+  q->batch       = Modes.adsb_lol_batch ? min (Modes.adsb_lol_batch, API_BATCH_MAX) : API_BATCH;
+  q->rate        = Modes.adsb_lol_rate ? Modes.adsb_lol_rate : API_RATE;
+  q->tokens      = API_BURST;
+  q->last_refill = MSEC_TIME();
+
+  for (i = 0; i < num; i++)
+  {
+    g_data.thread_hnd [i] = (HANDLE) _beginthreadex (NULL, 0, API_thread_func, (void*) (uintptr_t) i,
+                                                     0, &g_data.thread_id [i]);
+    if (!g_data.thread_hnd [i])
+    {
+      LOG_STDERR ("Failed to create thread: %s\n", strerror(errno));
+      break;
+    }
+    g_data.num_threads++;
+  }
+  return (g_data.num_threads > 0);
+}
+
+/**
+ * Return true if the journal is empty or missing, or it's last byte is a '\n'.
+ */
+static bool API_journal_ends_in_newline (void)
+{
+  FILE *file = fopen (Modes.airport_cache, "rb");
+  int   c = '\n';
+
+  if (!file)
+     return (true);
+  if (fseek(file, -1, SEEK_END) == 0)
+     c = fgetc (file);
+  fclose (file);
+  return (c == '\n');
+}
+
+/**
+ * Open for appending or create the `%TEMP%\\dump1090\\ AIRPORT_DATABASE_CACHE` journal.
+ *
+ * A crash in the middle of a write can leave a last line without a '\n'.
+ * Terminate it, so the first new record does not get glued onto it.
+ */
+static bool API_journal_open (void)
+{
+  API_journal *j = &g_data.journal;
+  bool         partial = !API_journal_ends_in_newline();
+
+  j->file = fopen (Modes.airport_cache, "at");
+  if (!j->file)
+  {
+    LOG_STDERR ("Failed to open \"%s\": %s\n", Modes.airport_cache, strerror(errno));
+    return (false);
   }
-  else if (f->http_status == 503 ||     /* We sent too many requests! */
-           !strncmp(response, API_SERVICE_503, sizeof(API_SERVICE_503)-1))
+
+  fseek (j->file, 0, SEEK_END);
+  if (ftell(j->file) == 0)
   {
-    g_data.ap_stats.API_service_503++;
+    fputs (API_JOURNAL_HEADER, j->file);
+    fflush (j->file);
   }
-  else
+  else if (partial)
   {
-    rc = airports_API_parse_response (f, response);
+    LOG_FILEONLY ("Terminated a partial last line in \"%s\".\n", Modes.airport_cache);
+    fputc ('\n', j->file);
+    fflush (j->file);
   }
-
-  free (response);
-  return (rc);
+  return (true);
 }
 
 /**
- * In `--test`, `--debug` or `--raw` modes (`g_data.do_trace == true`),
- * just trace current flight-stats.
+ * Append the records resolved by the API-threads to the journal.
+ * Only the main-thread writes to `g_data.journal.file`.
  */
-static void airports_API_show_stats (void)
+static void API_journal_flush (void)
 {
-  flight_info_stats fs;
-
-  if (test_contains(Modes.tests, "airport") || Modes.debug || Modes.raw)
+  API_journal *j = &g_data.journal;
+  char        *buf;
+  size_t       len;
+  uint32_t     records;
+
+  EnterCriticalSection (&g_data.API_queue.lock);
+  buf     = j->buf;
+  len     = j->buf_len;
+  records = j->buf_records;
+  j->buf  = NULL;
+  j->buf_len = j->buf_size = 0;
+  j->buf_records = 0;
+  LeaveCriticalSection (&g_data.API_queue.lock);
+
+  if (len > 0 && j->file)
   {
-    flight_stats_now (&fs);
-    API_TRACE ("stats now: total=%u, live=%u, pending=%u, dead=%u, unknown=%u",
-               fs.total, fs.live, fs.pending, fs.dead, fs.unknown);
+    if (fwrite(buf, 1, len, j->file) == len && fflush(j->file) == 0)
+    {
+      j->records  += records;
+      j->appended += records;
+    }
+    else
+      LOG_FILEONLY ("Failed to append %u records to \"%s\": %s\n",
+                    records, Modes.airport_cache, strerror(errno));
   }
+  free (buf);
 }
 
 /**
- * The thread for handling flight-info API requests.
- *
- * Iterate over the `g_data.flight_info` list and handle
- * a `AIRPORT_API_PENDING` record one at a time.
+ * Return true if the journal has enough garbage to be compacted.
+ * I.e. records replaced by a later record, expired or evicted records.
  */
-static unsigned int __stdcall API_thread_func (void *arg)
+static bool API_journal_garbage (void)
 {
-  airports_priv *data = (airports_priv*) arg;
+  const API_journal *j = &g_data.journal;
+  const flight_info *f;
+  uint32_t           live = 0;
 
-  while (!Modes.exit)
-  {
-    flight_info *f;
+  if (j->records < API_JOURNAL_MIN)
+     return (false);
 
-    if (API_num_pending() == 0) /* Sleep if queue is empty */
-    {
-      Sleep (API_SLEEP_MS);
-      continue;
-    }
+  AcquireSRWLockShared (&g_data.flights.lock);
+  for (f = g_data.flights.head; f; f = f->next)
+      if (flight_info_format(NULL, 0, f) > 0)
+         live++;
+  ReleaseSRWLockShared (&g_data.flights.lock);
 
-    for (f = g_data.flight_info; f; f = f->next)
-    {
-      if (f->type == AIRPORT_API_PENDING)
-      {
-        /* Change the state to AIRPORT_API_LIVE even
-         * for an error-response like `"_airport_codes_iata": "unknown"`
-         */
-        if (API_thread_worker(f))
-        {
-          f->type = AIRPORT_API_LIVE;
-          g_data.fs_stats.live++;
-          g_data.fs_stats.pending--;
-        }
-        else   /* Otherwise it's a dead record */
-        {
-          f->type = AIRPORT_API_DEAD;
-          g_data.fs_stats.dead++;
-        }
-      }
-    }
-  }
-  SetEvent (data->thread_event);
-  return (0);
+  return (live < j->records &&
+          (uint64_t) (j->records - live) * 100 > (uint64_t) j->records * API_JOURNAL_GARBAGE);
 }
 
 /**
- * Open for writing or create the `%TEMP%\\dump1090\\ AIRPORT_DATABASE_CACHE` file.
+ * Rewrite the journal with the live records only.
+ * Write to a temporary file first and rename it, so a crash
+ * can never leave a partial journal.
  */
-static bool airports_cache_open (FILE **f_ptr)
+static bool API_journal_compact (void)
 {
-  FILE *f = fopen (Modes.airport_cache, "w+t");
-  bool  create = (f_ptr == NULL);
-
-  if (f_ptr)
-     *f_ptr = f;
+  API_journal       *j = &g_data.journal;
+  const flight_info *f;
+  char               tmp_file [MAX_PATH];
+  FILE              *file;
+  uint32_t           num = 0;
+  bool               ok;
 
-  if (!f)
+  snprintf (tmp_file, sizeof(tmp_file), "%s.tmp", Modes.airport_cache);
+  file = fopen (tmp_file, "wt");
+  if (!file)
   {
-    LOG_STDERR ("Failed to %s \"%s\": %s\n",
-                create ? "create" : "open",
-                Modes.airport_cache, strerror(errno));
+    LOG_STDERR ("Failed to create \"%s\": %s\n", tmp_file, strerror(errno));
     return (false);
   }
 
-  fprintf (f, "# type,callsign,departure,destination,icao,timestamp\n");
-  if (create)
-     fclose (f);
-  return (true);
+  fputs (API_JOURNAL_HEADER, file);
+
+  AcquireSRWLockShared (&g_data.flights.lock);
+  for (f = g_data.flights.head; f; f = f->next)
+      if (flight_info_write(file, f))
+         num++;
+  ReleaseSRWLockShared (&g_data.flights.lock);
+
+  ok = !ferror (file);
+  ok = (fclose(file) == 0) && ok;
+
+  if (j->file)
+     fclose (j->file);
+  j->file = NULL;
+
+  if (ok && !MoveFileExA(tmp_file, Modes.airport_cache, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+  {
+    LOG_STDERR ("Failed to rename \"%s\": %s\n", tmp_file, win_strerror(GetLastError()));
+    ok = false;
+  }
+  if (!ok)
+     DeleteFileA (tmp_file);
+  else
+  {
+    LOG_FILEONLY ("compacted \"%s\" from %u to %u records.\n", Modes.airport_cache, j->records, num);
+    j->records = num;
+    j->compactions++;
+  }
+  API_journal_open();
+  return (ok);
 }
 
+/**
+ * Flush and compact the journal at exit. Then free the `g_data.flights` store.
+ */
 static void airports_cache_write (void)
 {
-  FILE *f = NULL;
+  API_journal *j = &g_data.journal;
 
-  if (g_data.fs_stats.live + g_data.fs_stats.dead > 0)
-     airports_cache_open (&f);
+  API_journal_flush();
+  if (API_journal_garbage())
+     API_journal_compact();
 
-  flight_info_exit (f);
-  if (f)
-  {
-    struct stat st;
+  if (j->file)
+     fclose (j->file);
+  j->file = NULL;
 
-    fclose (f);
-    if (stat(Modes.airport_cache, &st) == 0)
-         API_TRACE ("\"%s\": %u bytes written.", Modes.airport_cache, st.st_size);
-    else API_TRACE ("\"%s\": errno: %d/%s.", Modes.airport_cache, errno, strerror(errno));
-  }
-  if (!f && test_contains(Modes.tests, "airport"))
-     printf ("No need to rewrite the %s cache.\n", Modes.airport_cache);
+  if (g_data.API_queue.stopped)  /* no API-thread can use the records now */
+     flight_info_exit();
+
+  if (test_contains(Modes.tests, "airport"))
+     printf ("%u records in the %s journal. Appended %u, replaced %u, %u compactions.\n",
+             j->records, Modes.airport_cache, j->appended, j->replaced, j->compactions);
 }
 
 /**
  * Called from `background_tasks()` 4 times per second.
- * Save the `%TEMP%\\dump1090\\AIRPORT_DATABASE_CACHE` file once every 5 minutes.
+ * Append resolved records to the `%TEMP%\\dump1090\\AIRPORT_DATABASE_CACHE` journal.
+ * Check if it needs a compaction once every 5 minutes.
  */
 void airports_background (uint64_t now)
 {
-  static uint64_t    last_dump = 0;
-  static bool        do_dump = true;
-  const flight_info *f;
-  FILE              *file;
-  int                num;
+  static uint64_t last_check = 0;
 
 //airports_API_show_stats();
 
-  if (!do_dump)  /* problem with cache-file? */
-     return;
+  flight_store_evict();
+  API_journal_flush();
 
-  if ((now - last_dump) < API_CACHE_PERIOD)   /* 5 min not passed */
+  if ((now - last_check) < API_CACHE_PERIOD)   /* 5 min not passed */
      return;
 
-  last_dump = now;
-
-  if (!airports_cache_open(&file))
-  {
-    do_dump = false;
-    return;
-  }
-
-  for (num = 0, f = g_data.flight_info; f; f = f->next)
-      if (flight_info_write(file, f))
-         num++;
-  fclose (file);
-  LOG_FILEONLY ("dumped %d LIVE records to cache.\n", num);
+  last_check = now;
+  if (API_journal_garbage())
+     API_journal_compact();
 }
 
 /**
  * Open and parse the `%TEMP%\\dump1090\\ AIRPORT_DATABASE_CACHE` file
- * and append to `g_data.flight_info`.
+ * and append to `g_data.flights`.
  *
  * These records are always `a->type == AIRPORT_API_CACHED`.
  */
@@ -1090,48 +3019,16 @@ static bool airports_init_API (void)
   struct stat st;
   bool        exists;
 
-  g_data.thread_event = CreateEvent (NULL, FALSE, FALSE, NULL);
-  if (!g_data.thread_event)
-  {
-    LOG_STDERR ("Failed to create thread-event: %lu\n", GetLastError());
-    return (false);
-  }
-
-  g_data.thread_hnd = _beginthreadex (NULL, 0, API_thread_func, &g_data, 0, &g_data.thread_id);
-  if (!g_data.thread_hnd)
-  {
-    LOG_STDERR ("Failed to create thread: %s\n", strerror(errno));
-    return (false);
-  }
-
+  if (!API_init_threads())
+     return (false);
 
   exists = (stat(Modes.airport_cache, &st) == 0 && st.st_size > 0);
-  if (!exists)
-     airports_cache_open (NULL);
-  else
+  if (exists)
   {
     flight_info_stats fs;
 
-    memset (&g_data.csv_ctx, '\0', sizeof(g_data.csv_ctx));
-    g_data.csv_ctx.file_name  = Modes.airport_cache;
-    g_data.csv_ctx.delimiter  = ',';
-    g_data.csv_ctx.callback   = API_cache_callback;
-    g_data.csv_ctx.line_size  = 2000;
-    g_data.csv_ctx.num_fields = 6;
-
-    if (!CSV_open_and_parse_file(&g_data.csv_ctx))
-    {
-      API_TRACE ("c_in: 0x%02X, state: %d", g_data.csv_ctx.c_in, g_data.csv_ctx.state);
-
-      /* getting only the header from a previous run is not an error
-       */
-      if (g_data.csv_ctx.state != STATE_EOF &&
-          g_data.csv_ctx.state != STATE_NORMAL)
-      {
-        LOG_STDERR ("Parsing of \"%s\" failed: %s\n", Modes.airport_cache, strerror(errno));
-        return (false);
-      }
-    }
+    if (!API_journal_replay())
+       return (false);
 
     flight_stats_now (&fs);
     TRACE ("Parsed %u/%u/%u records from: \"%s\"",
@@ -1140,7 +3037,7 @@ static bool airports_init_API (void)
     if (test_contains(Modes.tests, "airport"))
        assert (fs.cached + fs.expired == g_data.ap_stats.API_added_CSV);
   }
-  return (true);
+  return API_journal_open();
 }
 
 /**
@@ -1159,7 +3056,6 @@ uint32_t airports_init (void)
 {
   bool rc;
 
-  assert (g_data.airports == NULL);
   assert (g_data.init_done == false);
 
   if (Modes.debug & DEBUG_ADSB_LOL)
@@ -1169,10 +3065,21 @@ uint32_t airports_init (void)
 
   Modes.airports_priv = &g_data;
 
+  /* `airports_API_get_flight_info()` may be called even if the below fails
+   */
+  InitializeCriticalSection (&g_data.API_queue.lock);
+  InitializeConditionVariable (&g_data.API_queue.wakeup);
+  InitializeSRWLock (&g_data.flights.lock);
+
   rc = (airports_init_CSV() &&
         airports_init_freq_CSV() &&
         airports_init_API());
 
+#if defined(USE_GEN_ROUTES)
+  if (rc)
+     routes_init_index();
+#endif
+
   if (test_contains(Modes.tests, "airport"))
   {
     SetConsoleOutputCP (CP_UTF8);
@@ -1183,6 +3090,7 @@ uint32_t airports_init (void)
     airport_CSV_test_4();
     airport_loc_test_1();
     airport_loc_test_2();
+    airport_kd_test_1();
     airport_API_test_1();
     airport_API_test_2();
     routes_find_test_1();
@@ -1210,67 +3118,68 @@ uint32_t airports_init (void)
  */
 static void airports_exit_API (void)
 {
-  const airport *a;
-
-  for (a = g_data.airports; a; a = a->next)
-     LIST_DELETE (airport, &g_data.airports, a);
+  uint32_t i;
 
-  g_data.airports = NULL;
+  EnterCriticalSection (&g_data.API_queue.lock);
+  g_data.API_queue.quit = true;
+  WakeAllConditionVariable (&g_data.API_queue.wakeup);
+  LeaveCriticalSection (&g_data.API_queue.lock);
 
-  free (g_data.IATA_to_ICAO);
-  g_data.IATA_to_ICAO = NULL;
+  /* An API-thread may still be blocked in `download_to_buf()`.
+   * In that case, it will need the lock, the `flight_store` and
+   * the journal later. So `airports_exit()` must not free these.
+   */
+  if (g_data.num_threads == 0 ||
+      WaitForMultipleObjects (g_data.num_threads, g_data.thread_hnd, TRUE, API_EXIT_WAIT) != WAIT_TIMEOUT)
+       g_data.API_queue.stopped = true;
+  else LOG_FILEONLY ("API-threads still running after %u msec; not freeing the airport data.\n", API_EXIT_WAIT);
 
-  if (g_data.thread_hnd)
+  for (i = 0; i < g_data.num_threads; i++)
   {
-    WaitForSingleObject (g_data.thread_event, 500);
-    CloseHandle (g_data.thread_event);
-    CloseHandle ((HANDLE)g_data.thread_hnd);
+    CloseHandle (g_data.thread_hnd[i]);
+    g_data.thread_hnd [i] = NULL;
   }
-  g_data.thread_hnd = 0ULL;
+  g_data.num_threads = 0;
 }
 
 void airports_exit (bool free_airports)
 {
   if (free_airports)  /* If a SIGABRT was NOT raised, exit normally */
+     airports_exit_API();
+
+  if (g_data.API_queue.stopped)
   {
-    airports_exit_API();
+#if defined(USE_GEN_ROUTES)
+    routes_exit_index();
+#endif
     airports_exit_CSV();
     airports_exit_freq_CSV();
   }
   /* Otherwise at least try to save the cache.
    */
   airports_cache_write();
+
+  if (g_data.API_queue.stopped)
+     DeleteCriticalSection (&g_data.API_queue.lock);
+  g_data.API_queue.stopped = false;
   Modes.airports_priv = NULL;
 }
 
 /**
  * Find the airport location by it's IATA name.
- * Currently must tranverse the whole list :-(
  */
 static const char *find_airport_location_by_IATA (const char *IATA)
 {
-  const airport *a;
-
-  if (!IATA[0])
-     return (NULL);
+  const airport *a = CSV_lookup_IATA (IATA);
 
-  for (a = g_data.airports; a; a = a->next)
-      if (!stricmp(IATA, a->IATA))
-         return (a->location[0] ? a->location : NULL);
-  return (NULL);
+  return (a && a->location[0] ? a->location : NULL);
 }
 
 static const char *find_airport_location_by_ICAO (const char *ICAO)
 {
-  const airport *a;
-
-  if (!ICAO[0])
-     return (NULL);
+  const airport *a = CSV_lookup_ICAO (ICAO);
 
-  for (a = g_data.airports; a; a = a->next)
-      if (!stricmp(ICAO, a->ICAO))
-         return (a->location[0] ? a->location : NULL);
-  return (NULL);
+  return (a && a->location[0] ? a->location : NULL);
 }
 
 /**
@@ -1351,7 +3260,8 @@ static void airport_CSV_test_1 (void)
   printf ("%s():\n  Dumping %zu airport records: ", __FUNCTION__, i_max);
   AIRPORT_PRINT_HEADER (false);
 
-  for (i = 0, a = g_data.airports; a && i < i_max; a = a->next, i++)
+  i_max = min (i_max, g_data.ap_stats.CSV_numbers);
+  for (i = 0, a = g_data.airport_CSV; i < i_max; a++, i++)
       airport_print_rec (a, a->ICAO, i, -1.0F, false);
   puts ("");
 }
@@ -1364,8 +3274,7 @@ static void airport_CSV_test_1 (void)
                    { location  },                    \
                    { full_name },                    \
                    { lon, lat  },                    \
-                   AIRPORT_CSV,                      \
-                   NULL                              \
+                   AIRPORT_CSV                       \
                  }
 
 static const airport airport_tests [] = {
@@ -1575,6 +3484,61 @@ static void airport_API_test_2 (void)
   puts ("");
 }
 
+/**
+ * Compare the k-d tree nearest-airport lookup against a linear scan
+ * for some random positions. And do a within-radius lookup around each.
+ */
+static void airport_kd_test_1 (void)
+{
+  const airport *within [10];
+  uint32_t       i, j, num_ok = 0, num = 10;
+
+  printf ("%s():\n  Checking %u random positions.\n", __FUNCTION__, num);
+  puts ("    lat       lon       nearest   distance   k-d usec  scan usec  within 50 km\n"
+        "  -------------------------------------------------------------------------");
+
+  for (i = 0; i < num; i++)
+  {
+    const airport *a, *scan = NULL;
+    pos_t          pos;
+    double         dist, best = DBL_MAX, now, kd_usec;
+
+    pos.lat = (double) random_range (-60*1000, 70*1000) / 1000.0 + 0.0005;
+    pos.lon = (double) random_range (-179*1000, 179*1000) / 1000.0 + 0.0005;
+
+    now     = get_usec_now();
+    a       = airports_nearest (&pos, &dist);
+    kd_usec = get_usec_now() - now;
+
+    now = get_usec_now();
+    for (j = 0; j < g_data.ap_stats.CSV_numbers; j++)
+    {
+      const airport *b = g_data.airport_CSV + j;
+      double         d;
+
+      if (!VALID_POS(b->pos))
+         continue;
+      d = great_circle_dist (pos, b->pos);
+      if (d < best)
+      {
+        best = d;
+        scan = b;
+      }
+    }
+
+    /* Different airports at the same distance are okay.
+     */
+    if (a && scan && (a == scan || fabs(dist - best) < 1.0))
+       num_ok++;
+
+    printf ("  %8.3f %9.3f  %-8s %8.1f km  %9.2f  %9.2f  %u\n",
+            pos.lat, pos.lon, a ? a->ICAO : "?", a ? dist / 1000.0 : 0.0,
+            kd_usec, get_usec_now() - now, airports_within (&pos, 50000.0, within, DIM(within)));
+  }
+  printf ("  %3u OKAY\n", num_ok);
+  printf ("  %3u FAIL\n\n", num - num_ok);
+}
+
 /**
  * Do a simple test on some call-signs using the ADSB-LOL API
  * setup in `airports_init_API()`.
@@ -1670,7 +3634,139 @@ static void locale_test (void)
 /**
  * Handling of "Flight Information".
  *
- * Created a linked list of pending, live or cached flight-information.
+ * The bucket in `g_data.flights.by_addr` for an ICAO address.
+ */
+static uint32_t flight_addr_bucket (uint32_t addr)
+{
+  return ((addr * 2654435761U) >> 20) & (FLIGHT_HASH_SIZE - 1);
+}
+
+static uint32_t flight_call_sign_bucket (const char *call_sign)
+{
+  return (upper_hash(call_sign) & (FLIGHT_HASH_SIZE - 1));
+}
+
+/**
+ * Append `f` to the `g_data.flights` list.
+ */
+static void flight_store_append (flight_info *f)
+{
+  f->next = NULL;
+  if (g_data.flights.tail)
+       g_data.flights.tail->next = f;
+  else g_data.flights.head = f;
+  g_data.flights.tail = f;
+}
+
+/**
+ * Add `f` to the `g_data.flights` list and hash-indices.
+ * Called with `g_data.flights.lock` held exclusive.
+ */
+static void flight_store_add (flight_info *f)
+{
+  uint32_t bucket = flight_call_sign_bucket (f->call_sign);
+
+  flight_store_append (f);
+  f->cs_next = g_data.flights.by_call_sign [bucket];
+  g_data.flights.by_call_sign [bucket] = f;
+
+  if (f->ICAO_addr != ICAO_UNKNOWN)
+  {
+    bucket = flight_addr_bucket (f->ICAO_addr);
+    f->addr_next = g_data.flights.by_addr [bucket];
+    g_data.flights.by_addr [bucket] = f;
+  }
+  g_data.flights.num++;
+}
+
+/**
+ * Remove `f` from the `g_data.flights` hash-indices.
+ * Called with `g_data.flights.lock` held exclusive.
+ */
+static void flight_store_unindex (const flight_info *f)
+{
+  flight_info **p = &g_data.flights.by_call_sign [flight_call_sign_bucket(f->call_sign)];
+
+  while (*p != f)
+     p = &(*p)->cs_next;
+  *p = f->cs_next;
+
+  if (f->ICAO_addr != ICAO_UNKNOWN)
+  {
+    p = &g_data.flights.by_addr [flight_addr_bucket(f->ICAO_addr)];
+    while (*p != f)
+       p = &(*p)->addr_next;
+    *p = f->addr_next;
+  }
+}
+
+/**
+ * Mark `f` as used for the eviction in `flight_store_evict()`.
+ * Called with `g_data.flights.lock` held shared.
+ */
+static void flight_store_touch (flight_info *f)
+{
+  if (!f->referenced)
+     InterlockedExchange (&f->referenced, 1);
+}
+
+/**
+ * Evict the least recently used records when there are more than `FLIGHT_INFO_MAX`.
+ * Records still `AIRPORT_API_PENDING` are referenced by the `API_queue` and kept.
+ *
+ * Called from `airports_background()` in the main-thread.
+ */
+static void flight_store_evict (void)
+{
+  uint32_t passes;
+
+  AcquireSRWLockExclusive (&g_data.flights.lock);
+
+  passes = g_data.flights.num;  /* at most one pass over the list */
+
+  while (g_data.flights.num > FLIGHT_INFO_MAX && passes-- > 0)
+  {
+    flight_info *f = g_data.flights.head;
+
+    g_data.flights.head = f->next;
+    if (!g_data.flights.head)
+       g_data.flights.tail = NULL;
+
+    if (f->type == AIRPORT_API_PENDING || f->referenced)
+    {
+      f->referenced = 0;
+      flight_store_append (f);   /* give it a second chance */
+      continue;
+    }
+
+    flight_store_unindex (f);
+    g_data.flights.num--;
+    g_data.flights.evicted++;
+    g_data.fs_stats.total--;
+    switch (f->type)
+    {
+      case AIRPORT_API_LIVE:
+           g_data.fs_stats.live--;
+           break;
+      case AIRPORT_API_CACHED:
+           g_data.fs_stats.cached--;
+           break;
+      case AIRPORT_API_DEAD:
+           g_data.fs_stats.dead--;
+           break;
+      case AIRPORT_API_EXPIRED:
+           g_data.fs_stats.expired--;
+           break;
+      default:
+           break;
+    }
+    free (f);
+  }
+  ReleaseSRWLockExclusive (&g_data.flights.lock);
+}
+
+/**
+ * Create a pending, live or cached flight-information record in `g_data.flights`.
  */
 static flight_info *flight_info_create (const char *call_sign, uint32_t addr, airport_t type)
 {
@@ -1686,7 +3782,9 @@ static flight_info *flight_info_create (const char *call_sign, uint32_t addr, ai
   strcpy (f->departure, "?");
   strcpy (f->destination, "?");
 
-  LIST_ADD_TAIL (flight_info, &g_data.flight_info, f);
+  AcquireSRWLockExclusive (&g_data.flights.lock);
+
+  flight_store_add (f);
 
   g_data.fs_stats.total++;
   switch (type)
@@ -1704,9 +3802,29 @@ static flight_info *flight_info_create (const char *call_sign, uint32_t addr, ai
          assert (0);
          break;
   }
+  ReleaseSRWLockExclusive (&g_data.flights.lock);
   return (f);
 }
 
+/**
+ * Find the newest record for a call-sign in `g_data.flights`.
+ * Called with `g_data.flights.lock` held shared.
+ */
+static flight_info *flight_info_find_by_callsign (const char *call_sign)
+{
+  flight_info *f;
+
+  for (f = g_data.flights.by_call_sign [flight_call_sign_bucket(call_sign)]; f; f = f->cs_next)
+  {
+    if (!stricmp(f->call_sign, call_sign))
+    {
+      flight_store_touch (f);
+      return (f);
+    }
+  }
+  return (NULL);
+}
+
 /**
  * As above, but for any ICAO address (or a "live" ICAO address).
  */
@@ -1714,21 +3832,29 @@ static flight_info *flight_info_find_by_addr (uint32_t addr)
 {
   flight_info *f;
 
-  for (f = g_data.flight_info; f; f = f->next)
+  if (addr == ICAO_UNKNOWN)
+     return (NULL);
+
+  for (f = g_data.flights.by_addr [flight_addr_bucket(addr)]; f; f = f->addr_next)
   {
-    if (f->ICAO_addr != ICAO_UNKNOWN && addr == f->ICAO_addr)
-       return (f);
+    if (addr == f->ICAO_addr)
+    {
+      flight_store_touch (f);
+      return (f);
+    }
   }
   return (NULL);
 }
 
 /**
  * Find `flight_info` for a `call_sign` in either
- * `route_records[]` or the `g_data.flight_info` cache.
+ * `route_records[]` or the `g_data.flights` cache.
  *
  * If `Modes.prefer_ADSB_LOL == true` (from the config-file), search in
- * `g_data.flight_info` cache. If not found there, we return NULL to create
+ * `g_data.flights` cache. If not found there, we return NULL to create
  * a new `AIRPORT_API_PENDING` record handled by 'API_thread_worker()'.
+ *
+ * Called with `g_data.flights.lock` held shared.
  */
 static flight_info *find_by_callsign (const char *call_sign, bool *fixed)
 {
@@ -1750,21 +3876,31 @@ static flight_info *find_by_callsign (const char *call_sign, bool *fixed)
 
   cache_lookup:
 
-  for (f = g_data.flight_info; f; f = f->next)
-  {
-    if (!stricmp(f->call_sign, call_sign))
-       return (f);
-  }
-  return (NULL);
+  return flight_info_find_by_callsign (call_sign);
 }
 
 /**
- * Write a `g_data.flight_info` element to file-cache.
+ * Write a `g_data.flights` element to file-cache.
  */
 static bool flight_info_write (FILE *file, const flight_info *f)
+{
+  char buf [200];
+
+  if (flight_info_format(buf, sizeof(buf), f) == 0)
+     return (false);
+  fputs (buf, file);
+  return (true);
+}
+
+/**
+ * Format a `g_data.flights` element as a line for the file-cache.
+ * Return 0 if it should not be cached. With `buf == NULL`, just check that.
+ */
+static size_t flight_info_format (char *buf, size_t size, const flight_info *f)
 {
   const char *departure   = f->departure;
   const char *destination = f->destination;
+  int         len;
 
   if (!stricmp(f->departure, "unknown"))
      departure = "?";
@@ -1772,38 +3908,41 @@ static bool flight_info_write (FILE *file, const flight_info *f)
      destination = "?";
 
   if (*departure == '?' || *destination == '?')
-     return (false);
+     return (0);
 
   /* Cache only LIVE / CACHED records
    */
   if (f->type != AIRPORT_API_LIVE && f->type != AIRPORT_API_CACHED)
-     return (false);
+     return (0);
 
-  fprintf (file, "%d,%s,%s,%s,%06X,%llu\n",
-           f->type, f->call_sign, departure, destination, f->ICAO_addr,
-           *(const ULONGLONG*) &f->created);
-  return (true);
+  if (!buf)
+     return (1);
+
+  len = snprintf (buf, size, "%d,%s,%s,%s,%06X,%llu\n",
+                  f->type, f->call_sign, departure, destination, f->ICAO_addr,
+                  *(const ULONGLONG*) &f->created);
+  return (len > 0 && (size_t)len < size ? (size_t)len : 0);
 }
 
 /**
  * Exit function for flight-info:
- *  \li Write the `AIRPORT_API_CACHED` or `AIRPORT_API_LIVE` records to `Modes.airport_cache`.
- *  \li Free the `g_data.flight_info` list.
+ *  \li Free the `g_data.flights` store.
  */
-static void flight_info_exit (FILE *file)
+static void flight_info_exit (void)
 {
   flight_info *f, *f_next;
 
-  for (f = g_data.flight_info; f; f = f_next)
+  AcquireSRWLockExclusive (&g_data.flights.lock);
+  for (f = g_data.flights.head; f; f = f_next)
   {
-    if (file)
-       flight_info_write (file, f);
-
     f_next = f->next;
-    LIST_DELETE (flight_info, &g_data.flight_info, f);
     free (f);
   }
-  g_data.flight_info = NULL;
+  g_data.flights.head = g_data.flights.tail = NULL;
+  g_data.flights.num  = 0;
+  memset (g_data.flights.by_call_sign, '\0', sizeof(g_data.flights.by_call_sign));
+  memset (g_data.flights.by_addr, '\0', sizeof(g_data.flights.by_addr));
+  ReleaseSRWLockExclusive (&g_data.flights.lock);
 }
 
 /**
@@ -1815,7 +3954,8 @@ static void flight_stats_now (flight_info_stats *fs)
 
   memset (fs, '\0', sizeof(*fs));
 
-  for (f = g_data.flight_info; f; f = f->next)
+  AcquireSRWLockShared (&g_data.flights.lock);
+  for (f = g_data.flights.head; f; f = f->next)
   {
     fs->total++;
     switch (f->type)
@@ -1840,12 +3980,13 @@ static void flight_stats_now (flight_info_stats *fs)
            break;
     }
   }
+  ReleaseSRWLockShared (&g_data.flights.lock);
 }
 
 /**
  * Non-blocking function called to get flight-information for a single call-sign.
  *
- * Add to the API lookup-queue if not already in the `g_data.flight_info` linked list.
+ * Add to the API lookup-queue if not already in the `g_data.flights` store.
  * \param call_sign   [in]      the call-sign to resolve.
  * \param addr        [in]      the plane's ICAO address.
  * \param departure   [in|out]  a pointer to the IATA departure airport.
@@ -1858,7 +3999,7 @@ bool airports_API_get_flight_info (const char  *call_sign,
 {
   const char  *type;
   const char   *end;
-  bool          fixed;
+  bool          fixed, expired;
   flight_info *f;
 
   *departure = *destination = NULL;
@@ -1881,28 +4022,40 @@ bool airports_API_get_flight_info (const char  *call_sign,
   end = strrchr (call_sign, '\0');
   assert (end[-1] != ' ');
 
+  AcquireSRWLockShared (&g_data.flights.lock);
+
   f = find_by_callsign (call_sign, &fixed);
   if (!f)
   {
-    flight_info_create (call_sign, addr, AIRPORT_API_PENDING);
-    API_TRACE ("Created PENDING record for call_sign: '%s'", call_sign);
+    ReleaseSRWLockShared (&g_data.flights.lock);
+    API_enqueue (call_sign, addr);
     return (false);
   }
 
-  if (f->type == AIRPORT_API_CACHED)
-  {
-    if (fixed)
-         g_data.ap_stats.routes_records_used++;
-    else g_data.ap_stats.API_used_CSV++;
-  }
+  if (f->type == AIRPORT_API_CACHED && !fixed)  /* `routes_find_by_callsign()` counted a fixed one */
+     g_data.ap_stats.API_used_CSV++;
 
   type = airport_t_str (f->type);
 
+  /* The strings of a LIVE or CACHED record never change and only
+   * the main-thread evicts it. So these are safe to return.
+   */
   if (f->type == AIRPORT_API_LIVE || f->type == AIRPORT_API_CACHED)
   {
-    API_TRACE ("call_sign: '%s', type: %s, '%s' -> '%s'", call_sign, type, f->departure, f->destination);
     *departure   = f->departure;
     *destination = f->destination;
+  }
+  expired = (f->type == AIRPORT_API_EXPIRED);
+  ReleaseSRWLockShared (&g_data.flights.lock);
+
+  /* Refresh an expired record from the journal
+   */
+  if (expired)
+     API_enqueue (call_sign, addr);
+
+  if (*departure)
+  {
+    API_TRACE ("call_sign: '%s', type: %s, '%s' -> '%s'", call_sign, type, *departure, *destination);
     return (true);
   }
 
@@ -1937,14 +4090,21 @@ bool airports_API_flight_log_resolved (const aircraft *a)
   bool         fixed;
   ULONGLONG    ft_diff;
   double       msec;
-  flight_info *f;
+  flight_info *f, copy;
 
   assert (a->is_helicopter == false);
 
+  AcquireSRWLockShared (&g_data.flights.lock);
   f = find_by_callsign (a->call_sign, &fixed);
+  if (f)
+     copy = *f;
+  ReleaseSRWLockShared (&g_data.flights.lock);
+
   if (!f)
      return (false);
 
+  f = &copy;
+
   snprintf (plane_buf, sizeof(plane_buf), "plane %06X, call-sign: %s", a->addr, f->call_sign);
 
   if (f->type == AIRPORT_API_LIVE || f->type == AIRPORT_API_CACHED)
@@ -2005,7 +4165,8 @@ bool airports_API_flight_log_resolved (const aircraft *a)
  */
 bool airports_API_flight_log_leaving (const aircraft *a)
 {
-  flight_info *f = flight_info_find_by_addr (a->addr);
+  flight_info *f;
+  char         f_call_sign [sizeof(f->call_sign)] = "";
   const char  *km_nmiles = "Nm";
   const char  *m_feet    = "ft";
   const char  *call_sign = "?";
@@ -2026,10 +4187,16 @@ bool airports_API_flight_log_leaving (const aircraft *a)
     _itoa (altitude, alt_buf, 10);
   }
 
+  AcquireSRWLockShared (&g_data.flights.lock);
+  f = flight_info_find_by_addr (a->addr);
+  if (f)
+     strcpy (f_call_sign, f->call_sign);
+  ReleaseSRWLockShared (&g_data.flights.lock);
+
   if (a->call_sign[0])
      call_sign = a->call_sign;
-  else if (f && f->call_sign[0])
-     call_sign = f->call_sign;    /* A cached plane or helicopter */
+  else if (f_call_sign[0])
+     call_sign = f_call_sign;     /* A cached plane or helicopter */
 
   LOG_FILEONLY ("%s %06X leaving. call-sign: %s, %sactive for %.1lf s, alt: %s %s, dist: %s/%s %s.\n",
                 a->is_helicopter ? "helicopter" : "plane",
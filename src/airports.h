@@ -36,5 +36,6 @@ bool     airports_API_get_flight_info (const char *call_sign, uint32_t addr,
 bool     airports_API_flight_log_entering (const aircraft *a);
 bool     airports_API_flight_log_resolved (const aircraft *a);
 bool     airports_API_flight_log_leaving (const aircraft *a);
+void     airports_nearest_update (aircraft *a);
 
 #endif /* _AIRPORTS_H */
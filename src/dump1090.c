@@ -25,6 +25,7 @@
 #include "sdrplay.h"
 #include "location.h"
 #include "airports.h"
+#include "routes.h"
 #include "interactive.h"
 
 global_data Modes;
@@ -99,6 +100,8 @@ static bool      set_home_pos_from_location_API (const char *arg);
 static bool      set_host_port_raw_in (const char *arg);
 static bool      set_host_port_raw_out (const char *arg);
 static bool      set_host_port_sbs_in (const char *arg);
+static bool      set_udp_raw_out (const char *arg);
+static bool      set_udp_sbs_out (const char *arg);
 static bool      set_logfile (const char *arg);
 static bool      set_loops (const char *arg);
 static bool      set_port_http (const char *arg);
@@ -108,6 +111,7 @@ static bool      set_port_sbs (const char *arg);
 static bool      set_prefer_adsb_lol (const char *arg);
 static bool      set_ppm (const char *arg);
 static bool      set_sample_rate (const char *arg);
+static bool      set_send_policy (const char *arg);
 static bool      set_tui (const char *arg);
 static bool      set_web_page (const char *arg);
 
@@ -128,6 +132,7 @@ static const struct cfg_table config[] = {
     { "calibrate",        ARG_ATOB,    (void*) &Modes.rtlsdr.calibrate },
     { "deny4",            ARG_FUNC,    (void*) net_deny4 },
     { "deny6",            ARG_FUNC,    (void*) net_deny6 },
+    { "deny-reload",      ARG_ATO_U32, (void*) &Modes.deny_reload },
     { "gain",             ARG_FUNC,    (void*) set_gain },
     { "homepos",          ARG_FUNC,    (void*) set_home_pos },
     { "location",         ARG_FUNC,    (void*) set_home_pos_from_location_API },
@@ -135,8 +140,13 @@ static const struct cfg_table config[] = {
     { "metric",           ARG_ATOB,    (void*) &Modes.metric },
     { "web-page",         ARG_FUNC,    (void*) set_web_page },
     { "web-touch",        ARG_ATOB,    (void*) &Modes.web_root_touch },
+    { "web-gzip-level",   ARG_ATO_U32, (void*) &Modes.web_gzip_level },
+    { "web-gzip-min",     ARG_ATO_U32, (void*) &Modes.web_gzip_min },
+    { "web-cache-max",    ARG_ATO_U32, (void*) &Modes.web_cache_max },
+    { "net-unique-max",   ARG_ATO_U32, (void*) &Modes.net_unique_max },
     { "tui",              ARG_FUNC,    (void*) set_tui },
     { "airports",         ARG_STRCPY,  (void*) &Modes.airport_db },
+    { "routes",           ARG_STRCPY,  (void*) &Modes.routes_db },
     { "aircrafts",        ARG_STRCPY,  (void*) &Modes.aircraft_db },
     { "aircrafts-url",    ARG_STRDUP,  (void*) &Modes.aircraft_db_url },
     { "bandwidth",        ARG_FUNC,    (void*) set_bandwidth },
@@ -154,7 +164,20 @@ static const struct cfg_table config[] = {
     { "net-ri-port",      ARG_FUNC,    (void*) set_port_raw_in },
     { "net-ro-port",      ARG_FUNC,    (void*) set_port_raw_out },
     { "net-sbs-port",     ARG_FUNC,    (void*) set_port_sbs },
+    { "net-send-max",     ARG_ATO_U32, (void*) &Modes.net_send_max },
+    { "net-send-policy",  ARG_FUNC,    (void*) set_send_policy },
+    { "net-flush-interval", ARG_ATO_U32, (void*) &Modes.net_flush_interval },
+    { "net-flush-size",   ARG_ATO_U32, (void*) &Modes.net_flush_size },
+    { "net-udp-raw-out",  ARG_FUNC,    (void*) set_udp_raw_out },
+    { "net-udp-sbs-out",  ARG_FUNC,    (void*) set_udp_sbs_out },
+    { "net-udp-mtu",      ARG_ATO_U32, (void*) &Modes.net_udp_mtu },
+    { "upstream",         ARG_FUNC,    (void*) net_upstream_add },
     { "prefer-adsb-lol",  ARG_FUNC,    (void*) set_prefer_adsb_lol },
+    { "adsb-lol-url",     ARG_STRDUP,  (void*) &Modes.adsb_lol_url },
+    { "adsb-lol-requests", ARG_ATO_U32, (void*) &Modes.adsb_lol_requests },
+    { "adsb-lol-rate",    ARG_ATO_U32, (void*) &Modes.adsb_lol_rate },
+    { "adsb-lol-routeset-url", ARG_STRDUP,  (void*) &Modes.adsb_lol_routeset_url },
+    { "adsb-lol-batch",   ARG_ATO_U32, (void*) &Modes.adsb_lol_batch },
     { "rtl-reset",        ARG_ATOB,    (void*) &Modes.rtlsdr.power_cycle },
     { "samplerate",       ARG_FUNC,    (void*) set_sample_rate },
     { "silent",           ARG_ATOB,    (void*) &Modes.silent },
@@ -384,6 +407,7 @@ static void modeS_init_config (void)
   snprintf (Modes.airport_db, sizeof(Modes.airport_db), "%s\\%s", Modes.where_am_I, AIRPORT_DATABASE_CSV);
 
   snprintf (Modes.airport_freq_db, sizeof(Modes.airport_freq_db), "%s\\%s", Modes.where_am_I, AIRPORT_FREQ_CSV);
+  snprintf (Modes.routes_db, sizeof(Modes.routes_db), "%s\\%s", Modes.where_am_I, ROUTES_DATABASE_BIN);
   snprintf (Modes.airport_cache, sizeof(Modes.airport_cache), "%s\\%s", Modes.tmp_dir, AIRPORT_DATABASE_CACHE);
 
   /* Defaults for SDRPlay:
@@ -397,6 +421,15 @@ static void modeS_init_config (void)
   Modes.freq            = MODES_DEFAULT_FREQ;
   Modes.interactive_ttl = MODES_INTERACTIVE_TTL;
   Modes.json_interval   = 1000;
+  Modes.web_gzip_level  = 6;
+  Modes.web_gzip_min    = 1024;    /* bytes */
+  Modes.web_cache_max   = 64;      /* MBytes */
+  Modes.net_send_max    = 256;     /* kBytes */
+  Modes.net_flush_interval = 10;   /* msec */
+  Modes.net_flush_size  = 8192;    /* bytes */
+  Modes.net_udp_mtu     = 1400;    /* bytes */
+  Modes.net_unique_max  = 10000;
+  Modes.deny_reload     = 10;      /* sec */
   Modes.tui_interface   = TUI_WINCON;
 
   Modes.error_correct_1 = true;
@@ -404,6 +437,7 @@ static void modeS_init_config (void)
 
   InitializeCriticalSection (&Modes.data_mutex);
   InitializeCriticalSection (&Modes.print_mutex);
+  InitializeConditionVariable (&Modes.data_event);
 }
 
 /**
@@ -702,6 +736,11 @@ void rx_callback (uint8_t *buf, uint32_t len, void *ctx)
   if (len > MODES_ASYNC_BUF_SIZE)
      len = MODES_ASYNC_BUF_SIZE;
 
+  /* The decoder did not get the previous block
+   */
+  if (Modes.data_ready)
+     Modes.stat.rx_overruns++;
+
   /* Move the last part of the previous buffer, that was not processed,
    * to the start of the new buffer.
    */
@@ -711,6 +750,7 @@ void rx_callback (uint8_t *buf, uint32_t len, void *ctx)
    */
   memcpy (Modes.data + 4*(MODES_FULL_LEN-1), buf, len);
   Modes.data_ready = true;
+  WakeConditionVariable (&Modes.data_event);
   LeaveCriticalSection (&Modes.data_mutex);
 }
 
@@ -847,6 +887,14 @@ static void main_data_loop (void)
   {
     background_tasks();
 
+    /* Wait for data from the reader thread or input from the network thread.
+     * But no longer than the next `background_tasks()` is due.
+     */
+    EnterCriticalSection (&Modes.data_mutex);
+    if (!Modes.data_ready && !Modes.net_input)
+       SleepConditionVariableCS (&Modes.data_event, &Modes.data_mutex, MODES_INTERACTIVE_REFRESH_TIME / 2);
+    LeaveCriticalSection (&Modes.data_mutex);
+
     if (!Modes.data_ready)
        continue;
 
@@ -2488,13 +2536,22 @@ static void modeS_user_message (const modeS_message *mm)
   uint64_t  now = MSEC_TIME();
   aircraft *a;
 
+  /* Drop a copy from another `upstream` source before any output
+   */
+  if (aircraft_is_duplicate(mm, now))
+  {
+    Modes.stat.upstream_dups++;
+    return;
+  }
+
   Modes.stat.messages_total++;
   a = interactive_receive_data (mm, now);
 
   if (a &&
-      Modes.stat.cli_accepted [MODES_NET_SERVICE_SBS_OUT] > 0 && /* If we have accepted >=1 client */
-      net_handler_sending(MODES_NET_SERVICE_SBS_OUT))            /* and we're still sending */
-     modeS_send_SBS_output (mm, a);                              /* Feed SBS output clients. */
+      (Modes.stat.cli_accepted [MODES_NET_SERVICE_SBS_OUT] > 0 || /* If we have accepted >=1 client */
+       net_udp_output(MODES_NET_SERVICE_SBS_OUT)) &&              /* or have a UDP output */
+      net_handler_sending(MODES_NET_SERVICE_SBS_OUT))             /* and we're still sending */
+     modeS_send_SBS_output (mm, a);                               /* Feed SBS output clients. */
 
   /* In non-interactive mode, display messages on standard output.
    * In silent-mode, do nothing just to consentrate on network traces.
@@ -2770,6 +2827,14 @@ bool decode_RAW_message (mg_iobuf *msg, int loop_cnt)
     len--;
   }
 
+  /* A sequence number from a UDP sender
+   */
+  if (*hex == '#' && net_udp_seq(MODES_NET_SERVICE_RAW_IN, (const char*)hex))
+  {
+    mg_iobuf_del (msg, 0, end - msg->buf);
+    return (true);
+  }
+
   /* Check it's format.
    */
   if (len < 2)
@@ -2817,8 +2882,12 @@ bool decode_RAW_message (mg_iobuf *msg, int loop_cnt)
   Modes.stat.RAW_good++;
 
   decode_modeS_message (&mm, bin_msg);
+  mm.source = Modes.net_source;
   if (mm.CRC_ok)
-     modeS_user_message (&mm);
+  {
+    net_upstream_count (mm.source);
+    modeS_user_message (&mm);
+  }
   return (true);
 }
 
@@ -2976,12 +3045,21 @@ bool decode_SBS_message (mg_iobuf *msg, int loop_cnt)
   if (end [-2] == '\r')
      end [-2] = '\0';
 
+  /* A sequence number from a UDP sender
+   */
+  if (*msg->buf == '#' && net_udp_seq(MODES_NET_SERVICE_SBS_IN, (const char*)msg->buf))
+  {
+    mg_iobuf_del (msg, 0, end - msg->buf);
+    return (true);
+  }
+
   if (modeS_SBS_valid_msg(msg, &ignore))
   {
     if (!ignore)
     {
       LOG_GOOD_SBS ("'%.*s'", (int)(end - msg->buf), msg->buf);
       modeS_recv_SBS_input ((char*) msg->buf, &mm);
+      net_upstream_count (Modes.net_source);
     }
     mg_iobuf_del (msg, 0, end - msg->buf);
     return (true);
@@ -3055,7 +3133,7 @@ static void NO_RETURN show_help (const char *fmt, ...)
 /**
  * This background function is called continously by `main_data_loop()`.
  * It performs:
- *  \li Polls the network for events blocking less than 125 msec.
+ *  \li Decodes the RAW / SBS input from the network thread (never blocking).
  *  \li Polls the `Windows Location API` for a location every 250 msec.
  *  \li Removes inactive aircrafts from the list.
  *  \li Refreshes interactive data every 250 msec (`MODES_INTERACTIVE_REFRESH_TIME`).
@@ -3100,6 +3178,7 @@ static void background_tasks (void)
   }
 
   aircraft_remove_stale (now);
+  aircraft_json_update();
   airports_background (now);
 
   /* Refresh screen and console-title when in interactive mode
@@ -3206,11 +3285,6 @@ static void show_decoder_stats (void)
   LOG_STDOUT (" %8llu total usable messages (%llu + %llu).\n", Modes.stat.good_CRC + Modes.stat.fixed, Modes.stat.good_CRC, Modes.stat.fixed);
   interactive_clreol();
 
-  /**\todo Move to `aircraft_show_stats()`
-   */
-  LOG_STDOUT (" %8llu unique aircrafts of which %llu was in CSV-file and %llu in SQL-file.\n",
-              Modes.stat.unique_aircrafts, Modes.stat.unique_aircrafts_CSV, Modes.stat.unique_aircrafts_SQL);
-
   print_unrecognized_ME();
 }
 
@@ -3228,6 +3302,9 @@ static void show_statistics (void)
   if (any_device)  /* assume we got some data */
      show_decoder_stats();
 
+  if (any_device || Modes.net)
+     aircraft_show_stats();
+
   if (Modes.net)
      net_show_stats();
 
@@ -3292,6 +3369,8 @@ static void modeS_exit (void)
   free (Modes.rtlsdr.name);
   free (Modes.sdrplay.name);
   free (Modes.aircraft_db_url);
+  free (Modes.adsb_lol_url);
+  free (Modes.adsb_lol_routeset_url);
   free (Modes.tests);
 
   DeleteCriticalSection (&Modes.data_mutex);
@@ -3534,6 +3613,18 @@ static bool set_if_mode (const char *arg)
   return (true);
 }
 
+static bool set_send_policy (const char *arg)
+{
+  if (!stricmp(arg, "drop-oldest"))
+       Modes.net_send_policy = SEND_DROP_OLDEST;
+  else if (!stricmp(arg, "drop-newest"))
+       Modes.net_send_policy = SEND_DROP_NEWEST;
+  else if (!stricmp(arg, "disconnect"))
+       Modes.net_send_policy = SEND_DISCONNECT;
+  else printf ("%s(%u): Ignoring illegal 'net-send-policy': '%s'.\n",  cfg_current_file(), cfg_current_line(), arg);
+  return (true);
+}
+
 static bool set_interactive_ttl (const char *arg)
 {
   Modes.interactive_ttl = 1000 * atoi (arg);
@@ -3603,6 +3694,16 @@ static bool set_host_port_sbs_in (const char *arg)
   return (true);
 }
 
+static bool set_udp_raw_out (const char *arg)
+{
+  return net_udp_set_output (MODES_NET_SERVICE_RAW_OUT, arg);
+}
+
+static bool set_udp_sbs_out (const char *arg)
+{
+  return net_udp_set_output (MODES_NET_SERVICE_SBS_OUT, arg);
+}
+
 static bool set_ppm (const char *arg)
 {
   Modes.rtlsdr.ppm_error = atoi (arg);
@@ -3843,6 +3944,7 @@ int main (int argc, char **argv)
   }
 
 quit:
+  net_thread_stop();
   if (!init_error)
      show_statistics();
   modeS_exit();
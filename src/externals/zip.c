@@ -1793,3 +1793,21 @@ int zip_extract(const char *zipname, const char *dir,
 
   return zip_archive_extract(&zip_archive, dir, on_extract, arg);
 }
+
+size_t zip_inflate_mem(void *out_buf, size_t out_len, const void *in_buf,
+                       size_t in_len) {
+  return tinfl_decompress_mem_to_mem(out_buf, out_len, in_buf, in_len,
+                                     TINFL_FLAG_PARSE_ZLIB_HEADER);
+}
+
+void *zip_deflate_mem(const void *in_buf, size_t in_len, size_t *out_len,
+                      int level) {
+  int flags = (int)tdefl_create_comp_flags_from_zip_params(
+      level, -MZ_DEFAULT_WINDOW_BITS, MZ_DEFAULT_STRATEGY);
+
+  return tdefl_compress_mem_to_heap(in_buf, in_len, out_len, flags);
+}
+
+unsigned long zip_crc32(unsigned long crc, const void *buf, size_t len) {
+  return mz_crc32(crc, (const unsigned char *)buf, len);
+}
@@ -456,6 +456,44 @@ extern ZIP_EXPORT int zip_extract(const char *zipname, const char *dir,
                                   int (*on_extract_entry)(const char *filename,
                                                           void *arg),
                                   void *arg);
+
+/**
+ * Decompresses a zlib stream in memory.
+ *
+ * @param out_buf output buffer.
+ * @param out_len size of the output buffer.
+ * @param in_buf zlib stream (with a zlib header).
+ * @param in_len size of the zlib stream.
+ *
+ * @return the decompressed size or (size_t)-1 on error.
+ */
+extern ZIP_EXPORT size_t zip_inflate_mem(void *out_buf, size_t out_len,
+                                         const void *in_buf, size_t in_len);
+
+/**
+ * Compresses a buffer into a malloced raw deflate stream (no header).
+ *
+ * @param in_buf input buffer.
+ * @param in_len size of the input buffer.
+ * @param out_len size of the deflate stream.
+ * @param level compression level (0-10).
+ *
+ * @return the deflate stream (free it with free()) or NULL on error.
+ */
+extern ZIP_EXPORT void *zip_deflate_mem(const void *in_buf, size_t in_len,
+                                        size_t *out_len, int level);
+
+/**
+ * Updates a CRC-32 (as used by gzip and zip) with a buffer.
+ *
+ * @param crc the CRC-32 so far (0 to start).
+ * @param buf input buffer.
+ * @param len size of the input buffer.
+ *
+ * @return the updated CRC-32.
+ */
+extern ZIP_EXPORT unsigned long zip_crc32(unsigned long crc, const void *buf,
+                                          size_t len);
 /** @} */
 #ifdef __cplusplus
 }
@@ -613,6 +613,8 @@ aircraft *interactive_receive_data (const modeS_message *mm, uint64_t now)
   if (!a)
      return (NULL);
 
+  a->source = mm->source;
+
   a->seen_last = now;
   a->messages++;
 
@@ -21,6 +21,7 @@
 #endif
 
 #include "aircraft.h"
+#include "airports.h"
 #include "sqlite3.h"
 #include "trace.h"
 #include "misc.h"
@@ -920,6 +921,41 @@ int touch_dir (const char *directory, bool recurse)
   closedir (dir);
   return (rc);
 }
+
+/**
+ * Call `func` for all files in a directory and all it's sub-directories.
+ * Returns the number of files.
+ */
+int walk_dir (const char *directory, walk_func func, void *arg)
+{
+  dirent *d;
+  DIR    *dir = opendir (directory);
+  int     rc = 0;
+
+  if (!dir)
+     return (0);
+
+  while ((d = readdir(dir)) != NULL)
+  {
+    mg_file_path full_name;
+    DWORD        attrs;
+
+    if (!strcmp(d->d_name, ".") || !strcmp(d->d_name, ".."))
+       continue;
+
+    snprintf (full_name, sizeof(full_name), "%s\\%s", directory, d->d_name);
+    attrs = GetFileAttributesA (full_name);
+    if (attrs != INVALID_FILE_ATTRIBUTES && (attrs & FILE_ATTRIBUTE_DIRECTORY))
+       rc += walk_dir (full_name, func, arg);
+    else
+    {
+      (*func) (full_name, arg);
+      rc++;
+    }
+  }
+  closedir (dir);
+  return (rc);
+}
 #endif /* MG_ENABLE_FILE */
 
 /**
@@ -1598,6 +1634,35 @@ DEF_FUNC (BOOL, HttpQueryInfoA, (HINTERNET handle,
                                  DWORD    *buf_len,
                                  DWORD    *index));
 
+DEF_FUNC (BOOL, InternetCrackUrlA, (const char      *url,
+                                    DWORD            url_len,
+                                    DWORD            flags,
+                                    URL_COMPONENTSA *components));
+
+DEF_FUNC (HINTERNET, InternetConnectA, (HINTERNET     hnd,
+                                        const char   *server_name,
+                                        INTERNET_PORT server_port,
+                                        const char   *user_name,
+                                        const char   *password,
+                                        DWORD         service,
+                                        DWORD         flags,
+                                        DWORD_PTR     context));
+
+DEF_FUNC (HINTERNET, HttpOpenRequestA, (HINTERNET    hnd,
+                                        const char  *verb,
+                                        const char  *object_name,
+                                        const char  *version,
+                                        const char  *referrer,
+                                        const char **accept_types,
+                                        DWORD        flags,
+                                        DWORD_PTR    context));
+
+DEF_FUNC (BOOL, HttpSendRequestA, (HINTERNET   hnd,
+                                   const char *headers,
+                                   DWORD       headers_len,
+                                   void       *optional,
+                                   DWORD       optional_len));
+
 /**
  * \def BUF_INCREMENT
  * Initial and incremental buffer size of `download_to_buf()`.
@@ -1648,8 +1713,20 @@ int unload_dynamic_table (struct dyn_struct *tab, int tab_size)
   return (i);
 }
 
+/**
+ * The last error from `WinInet.dll` in the calling thread.
+ * Several API-threads in `airports.c` can download concurrently.
+ */
+static __declspec(thread) const char *wininet_last_err;
+
+const char *wininet_last_error (void)
+{
+  return (wininet_last_err ? wininet_last_err : "unknown error");
+}
+
 /**
  * Return error-string for `err` from `WinInet.dll`.
+ * The string is private to the calling thread.
  *
  * Try to get a more detailed error-code and text from
  * the server response using `InternetGetLastResponseInfoA()`.
@@ -1657,21 +1734,21 @@ int unload_dynamic_table (struct dyn_struct *tab, int tab_size)
 const char *wininet_strerror (DWORD err)
 {
   HMODULE mod = GetModuleHandleA ("wininet.dll");
-  static char buf [512];
+  static __declspec(thread) char buf [512];
 
-  Modes.wininet_last_error = NULL;
+  wininet_last_err = NULL;
 
   if (mod && FormatMessageA (FORMAT_MESSAGE_FROM_HMODULE,
                              mod, err, MAKELANGID(LANG_NEUTRAL,SUBLANG_DEFAULT),
                              buf, sizeof(buf), NULL))
   {
-    static char err_buf [512];
+    static __declspec(thread) char err_buf [512];
     char   wininet_err_buf [200];
     char  *p;
     DWORD  wininet_err = 0;
     DWORD  wininet_err_len = sizeof(wininet_err_buf)-1;
 
-    Modes.wininet_last_error = buf;
+    wininet_last_err = buf;
 
     p = strrchr (buf, '\r');
     if (p)
@@ -1687,12 +1764,12 @@ const char *wininet_strerror (DWORD err)
     if ((*p_InternetGetLastResponseInfoA) (&wininet_err, wininet_err_buf, &wininet_err_len) &&
         wininet_err > INTERNET_ERROR_BASE && wininet_err <= INTERNET_ERROR_LAST)
     {
-      snprintf (p, (size_t)(p-err_buf), " (%lu/%s)", (u_long)wininet_err, wininet_err_buf);
+      snprintf (p, sizeof(err_buf) - (size_t)(p-err_buf), " (%lu/%s)", (u_long)wininet_err, wininet_err_buf);
       p = strrchr (p, '.');
       if (p && p[1] == '\0')
          *p = '\0';
     }
-    Modes.wininet_last_error = err_buf;
+    wininet_last_err = err_buf;
     return (err_buf);
   }
   return win_strerror (err);
@@ -1711,7 +1788,7 @@ static bool download_init (HINTERNET *h1, HINTERNET *h2, const char *url)
   if (*h1 == NULL)
   {
     wininet_strerror (GetLastError());
-    DEBUG (DEBUG_NET, "InternetOpenA() failed: %s.\n", Modes.wininet_last_error);
+    DEBUG (DEBUG_NET, "InternetOpenA() failed: %s.\n", wininet_last_error());
     return (false);
   }
 
@@ -1729,7 +1806,79 @@ static bool download_init (HINTERNET *h1, HINTERNET *h2, const char *url)
   if (*h2 == NULL)
   {
     wininet_strerror (GetLastError());
-    DEBUG (DEBUG_NET, "InternetOpenA() failed: %s.\n", Modes.wininet_last_error);
+    DEBUG (DEBUG_NET, "InternetOpenA() failed: %s.\n", wininet_last_error());
+    return (false);
+  }
+  return (true);
+}
+
+/**
+ * Setup the `h1`, `h_conn` and `h2` handles for a WinInet POST request
+ * and send `body`. The response is read as for a GET request.
+ */
+static bool download_init_post (HINTERNET *h1, HINTERNET *h_conn, HINTERNET *h2,
+                                const char *url, const char *type, const char *body)
+{
+  URL_COMPONENTSA uc;
+  char            host [200];
+  char            path [500];
+  char            headers [100];
+  DWORD           url_flags;
+
+  memset (&uc, '\0', sizeof(uc));
+  uc.dwStructSize     = sizeof(uc);
+  uc.lpszHostName     = host;
+  uc.dwHostNameLength = sizeof(host);
+  uc.lpszUrlPath      = path;
+  uc.dwUrlPathLength  = sizeof(path);
+
+  if (!(*p_InternetCrackUrlA) (url, 0, 0, &uc))
+  {
+    wininet_strerror (GetLastError());
+    DEBUG (DEBUG_NET, "InternetCrackUrlA() failed: %s.\n", wininet_last_error());
+    return (false);
+  }
+
+  *h1 = (*p_InternetOpenA) ("dump1090", INTERNET_OPEN_TYPE_DIRECT,
+                            NULL, NULL,
+                            INTERNET_FLAG_NO_COOKIES);
+  if (*h1 == NULL)
+  {
+    wininet_strerror (GetLastError());
+    DEBUG (DEBUG_NET, "InternetOpenA() failed: %s.\n", wininet_last_error());
+    return (false);
+  }
+
+  *h_conn = (*p_InternetConnectA) (*h1, host, uc.nPort, NULL, NULL,
+                                   INTERNET_SERVICE_HTTP, 0, 0);
+  if (*h_conn == NULL)
+  {
+    wininet_strerror (GetLastError());
+    DEBUG (DEBUG_NET, "InternetConnectA() failed: %s.\n", wininet_last_error());
+    return (false);
+  }
+
+  url_flags = INTERNET_FLAG_RELOAD |
+              INTERNET_FLAG_PRAGMA_NOCACHE |
+              INTERNET_FLAG_NO_CACHE_WRITE |
+              INTERNET_FLAG_NO_UI;
+
+  if (uc.nScheme == INTERNET_SCHEME_HTTPS)
+     url_flags |= INTERNET_FLAG_SECURE;
+
+  *h2 = (*p_HttpOpenRequestA) (*h_conn, "POST", path, NULL, NULL, NULL, url_flags, 0);
+  if (*h2 == NULL)
+  {
+    wininet_strerror (GetLastError());
+    DEBUG (DEBUG_NET, "HttpOpenRequestA() failed: %s.\n", wininet_last_error());
+    return (false);
+  }
+
+  snprintf (headers, sizeof(headers), "Content-Type: %s\r\n", type);
+  if (!(*p_HttpSendRequestA) (*h2, headers, (DWORD)-1, (void*)body, (DWORD)strlen(body)))
+  {
+    wininet_strerror (GetLastError());
+    DEBUG (DEBUG_NET, "HttpSendRequestA() failed: %s.\n", wininet_last_error());
     return (false);
   }
   return (true);
@@ -1747,13 +1896,20 @@ static struct dyn_struct wininet_funcs[] = {
                          ADD_VALUE (InternetGetLastResponseInfoA),
                          ADD_VALUE (InternetReadFile),
                          ADD_VALUE (InternetCloseHandle),
-                         ADD_VALUE (HttpQueryInfoA)
+                         ADD_VALUE (HttpQueryInfoA),
+                         ADD_VALUE (InternetCrackUrlA),
+                         ADD_VALUE (InternetConnectA),
+                         ADD_VALUE (HttpOpenRequestA),
+                         ADD_VALUE (HttpSendRequestA)
                        };
 
 typedef struct download_ctx {
         const char *url;
         const char *file;
+        const char *post_type;           /* the 'Content-Type' of a POST request */
+        const char *post_body;           /* the body of a POST request. Or NULL for a GET request */
         HINTERNET   h1;
+        HINTERNET   h_conn;              /* the connection handle of a POST request */
         HINTERNET   h2;
         FILE       *f;
         BOOL        wininet_rc;          /* last 'InternetReadFile()' result */
@@ -1765,15 +1921,53 @@ typedef struct download_ctx {
         DWORD       bytes_read_total;
         uint32_t    written_to_file;
         bool        got_last_chunk;
+        bool        wininet_loaded;      /* we hold a reference to `wininet_funcs[]` */
       } download_ctx;
 
-static int http_status = -1;
+/**
+ * The HTTP status of the last download in the calling thread.
+ * Several API-threads in `airports.c` can download concurrently.
+ */
+static __declspec(thread) int http_status = -1;
+
+/**
+ * The `wininet_funcs[]` table is loaded on the first download and
+ * unloaded when the last concurrent download is done.
+ */
+static SRWLOCK  wininet_lock = SRWLOCK_INIT;
+static uint32_t wininet_users;
+static bool     wininet_loaded;
 
 int download_status (void)
 {
   return (http_status);
 }
 
+static bool wininet_load (void)
+{
+  bool rc;
+
+  AcquireSRWLockExclusive (&wininet_lock);
+  if (!wininet_loaded)
+     wininet_loaded = (load_dynamic_table(wininet_funcs, DIM(wininet_funcs)) == DIM(wininet_funcs));
+  if (wininet_loaded)
+     wininet_users++;
+  rc = wininet_loaded;
+  ReleaseSRWLockExclusive (&wininet_lock);
+  return (rc);
+}
+
+static void wininet_unload (void)
+{
+  AcquireSRWLockExclusive (&wininet_lock);
+  if (wininet_users > 0 && --wininet_users == 0)
+  {
+    unload_dynamic_table (wininet_funcs, DIM(wininet_funcs));
+    wininet_loaded = false;
+  }
+  ReleaseSRWLockExclusive (&wininet_lock);
+}
+
 static bool download_exit (download_ctx *ctx, bool rc)
 {
   if (ctx->f)
@@ -1790,11 +1984,16 @@ static bool download_exit (download_ctx *ctx, bool rc)
     (*p_InternetCloseHandle) (ctx->h2);
   }
 
+  if (ctx->h_conn)
+    (*p_InternetCloseHandle) (ctx->h_conn);
+
   if (ctx->h1)
     (*p_InternetCloseHandle) (ctx->h1);
 
-  ctx->h1 = ctx->h2 = NULL;
-  unload_dynamic_table (wininet_funcs, DIM(wininet_funcs));
+  ctx->h1 = ctx->h2 = ctx->h_conn = NULL;
+  if (ctx->wininet_loaded)
+     wininet_unload();
+  ctx->wininet_loaded = false;
   return (rc);
 }
 
@@ -1848,11 +2047,15 @@ static bool download_to_buf_cb (download_ctx *ctx)
 static bool download_common (download_ctx *ctx,
                              const char   *url,
                              const char   *file,
+                             const char   *post_type,
+                             const char   *post_body,
                              bool        (*callback)(download_ctx *ctx))
 {
   memset (ctx, '\0', sizeof(*ctx));
-  ctx->url  = url;
-  ctx->file = file;
+  ctx->url       = url;
+  ctx->file      = file;
+  ctx->post_type = post_type;
+  ctx->post_body = post_body;
   http_status = -1; /* unknown now */
 
   if (ctx->file)
@@ -1877,13 +2080,19 @@ static bool download_common (download_ctx *ctx,
     }
   }
 
-  if (load_dynamic_table(wininet_funcs, DIM(wininet_funcs)) != DIM(wininet_funcs))
+  ctx->wininet_loaded = wininet_load();
+  if (!ctx->wininet_loaded)
   {
     DEBUG (DEBUG_NET, "Failed to load the needed 'WinInet.dll' functions.\n");
     return download_exit (ctx, false);
   }
 
-  if (!download_init(&ctx->h1, &ctx->h2, ctx->url))
+  if (ctx->post_body)
+  {
+    if (!download_init_post(&ctx->h1, &ctx->h_conn, &ctx->h2, ctx->url, ctx->post_type, ctx->post_body))
+       return download_exit (ctx, false);
+  }
+  else if (!download_init(&ctx->h1, &ctx->h2, ctx->url))
      return download_exit (ctx, false);
 
   while (1)
@@ -1919,7 +2128,7 @@ uint32_t download_to_file (const char *url, const char *file)
 {
   download_ctx ctx;
 
-  if (!download_common(&ctx, url, file, download_to_file_cb))
+  if (!download_common(&ctx, url, file, NULL, NULL, download_to_file_cb))
      return (0);
   return (ctx.written_to_file);
 }
@@ -1934,7 +2143,24 @@ char *download_to_buf (const char *url)
 {
   download_ctx ctx;
 
-  if (!download_common(&ctx, url, NULL, download_to_buf_cb))
+  if (!download_common(&ctx, url, NULL, NULL, NULL, download_to_buf_cb))
+     return (NULL);
+  return (ctx.dl_buf);
+}
+
+/**
+ * POST a request to an url using the Windows *WinInet API*.
+ *
+ * \param[in] url   the URL to post to.
+ * \param[in] type  the 'Content-Type' of `body`.
+ * \param[in] body  the request body.
+ * \retval    The allocated response. Caller must free this.
+ */
+char *download_post_to_buf (const char *url, const char *type, const char *body)
+{
+  download_ctx ctx;
+
+  if (!download_common(&ctx, url, NULL, type, body, download_to_buf_cb))
      return (NULL);
   return (ctx.dl_buf);
 }
@@ -2104,6 +2330,8 @@ static void set_home_distance (aircraft *a)
 
   if (a->even_CPR_time > 0 && a->odd_CPR_time > 0)
      a->EST_seen_last = (a->even_CPR_time > a->odd_CPR_time) ? a->even_CPR_time : a->odd_CPR_time;
+
+  airports_nearest_update (a);
 }
 
 /**
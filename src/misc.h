@@ -142,6 +142,7 @@ typedef struct mg_addr            mg_addr;
 typedef struct mg_str             mg_str;
 typedef struct mg_timer           mg_timer;
 typedef struct mg_iobuf           mg_iobuf;
+typedef struct mg_queue           mg_queue;
 typedef struct mg_ws_message      mg_ws_message;
 typedef struct mg_http_serve_opts mg_http_serve_opts;
 typedef char                      mg_file_path [MG_PATH_MAX];
@@ -160,9 +161,30 @@ typedef struct connection {
         ULONG              id;                /**< copy of `mg_connection::id` */
         bool               keep_alive;        /**< client request contains "Connection: keep-alive" */
         bool               encoding_gzip;     /**< gzip compressed client data (not yet) */
+        bool               ws_aircraft;       /**< a WebSocket client of "/ws/aircraft" */
+        uint32_t           ws_seq;            /**< the last aircraft update sent to it */
+        size_t             send_max;          /**< The highest send-queue depth seen for this client */
+        uint64_t           send_dropped;      /**< Bytes dropped since this client was too slow */
+        struct net_chunk  *send_chunk;        /**< The shared output chunk this client sends from. NULL if not attached */
+        uint64_t           send_pos;          /**< Stream position of the next byte to send to this client */
+        bool               send_partial;      /**< The last send ended inside a line */
+        bool               send_resync;       /**< Attach at the stream end once the private send-buffer is sent */
+        uint64_t           send_stalled;      /**< `MSEC_TIME()` when the private send-buffer got data. 0 == empty */
         struct connection *next;              /**< next connection in this list for this service */
+        struct connection *prev;              /**< previous connection in this list for this service */
+        struct connection *hash_next;         /**< next connection in the same `connection_get()` hash-bucket */
       } connection;
 
+/**
+ * \enum send_policy
+ * What to do when a client's send-queue reaches `Modes.net_send_max`.
+ */
+typedef enum send_policy {
+        SEND_DROP_OLDEST = 0,   /**< drop the oldest whole lines in the send-queue (default) */
+        SEND_DROP_NEWEST,       /**< drop the newest whole lines in the send-queue */
+        SEND_DISCONNECT         /**< disconnect the slow client */
+      } send_policy;
+
 /**
  * A structure defining a passive or active network service.
  */
@@ -255,12 +277,14 @@ typedef struct statistics {
         uint64_t        messages_total;
         unrecognized_ME unrecognized_ME [MAX_ME_TYPE];
 
-        /* Aircraft statistics: \todo Move to 'aircraft_show_stats()'
+        /* Aircraft statistics: shown in `aircraft_show_stats()`
          */
         uint64_t        unique_aircrafts;
         uint64_t        unique_aircrafts_CSV;
         uint64_t        unique_aircrafts_SQL;
         uint64_t        unique_helicopters;
+        uint64_t        ICAO_filter_hits;      /**< Lookups answered "absent" by the known-ICAO filter */
+        uint64_t        ICAO_filter_misses;    /**< Lookups passed on to the CSV / SQL lookup */
 
         /* Network statistics:
          */
@@ -273,13 +297,38 @@ typedef struct statistics {
         uint64_t  bytes_sent     [MODES_NET_SERVICES_NUM];
         uint64_t  bytes_recv     [MODES_NET_SERVICES_NUM];
         uint64_t  unique_clients [MODES_NET_SERVICES_NUM];
+        uint64_t  cli_evicted    [MODES_NET_SERVICES_NUM];   /**< Slow clients disconnected */
+        uint64_t  send_dropped   [MODES_NET_SERVICES_NUM];   /**< Bytes dropped for slow clients */
+        uint64_t  send_queue_max [MODES_NET_SERVICES_NUM];   /**< The highest send-queue depth of any client */
+        uint64_t  udp_datagrams  [MODES_NET_SERVICES_NUM];   /**< UDP datagrams sent by a RAW / SBS output service */
+        uint64_t  udp_dropped    [MODES_NET_SERVICES_NUM];   /**< UDP datagrams that could not be sent */
+        uint64_t  udp_recv       [MODES_NET_SERVICES_NUM];   /**< UDP datagrams with a sequence number received by a RAW / SBS input service */
+        uint64_t  udp_lost       [MODES_NET_SERVICES_NUM];   /**< Gaps in those sequence numbers */
         uint64_t  HTTP_get_requests;
         uint64_t  HTTP_keep_alive_recv;
         uint64_t  HTTP_keep_alive_sent;
         uint64_t  HTTP_websockets;
+        uint64_t  HTTP_ws_updates;     /**< WebSocket aircraft updates sent */
+        uint64_t  HTTP_ws_bytes;       /**< Bytes in those */
         uint64_t  HTTP_400_responses;
+        uint64_t  HTTP_304_responses;
         uint64_t  HTTP_404_responses;
+        uint64_t  HTTP_gzip_replies;   /**< HTTP replies sent gzip compressed */
+        uint64_t  HTTP_gzip_saved;     /**< Bytes saved by that */
+        uint64_t  HTTP_cache_replies;  /**< Static files sent from the web-cache */
         uint64_t  HTTP_500_responses;
+        uint64_t  net_out_queued;      /**< Messages queued for the network thread */
+        uint64_t  net_out_dropped;     /**< Messages dropped since that queue was full */
+        uint64_t  net_in_queued;       /**< RAW / SBS input queued for the decoder */
+        uint64_t  net_in_deferred;     /**< RAW / SBS input kept back since that queue was full */
+        uint64_t  net_flushes;         /**< Batches of RAW / SBS output flushed to clients */
+        uint64_t  net_flush_bytes;     /**< Bytes in those batches */
+        uint64_t  net_writes;          /**< `WSASend()` calls for those batches */
+        uint64_t  upstream_dups;       /**< Duplicate messages from another `upstream` source dropped */
+        uint64_t  unique_evicted;      /**< Least recently seen client addresses forgotten */
+        uint64_t  deny_reloads;        /**< Number of times the deny-lists were reloaded */
+        uint64_t  rtltcp_blocks;       /**< Full sample blocks from a RTL_TCP server given to `rx_callback()` */
+        uint64_t  rx_overruns;         /**< Sample blocks overwritten before the decoder got them */
 
         /* Network statistics for receiving RAW and SBS messages:
          */
@@ -318,6 +367,8 @@ typedef struct rtltcp_conf {
         int           calibrate;         /**< Enable calibration for R820T/R828D type devices */
         int          *gains;             /**< Gain table reported from `rtlsdr_get_tuner_gains()` */
         int           gain_count;        /**< Number of gain values in above array */
+        uint8_t      *block;             /**< Reassembly buffer for a full sample block of `MODES_ASYNC_BUF_SIZE` bytes */
+        uint32_t      block_len;         /**< Number of bytes in `block` */
       } rtltcp_conf;
 
 /**
@@ -366,6 +417,7 @@ typedef struct global_data {
         SYSTEMTIME        start_SYSTEMTIME;         /**< The start-time on `SYSTEMTIME` form */
         uintptr_t         reader_thread;            /**< Device reader thread ID. */
         CRITICAL_SECTION  data_mutex;               /**< Mutex to synchronize buffer access. */
+        CONDITION_VARIABLE data_event;              /**< Signalled when data or network input is ready. */
         CRITICAL_SECTION  print_mutex;              /**< Mutex to synchronize printouts. */
         uint8_t          *data;                     /**< Raw IQ samples buffer. */
         uint32_t          data_len;                 /**< Length of raw IQ buffer. */
@@ -374,6 +426,7 @@ typedef struct global_data {
         int               infile_fd;                /**< File descriptor for `--infile` option. */
         volatile bool     exit;                     /**< Exit from the main loop when true. */
         volatile bool     data_ready;               /**< Data ready to be processed. */
+        volatile bool     net_input;                /**< RAW / SBS input queued by the network thread. */
         uint32_t         *ICAO_cache;               /**< Recently seen ICAO addresses. */
         statistics        stat;                     /**< Decoder, aircraft and network statistics. */
         struct aircraft  *aircrafts;                /**< Linked list of active aircrafts. */
@@ -407,6 +460,8 @@ typedef struct global_data {
         mg_connection *raw_in;                      /**< Raw input listening connection. */
         mg_connection *http_out;                    /**< HTTP listening connection. */
         mg_connection *rtl_tcp_in;                  /**< RTL_TCP active connection. */
+        uint8_t        net_source;                  /**< The `upstream` source id of the input now decoded. */
+        volatile LONG  ws_clients;                  /**< WebSocket clients of "/ws/aircraft". Set by the network thread. */
         mg_mgr         mgr;                         /**< Only one Mongoose connection manager. */
         char          *dns;                         /**< Use default Windows DNS server (not 8.8.8.8) */
 
@@ -438,19 +493,33 @@ typedef struct global_data {
         int          only_addr;                  /**< Print only ICAO addresses. */
         int          metric;                     /**< Use metric units. */
         int          prefer_adsb_lol;            /**< Prefer using ADSB-LOL API even with '-DUSE_GEN_ROUTES'. */
+        char        *adsb_lol_url;               /**< Value of key `adsb-lol-url = url`. A format with 2 `%s`. */
+        uint32_t     adsb_lol_requests;          /**< Value of key `adsb-lol-requests`; max concurrent API requests. */
+        uint32_t     adsb_lol_rate;              /**< Value of key `adsb-lol-rate`; max API requests per second. */
+        char        *adsb_lol_routeset_url;      /**< Value of key `adsb-lol-routeset-url = url`. */
+        uint32_t     adsb_lol_batch;             /**< Value of key `adsb-lol-batch`; max call-signs per routeset request. */
         bool         error_correct_1;            /**< Fix 1 bit errors (default: true). */
         bool         error_correct_2;            /**< Fix 2 bit errors (default: false). */
         int          keep_alive;                 /**< Send "Connection: keep-alive" if HTTP client sends it. */
+        uint32_t     net_send_max;               /**< Value of key `net-send-max`; max kBytes in a client's send-queue. 0 == no limit. */
+        send_policy  net_send_policy;            /**< Value of key `net-send-policy`. */
+        uint32_t     net_flush_interval;         /**< Value of key `net-flush-interval`; max msec to batch RAW / SBS output. 0 == no batching. */
+        uint32_t     net_flush_size;             /**< Value of key `net-flush-size`; flush a batch at this many bytes. */
+        uint32_t     net_udp_mtu;                /**< Value of key `net-udp-mtu`; max bytes in a UDP datagram for RAW / SBS output. */
         mg_file_path web_page;                   /**< The base-name of the web-page to server for HTTP clients. */
         mg_file_path web_root;                   /**< And it's directory. */
         bool         web_root_touch;             /**< Touch all files in `web_root` first. */
+        uint32_t     web_gzip_level;             /**< Value of key `web-gzip-level`; 1 - 9. 0 == no gzip compression. */
+        uint32_t     web_gzip_min;               /**< Value of key `web-gzip-min`; do not compress HTTP bodies smaller than this. */
+        uint32_t     web_cache_max;              /**< Value of key `web-cache-max`; MBytes of static files to keep in memory. 0 == no cache. */
+        uint32_t     net_unique_max;             /**< Value of key `net-unique-max`; max client addresses to remember. 0 == no limit. */
+        uint32_t     deny_reload;                /**< Value of key `deny-reload`; seconds between checks for modified deny-lists. 0 == never. */
         mg_file_path aircraft_db;                /**< The `aircraft-database.csv` file. */
         char        *aircraft_db_url;            /**< Value of key `aircrafts-update = url` */
         int          strip_level;                /**< For '--strip X' mode. */
         pos_t        home_pos;                   /**< Coordinates of home position. */
         cartesian_t  home_pos_cart;              /**< Coordinates of home position (cartesian). */
         bool         home_pos_ok;                /**< We have a good home position. */
-        const char  *wininet_last_error;         /**< Last error from WinInet API. */
         char        *tests;                      /**< Perform tests specified by pattern. */
         int          tui_interface;              /**< Selected `--tui` interface. */
         bool         update;                     /**< Option `--update' was used to update missing .csv-files */
@@ -466,6 +535,7 @@ typedef struct global_data {
          */
         mg_file_path    airport_db;              /**< The `airports-codes.csv` file generated by `tools/gen_airport_codes_csv.py`. */
         mg_file_path    airport_freq_db;         /**< The `airports-frequencies.csv` file. Not used yet. */
+        mg_file_path    routes_db;               /**< The `routes.bin` file generated by `tools/gen_routes_data.py`. */
         mg_file_path    airport_cache;           /**< The `%%TEMP%%\\dump1090\\airport-api-cache.csv`. */
         char           *airport_db_url;          /**< Value of key `airports-update = url`. Not effective yet. */
 
@@ -534,6 +604,7 @@ typedef struct modeS_message {
         int      error_bit;                  /**< Bit corrected. -1 if no bit corrected. */
         uint8_t  AA [3];                     /**< ICAO Address bytes 1, 2 and 3 (big-endian). */
         bool     phase_corrected;            /**< True if phase correction was applied. */
+        uint8_t  source;                     /**< The `upstream` source id. 0 if not from an upstream. */
 
         /** DF11
          */
@@ -601,6 +672,12 @@ typedef struct file_packed {
         const char          *name;
       } file_packed;
 
+/**
+ * \typedef walk_func
+ * The callback for `walk_dir()`.
+ */
+typedef void (*walk_func) (const char *file, void *arg);
+
 /*
  * Defined in MSVC's <sal.h>.
  */
@@ -659,10 +736,13 @@ uint32_t    random_range (uint32_t min, uint32_t max);
 int32_t     random_range2 (int32_t min, int32_t max);
 int         touch_file (const char *file);
 int         touch_dir (const char *dir, bool recurse);
+int         walk_dir (const char *dir, walk_func func, void *arg);
 FILE       *fopen_excl (const char *file, const char *mode);
 uint32_t    download_to_file (const char *url, const char *file);
 char       *download_to_buf  (const char *url);
+char       *download_post_to_buf (const char *url, const char *type, const char *body);
 int         download_status (void);
+const char *wininet_last_error (void);
 int         load_dynamic_table (struct dyn_struct *tab, int tab_size);
 int         unload_dynamic_table (struct dyn_struct *tab, int tab_size);
 bool        test_add (char **pattern, const char *what);
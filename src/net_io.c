@@ -3,6 +3,8 @@
  * \brief   Most network functions and handling of network services.
  */
 #include <stdint.h>
+#include <errno.h>
+#include <process.h>
 #include <winsock2.h>
 #include <iphlpapi.h>
 #include <windows.h>
@@ -11,6 +13,7 @@
 #include "aircraft.h"
 #include "net_io.h"
 #include "rtl-tcp.h"
+#include "zip.h"
 
 /**
  * Handlers for the network services.
@@ -52,29 +55,76 @@ DEF_FUNC (const char *, mg_spec,   (void));
 
 /**
  * For handling denial of clients in `client_handler (.., MG_EV_ACCEPT)` .
+ *
+ * The `deny4` and `deny6` ACLs are compiled into a binary trie for IPv4 and IPv6.
+ * Each node is a prefix with an optional verdict. Nodes exist only where prefixes
+ * branch, so a lookup is O(prefix length) no matter how many ACLs are loaded.
+ */
+typedef enum acl_verdict {
+        ACL_NONE = 0,
+        ACL_DENY,
+        ACL_ALLOW
+      } acl_verdict;
+
+typedef struct acl_node {
+        uint8_t          prefix [16];  /**< The prefix bits; IPv4 in the first 4 bytes */
+        uint8_t          bits;         /**< Number of bits in `prefix` */
+        acl_verdict      verdict;      /**< `ACL_NONE` for a branch-node only */
+        struct acl_node *child [2];    /**< The sub-tries for the next bit 0 and 1 */
+      } acl_node;
+
+typedef struct acl_tries {
+        acl_node *ip4;
+        acl_node *ip6;
+        size_t    num4;
+        size_t    num6;
+      } acl_tries;
+
+static acl_tries g_deny;
+
+/**
+ * The config-files with `deny4` / `deny6` keys and their modification time.
+ * For `deny_lists_reload()`.
  */
-typedef struct deny_element {
-        ip_address           acl;
-        bool                 is_ip6;
-        struct deny_element *next;
-      } deny_element;
+static struct {
+       mg_file_path name;
+       time_t       mtime;
+     } g_deny_files [10];
 
-static deny_element *g_deny_list = NULL;
+static int g_deny_files_num = 0;
 
 /**
  * For handling a list of unique network clients.
  * A list of address, service and time first seen.
  */
 typedef struct unique_IP {
-        mg_addr           addr;      /**< The IPv4/6 address */
-        intptr_t          service;   /**< unique in service */
-        FILETIME          seen;      /**< time when this address was created */
-        uint32_t          accepted;  /**< number of times for `accept()` */
-        uint32_t          denied;    /**< number of times denied */
-        struct unique_IP *next;
+        mg_addr           addr;       /**< The IPv4/6 address */
+        intptr_t          service;    /**< unique in service */
+        FILETIME          seen;       /**< time when this address was created */
+        uint32_t          accepted;   /**< number of times for `accept()` */
+        uint32_t          denied;     /**< number of times denied */
+        struct unique_IP *hash_next;  /**< next in the same hash-bucket */
+        struct unique_IP *next;       /**< next more recently seen */
+        struct unique_IP *prev;       /**< previous less recently seen */
       } unique_IP;
 
-static unique_IP *g_unique_ips = NULL;
+/**
+ * \def UNIQUE_IP_BUCKETS
+ * Number of hash-buckets for `g_unique_ips`. Must be a power of 2.
+ */
+#define UNIQUE_IP_BUCKETS  1024
+
+/**
+ * The unique clients are hashed on address and service.
+ * And kept in a list from least to most recently seen. When `Modes.net_unique_max`
+ * is reached, the least recently seen is dropped.
+ */
+static struct {
+       unique_IP *buckets [UNIQUE_IP_BUCKETS];
+       unique_IP *oldest;    /**< least recently seen */
+       unique_IP *newest;    /**< most recently seen */
+       uint32_t   num;
+     } g_unique_ips;
 
 /**
  * For handling timers in each network service.
@@ -87,6 +137,103 @@ typedef struct timeout_data {
 
 static timeout_data service_timers [MODES_NET_SERVICES_NUM];
 
+/**
+ * \def NET_QUEUE_SIZE
+ * Size of each of the 2 queues between the network thread and the decoder.
+ */
+#define NET_QUEUE_SIZE  (512 * 1024)
+
+/**
+ * \typedef net_thread_data
+ *
+ * Mongoose runs in it's own thread (`net_thread_fn()`) so a slow client or
+ * the poll-timeout never delays the decoder.
+ *
+ * Data to and from it goes in 2 lock-free single-producer / single-consumer
+ * `mg_queue`s. Each queued message starts with a 1 byte service-number:
+ *  \li `out_queue`: the decoder queues RAW / SBS output and RTL_TCP commands.
+ *                   The network thread sends them.
+ *  \li `in_queue`:  the network thread queues complete lines of RAW / SBS input.
+ *                   The decoder handles them in `net_poll()`.
+ */
+typedef struct net_thread_data {
+        uintptr_t      thread;          /**< The thread-handle from `_beginthreadex()` */
+        unsigned       thread_id;       /**< And it's thread-ID */
+        volatile bool  stop;            /**< Set by `net_thread_stop()` */
+        volatile LONG  wakeup_pending;  /**< A `mg_wakeup()` is pending for `out_queue` */
+        volatile LONG  out_pending;     /**< Bytes queued in `out_queue` since the last `net_drain_out()` */
+        volatile LONG  idle;            /**< The thread is in `mg_mgr_poll()` with no flush due */
+        unsigned long  wakeup_id;       /**< The connection-ID of the `mg_wakeup()` pipe */
+        mg_queue       out_queue;
+        mg_queue       in_queue;
+        char          *out_buf;         /**< The buffer for `out_queue` */
+        char          *in_buf;          /**< The buffer for `in_queue` */
+        mg_iobuf       in_msg;          /**< Input lines from `in_queue` for `decode_RAW_message()` / `decode_SBS_message()` */
+      } net_thread_data;
+
+static net_thread_data net_thread;
+
+/**
+ * \def NET_STAT_ADD
+ * Add to a 64-bit `Modes.stat` counter of the network I/O.
+ * Both the decoder and the network thread update these.
+ */
+#define NET_STAT_ADD(counter, val)  InterlockedExchangeAdd64 ((volatile LONG64*) &(counter), (LONG64) (val))
+
+/**
+ * \def NET_SEND_TOTAL_MAX
+ * Max bytes a service keeps for it's clients: the shared output kept for the
+ * slowest client plus the private Mongoose send-buffers of all clients.
+ * Above this, the client using the most is disconnected.
+ *
+ * \def NET_SEND_DRAIN_MAX
+ * Max msec a client may take to drain it's private Mongoose send-buffer.
+ * A client that stopped reading is disconnected after this.
+ */
+#define NET_SEND_TOTAL_MAX  (32 * 1024 * 1024)
+#define NET_SEND_DRAIN_MAX  30000
+
+/**
+ * \def NET_CHUNK_SIZE
+ * Size of a chunk of shared RAW / SBS output.
+ *
+ * \def NET_WSABUF_MAX
+ * Max number of chunks sent to a client in one `WSASend()`.
+ */
+#define NET_CHUNK_SIZE  (16 * 1024)
+#define NET_WSABUF_MAX  16
+
+/**
+ * \typedef net_chunk
+ *
+ * RAW / SBS output is serialized once into a list of chunks per service.
+ * Each client has a cursor into this list (`connection::send_chunk` and
+ * `connection::send_pos`) and a chunk is freed when no cursor is in it.
+ */
+typedef struct net_chunk {
+        uint64_t          start;                  /**< stream position of `data[0]` */
+        uint32_t          len;                    /**< bytes used in `data` */
+        uint32_t          refs;                   /**< number of clients sending from this chunk */
+        struct net_chunk *next;                   /**< the next (newer) chunk */
+        char              data [NET_CHUNK_SIZE];
+      } net_chunk;
+
+/**
+ * \typedef net_stream
+ *
+ * The shared output of a service.
+ */
+typedef struct net_stream {
+        net_chunk *head;        /**< the oldest chunk */
+        net_chunk *tail;        /**< the chunk new output is appended to */
+        uint64_t   pos;         /**< stream position after the last byte appended */
+        uint64_t   flushed;     /**< stream position at the last `net_stream_flush()` */
+        double     flush_last;  /**< time (in msec) of the last `net_stream_flush()` */
+        bool       backlog;     /**< a client could not take all of the last flush */
+      } net_stream;
+
+static net_stream net_streams [MODES_NET_SERVICES_NUM];
+
 static void        net_handler (mg_connection *c, int ev, void *ev_data);
 static void        net_timer_add (intptr_t service, int timeout_ms, int flag);
 static void        net_timer_del (intptr_t service);
@@ -100,6 +247,17 @@ static const char *net_service_descr (intptr_t service);
 static char       *net_service_error (intptr_t service);
 static char       *net_service_url (intptr_t service);
 static bool        client_handler (const mg_connection *c, intptr_t service, int ev);
+static void        net_stream_append (intptr_t service, const void *msg, size_t len);
+static void        net_stream_flush (intptr_t service);
+static void        net_stream_flush_all (void);
+static void        net_stream_flush_due (void);
+static void        net_stream_detach (connection *conn);
+static void        net_stream_free_all (void);
+static void        net_ws_push (void);
+static void        deny_lists_reload (void);
+static int         net_flush_timeout (bool *idle);
+static void        net_send_evict (connection *conn, const char *why);
+static void        net_queue_in (intptr_t service, uint8_t source, mg_iobuf *msg);
 const char        *mg_unpack (const char *path, size_t *size, time_t *mtime);
 
 /**
@@ -274,48 +432,1414 @@ static void net_connection_recv (connection *conn, net_msg_handler handler, bool
   if (!conn)
      return;
 
-  msg = &conn->c->recv;
-  if (msg->len == 0)
+  msg = &conn->c->recv;
+  if (msg->len == 0)
+  {
+    DEBUG (DEBUG_NET2, "No msg for %s.\n", is_server ? "server" : "client");
+    return;
+  }
+
+  /* Let the decoder handle RAW / SBS input in `net_poll()`
+   */
+  if (net_thread.thread && handler != rtl_tcp_decode)
+  {
+    net_queue_in (conn->service, 0, msg);
+    return;
+  }
+
+  for (loops = 0; msg->len > 0; loops++)
+     (*handler) (msg, loops);
+}
+
+/**
+ * Returns true if called from the network thread.
+ * Or if there is no network thread.
+ */
+static bool net_in_thread (void)
+{
+  return (!net_thread.thread || GetCurrentThreadId() == net_thread.thread_id);
+}
+
+/**
+ * Break the network thread out of `mg_mgr_poll()`.
+ * Only once until it has emptied `net_thread.out_queue`.
+ */
+static void net_wakeup (void)
+{
+  if (InterlockedExchange(&net_thread.wakeup_pending, 1) == 0)
+     mg_wakeup (&Modes.mgr, net_thread.wakeup_id, "", 0);
+}
+
+/**
+ * Called from the decoder to queue a message for the network thread.
+ * If the queue is full, the message is dropped.
+ *
+ * RAW / SBS output wakes the network thread only when a batch of
+ * `Modes.net_flush_size` bytes is queued. Otherwise it is sent
+ * when `mg_mgr_poll()` times out in `net_thread_fn()`.
+ */
+static bool net_queue_out (intptr_t service, const void *msg, size_t len)
+{
+  char *buf;
+
+  if (mg_queue_book(&net_thread.out_queue, &buf, len + 1) < len + 1)
+  {
+    NET_STAT_ADD (Modes.stat.net_out_dropped, 1);
+    return (false);
+  }
+  *buf = (char) service;
+  memcpy (buf + 1, msg, len);
+  mg_queue_add (&net_thread.out_queue, len + 1);
+  NET_STAT_ADD (Modes.stat.net_out_queued, 1);
+
+  if (InterlockedExchangeAdd(&net_thread.out_pending, (LONG)len) + len >= Modes.net_flush_size ||
+      service == MODES_NET_SERVICE_RTL_TCP || Modes.net_flush_interval == 0 || net_thread.idle)
+     net_wakeup();
+  return (true);
+}
+
+/**
+ * Called from the network thread to queue the complete lines in `msg` for the decoder.
+ * An incomplete line is kept in `msg` until the rest is received.
+ *
+ * Each entry starts with the `service` and the upstream `source` (0 if none).
+ *
+ * If the queue is full, the lines are kept in `msg` and retried after the
+ * next `mg_mgr_poll()`.
+ */
+static void net_queue_in (intptr_t service, uint8_t source, mg_iobuf *msg)
+{
+  const uint8_t *end = msg->buf + min (msg->len, NET_QUEUE_SIZE / 4);
+  char          *buf;
+  size_t         len;
+
+  while (end > msg->buf && end[-1] != '\n')
+     end--;
+
+  len = end - msg->buf;
+  if (len == 0)
+     return;
+
+  if (mg_queue_book(&net_thread.in_queue, &buf, len + 2) < len + 2)
+  {
+    NET_STAT_ADD (Modes.stat.net_in_deferred, 1);
+    return;
+  }
+  buf[0] = (char) service;
+  buf[1] = (char) source;
+  memcpy (buf + 2, msg->buf, len);
+  mg_queue_add (&net_thread.in_queue, len + 2);
+  mg_iobuf_del (msg, 0, len);
+  NET_STAT_ADD (Modes.stat.net_in_queued, 1);
+
+  /* Wake the decoder in `main_data_loop()`. Under `Modes.data_mutex`,
+   * so the wakeup is not lost if it tests `Modes.net_input` now.
+   */
+  EnterCriticalSection (&Modes.data_mutex);
+  Modes.net_input = true;
+  WakeConditionVariable (&Modes.data_event);
+  LeaveCriticalSection (&Modes.data_mutex);
+}
+
+/**
+ * \def NET_UPSTREAM_MAX
+ * Max number of `upstream = ..` sources.
+ *
+ * \def NET_UPSTREAM_BACKOFF_MIN
+ * \def NET_UPSTREAM_BACKOFF_MAX
+ * The reconnect delay (msec) for an upstream source is doubled for each
+ * failed connect; from `NET_UPSTREAM_BACKOFF_MIN` up to `NET_UPSTREAM_BACKOFF_MAX`.
+ */
+#define NET_UPSTREAM_MAX          16
+#define NET_UPSTREAM_BACKOFF_MIN  1000
+#define NET_UPSTREAM_BACKOFF_MAX  60000
+
+/**
+ * \typedef net_upstream
+ *
+ * A remote RAW source set by the config-key `upstream = raw,host:port`.
+ * Several of these are aggregated into the one aircraft table.
+ *
+ * Unlike the `--net-active` services, a source that fails or goes away is not
+ * fatal. It is reconnected after `backoff` msec. The parse-state is the
+ * incomplete line kept in `c->recv`.
+ *
+ * The decoder puts the `id` in `modeS_message::source`.
+ */
+typedef struct net_upstream {
+        uint8_t        id;              /**< 1 .. `NET_UPSTREAM_MAX` */
+        intptr_t       service;         /**< The parser; `MODES_NET_SERVICE_RAW_IN` or `MODES_NET_SERVICE_SBS_IN` */
+        char          *url;             /**< "tcp://host:port" */
+        mg_connection *c;               /**< The active connection. NULL while waiting to reconnect */
+        bool           connected;       /**< `MG_EV_CONNECT` was received */
+        uint32_t       backoff;         /**< msec to wait before the next connect */
+        uint64_t       connect_start;   /**< `MSEC_TIME()` of the last `mg_connect()` */
+        uint64_t       connect_next;    /**< `MSEC_TIME()` for the next `mg_connect()` */
+        uint64_t       connects;        /**< number of successful connects */
+        uint64_t       failures;        /**< number of failed connects or lost connections */
+        uint64_t       bytes;           /**< bytes received */
+        uint64_t       last_seen;       /**< `MSEC_TIME()` of the last data received */
+        uint64_t       messages;        /**< good messages; updated by the decoder in `net_upstream_count()` */
+      } net_upstream;
+
+static net_upstream net_upstreams [NET_UPSTREAM_MAX];
+static int          net_upstreams_num = 0;
+
+/**
+ * Add an upstream source from the config-key `upstream = raw,host:port`.
+ * The default port is 30002.
+ *
+ * An `upstream = sbs,host:port` is refused; `decode_SBS_message()` does not
+ * produce a `modeS_message`, so it's messages would never reach the aircraft table.
+ */
+bool net_upstream_add (const char *arg)
+{
+  net_upstream *u;
+  net_service   serv;
+  intptr_t      service  = MODES_NET_SERVICE_RAW_IN;
+  uint16_t      def_port = MODES_NET_PORT_RAW_OUT;
+
+  if (!strnicmp(arg, "sbs,", 4))
+  {
+    printf ("%s(%u): Ignoring 'upstream': '%s'. SBS input is not decoded into the aircraft table; use 'raw,host:port'.\n",
+            cfg_current_file(), cfg_current_line(), arg);
+    return (true);
+  }
+  if (strnicmp(arg, "raw,", 4))
+  {
+    printf ("%s(%u): Ignoring illegal 'upstream': '%s'. Use 'raw,host:port'.\n",
+            cfg_current_file(), cfg_current_line(), arg);
+    return (true);
+  }
+
+  if (net_upstreams_num >= NET_UPSTREAM_MAX)
+  {
+    printf ("%s(%u): Ignoring 'upstream': '%s'. Max %d sources.\n",
+            cfg_current_file(), cfg_current_line(), arg, NET_UPSTREAM_MAX);
+    return (true);
+  }
+
+  memset (&serv, '\0', sizeof(serv));
+  if (!net_set_host_port(arg + 4, &serv, def_port))
+  {
+    printf ("%s(%u): Ignoring illegal 'upstream': '%s'.\n", cfg_current_file(), cfg_current_line(), arg);
+    return (true);
+  }
+
+  if (serv.is_udp)
+  {
+    printf ("%s(%u): Ignoring 'upstream': '%s'. Only TCP is supported.\n", cfg_current_file(), cfg_current_line(), arg);
+    return (true);
+  }
+
+  u = net_upstreams + net_upstreams_num;
+  if (serv.is_ip6)
+       u->url = mg_mprintf ("tcp://[%s]:%u", serv.host, serv.port);
+  else u->url = mg_mprintf ("tcp://%s:%u", serv.host, serv.port);
+  if (!u->url)
+     return (false);
+
+  u->id      = (uint8_t) ++net_upstreams_num;
+  u->service = service;
+  u->backoff = NET_UPSTREAM_BACKOFF_MIN;
+  return (true);
+}
+
+/**
+ * Called from the decoder for a good message from upstream `source`.
+ */
+void net_upstream_count (uint8_t source)
+{
+  if (source >= 1 && source <= net_upstreams_num)
+     net_upstreams [source-1].messages++;
+}
+
+/**
+ * The event handler for all upstream sources.
+ */
+static void net_upstream_handler (mg_connection *c, int ev, void *ev_data)
+{
+  net_upstream *u = (net_upstream*) c->fn_data;
+  uint64_t      now = MSEC_TIME();
+  long          bytes;
+  int           loops;
+
+  if (Modes.exit || u->c != c)
+     return;
+
+  if (ev == MG_EV_CONNECT)
+  {
+    u->connected = true;
+    u->backoff   = NET_UPSTREAM_BACKOFF_MIN;
+    u->connects++;
+    LOG_FILEONLY ("Connected to upstream %u: %s.\n", u->id, u->url);
+  }
+  else if (ev == MG_EV_READ)
+  {
+    bytes = *(const long*) ev_data;
+    u->bytes     += bytes;
+    u->last_seen  = now;
+    NET_STAT_ADD (Modes.stat.bytes_recv [u->service], bytes);
+
+    if (net_thread.thread)
+       net_queue_in (u->service, u->id, &c->recv);
+    else
+    {
+      Modes.net_source = u->id;
+      for (loops = 0; c->recv.len > 0; loops++)
+         (u->service == MODES_NET_SERVICE_RAW_IN ? decode_RAW_message : decode_SBS_message) (&c->recv, loops);
+      Modes.net_source = 0;
+    }
+  }
+  else if (ev == MG_EV_ERROR)
+  {
+    LOG_FILEONLY ("Upstream %u: %s: %s.\n", u->id, u->url, (const char*)ev_data);
+  }
+  else if (ev == MG_EV_CLOSE)
+  {
+    if (!u->connected)
+         LOG_FILEONLY ("Failed to connect upstream %u: %s. Retry in %u sec.\n", u->id, u->url, u->backoff / 1000);
+    else LOG_FILEONLY ("Lost upstream %u: %s. Retry in %u sec.\n", u->id, u->url, u->backoff / 1000);
+
+    u->failures++;
+    u->c            = NULL;
+    u->connected    = false;
+    u->connect_next = now + u->backoff;
+    u->backoff      = min (2 * u->backoff, NET_UPSTREAM_BACKOFF_MAX);
+  }
+}
+
+/**
+ * Called from the network thread.
+ * Connect the upstream sources that are due. And time out a pending connect.
+ */
+static void net_upstream_poll (void)
+{
+  net_upstream *u;
+  uint64_t      now = MSEC_TIME();
+  int           i;
+
+  for (i = 0, u = net_upstreams; i < net_upstreams_num; i++, u++)
+  {
+    if (u->c)
+    {
+      if (!u->connected && now - u->connect_start >= MODES_CONNECT_TIMEOUT)
+         u->c->is_closing = 1;
+      continue;
+    }
+    if (now < u->connect_next)
+       continue;
+
+    DEBUG (DEBUG_NET, "Connecting to upstream %u: '%s'.\n", u->id, u->url);
+    u->connect_start = now;
+    u->c = mg_connect (&Modes.mgr, u->url, net_upstream_handler, u);
+    if (!u->c)
+    {
+      u->failures++;
+      u->connect_next = now + u->backoff;
+      u->backoff      = min (2 * u->backoff, NET_UPSTREAM_BACKOFF_MAX);
+    }
+  }
+}
+
+/**
+ * Show the statistics for each upstream source.
+ */
+static void net_upstream_show_stats (void)
+{
+  const net_upstream *u;
+  uint64_t            now = MSEC_TIME();
+  int                 i;
+
+  if (net_upstreams_num == 0)
+     return;
+
+  LOG_STDOUT ("  Upstream sources:\n");
+  for (i = 0, u = net_upstreams; i < net_upstreams_num; i++, u++)
+  {
+    LOG_STDOUT ("    %2u: %s %-30s %s\n", u->id, u->service == MODES_NET_SERVICE_RAW_IN ? "RAW" : "SBS",
+                u->url, u->connected ? "connected" : "not connected");
+    LOG_STDOUT ("        %8llu bytes, %llu messages, %llu connects, %llu failures",
+                u->bytes, u->messages, u->connects, u->failures);
+    if (u->last_seen)
+         LOG_STDOUT (", last data %.1f sec ago.\n", (double)(now - u->last_seen) / 1000.0);
+    else LOG_STDOUT (".\n");
+  }
+  LOG_STDOUT ("    %8llu duplicate messages dropped.\n", Modes.stat.upstream_dups);
+}
+
+/**
+ * Free the upstream sources. Mongoose closes the connections.
+ */
+static void net_upstream_free_all (void)
+{
+  int i;
+
+  for (i = 0; i < net_upstreams_num; i++)
+  {
+    FREE (net_upstreams [i].url);
+    net_upstreams [i].c = NULL;
+  }
+  net_upstreams_num = 0;
+}
+
+/**
+ * The UDP listeners for RAW / SBS input set by `host-raw-in = udp://..` or
+ * `host-sbs-in = udp://..`.
+ */
+static mg_connection *net_udp_in [MODES_NET_SERVICES_NUM];
+
+/**
+ * Retry the RAW / SBS input which did not fit in `net_thread.in_queue`.
+ */
+static void net_retry_in (void)
+{
+  static const intptr_t services[] = { MODES_NET_SERVICE_RAW_IN, MODES_NET_SERVICE_SBS_IN };
+  connection *conn;
+  int         i;
+
+  for (i = 0; i < DIM(services); i++)
+      for (conn = Modes.connections [services[i]]; conn; conn = conn->next)
+      {
+        if (conn->c->recv.len > 0)
+           net_queue_in (services[i], 0, &conn->c->recv);
+      }
+
+  for (i = 0; i < net_upstreams_num; i++)
+  {
+    net_upstream *u = net_upstreams + i;
+
+    if (u->c && u->c->recv.len > 0)
+       net_queue_in (u->service, u->id, &u->c->recv);
+  }
+
+  for (i = 0; i < DIM(services); i++)
+  {
+    mg_connection *c = net_udp_in [services[i]];
+
+    if (c && c->recv.len > 0)
+       net_queue_in (services[i], 0, &c->recv);
+  }
+}
+
+/**
+ * Send what the decoder has queued in `net_thread.out_queue`.
+ */
+static void net_drain_out (void)
+{
+  char  *buf;
+  size_t len;
+
+  InterlockedExchange (&net_thread.out_pending, 0);
+  while ((len = mg_queue_next(&net_thread.out_queue, &buf)) > 0)
+  {
+    intptr_t service = (uint8_t) *buf;
+
+    if (service == MODES_NET_SERVICE_RTL_TCP)
+    {
+      if (Modes.rtl_tcp_in)
+         mg_send (Modes.rtl_tcp_in, buf + 1, len - 1);
+    }
+    else
+      net_stream_append (service, buf + 1, len - 1);
+    mg_queue_del (&net_thread.out_queue, len);
+  }
+}
+
+/**
+ * The network thread.
+ *
+ * Polls Mongoose for network events and sends what the decoder has queued.
+ * A `mg_wakeup()` from `net_queue_out()` breaks out of `mg_mgr_poll()` at once
+ * when a batch is full. Otherwise the poll-timeout is the time until the next
+ * flush is due, so the output latency is bounded by `Modes.net_flush_interval`.
+ *
+ * With nothing to flush, it sleeps for `MODES_INTERACTIVE_REFRESH_TIME / 2`.
+ * Then `net_queue_out()` wakes it for the first new message.
+ */
+static unsigned int __stdcall net_thread_fn (void *arg)
+{
+  int  timeout;
+  bool idle;
+
+  while (!net_thread.stop)
+  {
+    timeout = net_flush_timeout (&idle);
+
+    /* Set `idle` before checking `out_pending`; `net_queue_out()` does it the other way
+     */
+    InterlockedExchange (&net_thread.idle, idle);
+    if (idle && net_thread.out_pending > 0)
+       timeout = 0;
+
+    mg_mgr_poll (&Modes.mgr, timeout);
+    InterlockedExchange (&net_thread.idle, 0);
+    InterlockedExchange (&net_thread.wakeup_pending, 0);
+    net_drain_out();
+    net_stream_flush_due();
+    net_ws_push();
+    net_retry_in();
+    net_upstream_poll();
+    deny_lists_reload();
+  }
+  MODES_NOTUSED (arg);
+  return (0);
+}
+
+/**
+ * Create the queues and start the network thread.
+ * If this fails, `net_poll()` polls Mongoose in the main thread as before.
+ */
+static bool net_thread_start (void)
+{
+  net_thread.out_buf = malloc (NET_QUEUE_SIZE);
+  net_thread.in_buf  = malloc (NET_QUEUE_SIZE);
+
+  if (!net_thread.out_buf || !net_thread.in_buf || !mg_wakeup_init(&Modes.mgr))
+  {
+    LOG_STDERR ("Failed to setup the network thread.\n");
+    FREE (net_thread.out_buf);
+    FREE (net_thread.in_buf);
+    return (false);
+  }
+
+  /* `mg_wakeup_init()` added the pipe-connection first in the list
+   */
+  net_thread.wakeup_id = Modes.mgr.conns->id;
+  mg_queue_init (&net_thread.out_queue, net_thread.out_buf, NET_QUEUE_SIZE);
+  mg_queue_init (&net_thread.in_queue, net_thread.in_buf, NET_QUEUE_SIZE);
+  mg_iobuf_init (&net_thread.in_msg, 0, 1024);
+
+  /* Start it suspended; `net_thread.thread` must be set before it runs
+   */
+  net_thread.thread = _beginthreadex (NULL, 0, net_thread_fn, NULL, CREATE_SUSPENDED, &net_thread.thread_id);
+  if (!net_thread.thread)
+  {
+    LOG_STDERR ("_beginthreadex() failed: %s.\n", strerror(errno));
+    return (false);
+  }
+  ResumeThread ((HANDLE)net_thread.thread);
+  return (true);
+}
+
+/**
+ * Stop the network thread.
+ * Called before showing the network statistics and from `net_exit()`.
+ */
+void net_thread_stop (void)
+{
+  if (!net_thread.thread)
+     return;
+
+  net_thread.stop = true;
+  mg_wakeup (&Modes.mgr, net_thread.wakeup_id, "", 0);
+  WaitForSingleObject ((HANDLE)net_thread.thread, INFINITE);
+  CloseHandle ((HANDLE)net_thread.thread);
+  net_thread.thread = 0;
+
+  /* Send what is left in the queue in this thread.
+   */
+  net_drain_out();
+  net_stream_flush_all();
+}
+
+/**
+ * Send a `msg` to all clients in the specified `service`.
+ *
+ * Called from the decoder. The message is queued for the network thread
+ * which appends it to the shared output in `net_stream_append()`.
+ *
+ * \note
+ *  \li This function is not used for sending HTTP data.
+ *  \li This function is not called when `--net-active` is used.
+ */
+void net_connection_send (intptr_t service, const void *msg, size_t len)
+{
+  if (net_in_thread())
+  {
+    net_stream_append (service, msg, len);
+    net_stream_flush_due();
+  }
+  else
+    net_queue_out (service, msg, len);
+}
+
+/**
+ * \def NET_UDP_MTU_MIN
+ * \def NET_UDP_MTU_MAX
+ * The range of `Modes.net_udp_mtu`.
+ */
+#define NET_UDP_MTU_MIN  256
+#define NET_UDP_MTU_MAX  65000
+
+#ifndef SIO_UDP_CONNRESET
+#define SIO_UDP_CONNRESET  _WSAIOW (IOC_VENDOR, 12)
+#endif
+
+/**
+ * \typedef net_udp_out
+ *
+ * RAW / SBS output sent as UDP datagrams to a unicast or multicast address.
+ * Set by the config-keys `net-udp-raw-out` and `net-udp-sbs-out`.
+ *
+ * Whole lines are packed into datagrams of max `Modes.net_udp_mtu` bytes.
+ * Each datagram starts with a `"#<seq>\n"` line so a receiver can detect
+ * lost datagrams in `net_udp_seq()`. The cost is one `send()` per datagram
+ * no matter how many receivers there are.
+ */
+typedef struct net_udp_out {
+        char          *url;           /**< "udp://host:port" */
+        mg_connection *c;             /**< the connected UDP socket */
+        uint32_t       seq;           /**< sequence number of the datagram in `buf` */
+        char          *buf;           /**< the datagram being packed */
+        size_t         len;           /**< bytes used in `buf` */
+        size_t         hdr_len;       /**< length of the `"#<seq>\n"` line in `buf` */
+        double         first;         /**< time (in msec) the first line was put in `buf` */
+        double         connect_last;  /**< time (in msec) of the last `mg_connect()` */
+        bool           reset_off;     /**< `SIO_UDP_CONNRESET` was turned off */
+      } net_udp_out;
+
+static net_udp_out net_udp [MODES_NET_SERVICES_NUM];
+
+/**
+ * The event handler for a UDP output socket.
+ */
+static void net_udp_handler (mg_connection *c, int ev, void *ev_data)
+{
+  intptr_t     service = (intptr_t) c->fn_data;
+  net_udp_out *u = net_udp + service;
+
+  if (ev == MG_EV_ERROR)
+     net_store_error (service, ev_data);
+  else if (ev == MG_EV_READ)
+     c->recv.len = 0;       /* Nothing is expected from the receivers */
+  else if (ev == MG_EV_CLOSE && u->c == c)
+     u->c = NULL;
+}
+
+/**
+ * Set the `"udp://host:port"` for the UDP output of a RAW / SBS output service.
+ * For the config-keys `net-udp-raw-out` and `net-udp-sbs-out`.
+ */
+bool net_udp_set_output (intptr_t service, const char *host_port)
+{
+  net_service serv;
+
+  ASSERT_SERVICE (service);
+  memset (&serv, '\0', sizeof(serv));
+  if (!net_set_host_port(host_port, &serv, modeS_net_services [service].port))
+     return (false);
+
+  free (net_udp [service].url);
+  net_udp [service].url = mg_mprintf ("udp://%s:%u", serv.host, serv.port);
+  return (net_udp [service].url != NULL);
+}
+
+/**
+ * Return true if a RAW / SBS output service has a UDP output.
+ */
+bool net_udp_output (intptr_t service)
+{
+  ASSERT_SERVICE (service);
+  return (net_udp [service].url != NULL);
+}
+
+/**
+ * Setup the UDP output for a service if `net_udp_set_output()` was called.
+ */
+static bool net_udp_init (intptr_t service)
+{
+  net_udp_out *u = net_udp + service;
+
+  if (!u->url)
+     return (true);
+
+  Modes.net_udp_mtu = max (Modes.net_udp_mtu, NET_UDP_MTU_MIN);
+  Modes.net_udp_mtu = min (Modes.net_udp_mtu, NET_UDP_MTU_MAX);
+
+  u->connect_last = get_usec_now() / 1000.0;
+  u->buf = malloc (Modes.net_udp_mtu);
+  u->c   = mg_connect (&Modes.mgr, u->url, net_udp_handler, (void*)service);
+  if (!u->buf || !u->c)
+  {
+    LOG_STDERR ("Failed to setup the UDP output to %s.\n", u->url);
+    return (false);
+  }
+  LOG_FILEONLY ("Sending %s as UDP to %s (MTU: %u).\n", net_service_descr(service), u->url, Modes.net_udp_mtu);
+  return (true);
+}
+
+/**
+ * The event handler for a RAW / SBS input UDP listener.
+ * Each datagram has whole lines. The first is the `#<seq>` line added by `net_udp_append()`.
+ */
+static void net_udp_in_handler (mg_connection *c, int ev, void *ev_data)
+{
+  intptr_t service = (intptr_t) c->fn_data;
+  int      loops;
+
+  if (Modes.exit || ev != MG_EV_READ)
+     return;
+
+  NET_STAT_ADD (Modes.stat.bytes_recv [service], *(const long*) ev_data);
+
+  if (net_thread.thread)
+     net_queue_in (service, 0, &c->recv);
+  else
+  {
+    for (loops = 0; c->recv.len > 0; loops++)
+       (service == MODES_NET_SERVICE_RAW_IN ? decode_RAW_message : decode_SBS_message) (&c->recv, loops);
+  }
+}
+
+/**
+ * Bind a UDP listener for RAW / SBS input on the port in `host-raw-in = udp://host:port`
+ * or `host-sbs-in = udp://host:port`. This works both with and without `--net-active`.
+ *
+ * If `host` is a multicast group (224.0.0.0/4), join it on the default interface.
+ * Otherwise `host` is ignored and datagrams sent to any local address are received.
+ */
+static bool net_udp_listen (intptr_t service, mg_connection **c)
+{
+  net_service *serv = modeS_net_services + service;
+  mg_addr      group;
+
+  if (serv->is_ip6)
+  {
+    LOG_STDERR ("UDP input for \"%s\" supports only IPv4.\n", net_service_descr(service));
+    return (false);
+  }
+
+  strcpy (serv->protocol, "udp");
+  strcpy (serv->descr, service == MODES_NET_SERVICE_RAW_IN ? "Raw UDP input" : "SBS UDP input");
+  serv->url = mg_mprintf ("udp://0.0.0.0:%u", serv->port);
+
+  *c = mg_listen (&Modes.mgr, serv->url, net_udp_in_handler, (void*)service);
+  if (!*c)
+  {
+    LOG_STDERR ("Listen socket for \"%s\" failed.\n", net_service_descr(service));
+    return (false);
+  }
+  net_udp_in [service] = *c;
+
+  memset (&group, '\0', sizeof(group));
+  if (mg_aton(mg_str(serv->host), &group) && (group.ip[0] & 0xF0) == 0xE0)
+  {
+    struct ip_mreq mreq;
+
+    memset (&mreq, '\0', sizeof(mreq));
+    memcpy (&mreq.imr_multiaddr, &group.ip, 4);
+    mreq.imr_interface.s_addr = htonl (INADDR_ANY);
+    if (setsockopt ((SOCKET)(size_t)(*c)->fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, (const char*)&mreq, sizeof(mreq)))
+    {
+      LOG_STDERR ("Failed to join the multicast group %s; %s.\n", serv->host, win_strerror(WSAGetLastError()));
+      return (false);
+    }
+  }
+  LOG_FILEONLY ("Receiving %s on %s (group: %s).\n", net_service_descr(service), serv->url,
+                (group.ip[0] & 0xF0) == 0xE0 ? serv->host : "none");
+  return (true);
+}
+
+/**
+ * Send the packed datagram of a service.
+ *
+ * The sequence number is incremented even if the datagram could not be sent.
+ * Then a receiver sees the loss.
+ */
+static void net_udp_send (intptr_t service)
+{
+  net_udp_out *u = net_udp + service;
+  double       now = get_usec_now() / 1000.0;
+  SOCKET       sock;
+
+  if (u->len <= u->hdr_len)
+     return;
+
+  /* Reconnect once per second if Mongoose closed it
+   */
+  if (!u->c && now - u->connect_last >= 1000.0)
+  {
+    u->connect_last = now;
+    u->reset_off    = false;
+    u->c = mg_connect (&Modes.mgr, u->url, net_udp_handler, (void*)service);
+  }
+
+  if (!u->c || u->c->is_resolving || u->c->is_closing || !u->c->fd)
+     Modes.stat.udp_dropped [service]++;
+  else
+  {
+    sock = (SOCKET) (size_t) u->c->fd;
+
+    /* Do not let an ICMP "port unreachable" from a unicast receiver
+     * make the next `recv()` fail and Mongoose close the socket.
+     */
+    if (!u->reset_off)
+    {
+      BOOL  on = FALSE;
+      DWORD ret;
+
+      WSAIoctl (sock, SIO_UDP_CONNRESET, &on, sizeof(on), NULL, 0, &ret, NULL, NULL);
+      u->reset_off = true;
+    }
+
+    if (send(sock, u->buf, (int)u->len, 0) == (int)u->len)
+    {
+      Modes.stat.udp_datagrams [service]++;
+      NET_STAT_ADD (Modes.stat.bytes_sent [service], u->len);
+    }
+    else
+      Modes.stat.udp_dropped [service]++;
+  }
+  u->seq++;
+  u->len = 0;
+}
+
+/**
+ * Pack a RAW / SBS line into the datagram of a service.
+ * Send the datagram first if the line would make it larger than `Modes.net_udp_mtu`.
+ */
+static void net_udp_append (intptr_t service, const void *msg, size_t len)
+{
+  net_udp_out *u = net_udp + service;
+
+  if (!u->buf)
+     return;
+
+  if (u->len + len > Modes.net_udp_mtu)
+     net_udp_send (service);
+
+  if (u->len == 0)
+  {
+    u->hdr_len = u->len = mg_snprintf (u->buf, Modes.net_udp_mtu, "#%lu\n", (unsigned long)u->seq);
+    u->first   = get_usec_now() / 1000.0;
+  }
+
+  if (u->len + len > Modes.net_udp_mtu)
+  {
+    Modes.stat.udp_dropped [service]++;
+    return;
+  }
+  memcpy (u->buf + u->len, msg, len);
+  u->len += len;
+}
+
+/**
+ * Called from the decoder for a line starting with '#' from a RAW / SBS input service.
+ * If it is a `"#<seq>"` line from `net_udp_send()`, count the datagrams lost since the last one.
+ *
+ * Returns false if it is not such a line.
+ */
+bool net_udp_seq (intptr_t service, const char *line)
+{
+  static uint32_t last_seq [MODES_NET_SERVICES_NUM];
+  char           *end;
+  uint32_t        seq, lost;
+
+  ASSERT_SERVICE (service);
+  if (*line != '#')
+     return (false);
+
+  seq = strtoul (line + 1, &end, 10);
+  if (end == line + 1 || *end != '\0')
+     return (false);
+
+  lost = seq - last_seq [service] - 1;
+  if (Modes.stat.udp_recv [service] > 0 && lost > 0 && lost < 0x10000)  /* else the sender restarted */
+     Modes.stat.udp_lost [service] += lost;
+
+  last_seq [service] = seq;
+  Modes.stat.udp_recv [service]++;
+  return (true);
+}
+
+/**
+ * Free the UDP outputs. Mongoose closes the sockets.
+ */
+static void net_udp_free_all (void)
+{
+  intptr_t service;
+
+  for (service = MODES_NET_SERVICE_FIRST; service <= MODES_NET_SERVICE_LAST; service++)
+  {
+    FREE (net_udp [service].url);
+    FREE (net_udp [service].buf);
+    net_udp [service].c = NULL;
+    net_udp_in [service] = NULL;
+  }
+}
+
+/**
+ * Allocate a new tail-chunk for the stream `s`.
+ */
+static net_chunk *net_stream_new_chunk (net_stream *s)
+{
+  net_chunk *chunk = malloc (sizeof(*chunk));
+
+  if (!chunk)
+     return (NULL);
+
+  chunk->start = s->pos;
+  chunk->len   = 0;
+  chunk->refs  = 0;
+  chunk->next  = NULL;
+  if (s->tail)
+       s->tail->next = chunk;
+  else s->head = chunk;
+  s->tail = chunk;
+  return (chunk);
+}
+
+/**
+ * Append a `msg` to the shared output of a RAW / SBS `service`.
+ *
+ * The message is copied once; not once per client. The clients send it
+ * from the chunk in `net_stream_flush()`.
+ */
+static void net_stream_append (intptr_t service, const void *msg, size_t len)
+{
+  net_stream *s = net_streams + service;
+
+  if (len == 0 || len > NET_CHUNK_SIZE)
+     return;
+
+  net_udp_append (service, msg, len);
+  if (!Modes.connections [service])
+     return;
+
+  if ((!s->tail || s->tail->len + len > NET_CHUNK_SIZE) && !net_stream_new_chunk(s))
+  {
+    Modes.stat.send_dropped [service] += len;
+    return;
+  }
+  memcpy (s->tail->data + s->tail->len, msg, len);
+  s->tail->len += (uint32_t) len;
+  s->pos       += len;
+}
+
+/**
+ * Start sending the stream to a client from the current end of it.
+ */
+static void net_stream_attach (net_stream *s, connection *conn)
+{
+  if (!s->tail && !net_stream_new_chunk(s))
+     return;
+
+  conn->send_chunk   = s->tail;
+  conn->send_pos     = s->pos;
+  conn->send_partial = false;
+  s->tail->refs++;
+}
+
+/**
+ * Stop sending the stream to a client.
+ * The chunks it held gets freed in `net_stream_trim()`.
+ */
+static void net_stream_detach (connection *conn)
+{
+  if (conn->send_chunk)
+     conn->send_chunk->refs--;
+  conn->send_chunk = NULL;
+}
+
+/**
+ * Move the cursor of a client forward to `pos`.
+ */
+static void net_stream_seek (connection *conn, uint64_t pos)
+{
+  net_chunk *chunk = conn->send_chunk;
+
+  while (pos >= chunk->start + chunk->len && chunk->next)
+  {
+    chunk->refs--;
+    chunk = chunk->next;
+    chunk->refs++;
+  }
+  conn->send_chunk = chunk;
+  conn->send_pos   = pos;
+}
+
+/**
+ * Return the stream position after the first '\n' at or after `pos`.
+ * Or the end of the stream if there is none.
+ */
+static uint64_t net_stream_line_end (const net_stream *s, const net_chunk *chunk, uint64_t pos)
+{
+  while (chunk && pos < s->pos)
+  {
+    const char *nl;
+    size_t      ofs;
+
+    if (pos < chunk->start + chunk->len)
+    {
+      ofs = (size_t) (pos - chunk->start);
+      nl  = memchr (chunk->data + ofs, '\n', chunk->len - ofs);
+      if (nl)
+         return (chunk->start + (nl - chunk->data) + 1);
+      pos = chunk->start + chunk->len;
+    }
+    chunk = chunk->next;
+  }
+  return (s->pos);
+}
+
+/**
+ * Copy the stream from the cursor of a client up to `end` into it's
+ * private Mongoose send-buffer. The cursor is not moved.
+ */
+static void net_stream_copy (connection *conn, uint64_t end)
+{
+  const net_chunk *chunk = conn->send_chunk;
+  uint64_t         pos = conn->send_pos;
+
+  while (chunk && pos < end)
+  {
+    size_t ofs = (size_t) (pos - chunk->start);
+    size_t len = (size_t) min (chunk->len - ofs, end - pos);
+
+    mg_send (conn->c, chunk->data + ofs, len);
+    pos  += len;
+    chunk = chunk->next;
+  }
+}
+
+/**
+ * Called when the send-queue of `conn` is above `limit` bytes.
+ * Apply the `Modes.net_send_policy`.
+ *
+ * The first line in the queue could be partially sent already. So both
+ * drop-policies copy the rest of that line to the client's private Mongoose
+ * send-buffer and drop whole lines only.
+ */
+static void net_stream_backpressure (net_stream *s, connection *conn, size_t limit)
+{
+  uint64_t keep_end, skip_to, end;
+
+  if (Modes.net_send_policy == SEND_DISCONNECT)
+  {
+    net_send_evict (conn, "policy");
+    return;
+  }
+
+  if (Modes.net_send_policy == SEND_DROP_NEWEST)
+  {
+    /* Keep the oldest lines that fits in `limit`. Drop the rest and
+     * continue from the end of the stream when they are sent.
+     */
+    end = conn->send_pos + max (limit, 1);
+    keep_end = net_stream_line_end (s, conn->send_chunk, end - 1);
+    net_stream_copy (conn, keep_end);
+    net_stream_detach (conn);
+    conn->send_pos    = keep_end;
+    conn->send_resync = true;
+    return;
+  }
+
+  /* SEND_DROP_OLDEST: finish the partial line, then skip to the first
+   * whole line that keeps the queue below `limit`.
+   */
+  keep_end = conn->send_pos;
+  if (conn->send_partial)
+  {
+    keep_end = net_stream_line_end (s, conn->send_chunk, conn->send_pos);
+    net_stream_copy (conn, keep_end);
+  }
+
+  end = s->pos - limit;
+  skip_to = (end > keep_end) ? net_stream_line_end (s, conn->send_chunk, end - 1) : keep_end;
+
+  conn->send_dropped += skip_to - keep_end;
+  Modes.stat.send_dropped [conn->service] += skip_to - keep_end;
+  conn->send_partial = false;
+  net_stream_seek (conn, skip_to);
+}
+
+/**
+ * Send as much of the stream as the socket of a client will take
+ * in one vectored `WSASend()` from the shared chunks.
+ */
+static void net_stream_send (const net_stream *s, connection *conn)
+{
+  WSABUF     bufs [NET_WSABUF_MAX];
+  DWORD      num = 0, sent = 0, i, left;
+  net_chunk *chunk = conn->send_chunk;
+  uint64_t   pos = conn->send_pos;
+
+  while (chunk && pos < s->pos && num < NET_WSABUF_MAX)
+  {
+    size_t ofs = (size_t) (pos - chunk->start);
+
+    if (ofs < chunk->len)
+    {
+      bufs [num].buf = chunk->data + ofs;
+      bufs [num].len = (ULONG) (chunk->len - ofs);
+      num++;
+    }
+    pos   = chunk->start + chunk->len;
+    chunk = chunk->next;
+  }
+
+  if (num == 0)
+     return;
+
+  NET_STAT_ADD (Modes.stat.net_writes, 1);
+  if (WSASend((SOCKET)(size_t)conn->c->fd, bufs, num, &sent, 0, NULL, NULL) == SOCKET_ERROR)
+  {
+    int err = WSAGetLastError();
+
+    if (err != WSAEWOULDBLOCK)
+    {
+      DEBUG (DEBUG_NET, "WSASend() to %s failed: %d.\n", conn->rem_buf, err);
+      conn->c->is_closing = 1;    /* the client gets freed in net_handler() */
+    }
+    return;
+  }
+
+  if (sent == 0)
+     return;
+
+  /* Did the last byte sent end a line?
+   */
+  for (i = 0, left = sent; i < num && left > bufs[i].len; i++)
+      left -= bufs[i].len;
+  conn->send_partial = (bufs[i].buf [left-1] != '\n');
+
+  /* Mongoose did not send this; so it does not raise `MG_EV_WRITE`
+   */
+  NET_STAT_ADD (Modes.stat.bytes_sent [conn->service], sent);
+  net_stream_seek (conn, conn->send_pos + sent);
+}
+
+/**
+ * Free the oldest chunks no client is sending from.
+ */
+static void net_stream_trim (net_stream *s)
+{
+  while (s->head && s->head->refs == 0 && (s->head != s->tail || !Modes.connections[s - net_streams]))
+  {
+    net_chunk *next = s->head->next;
+
+    free (s->head);
+    s->head = next;
+  }
+  if (!s->head)
+     s->tail = NULL;
+}
+
+/**
+ * Send the shared output of a RAW / SBS `service` to all it's clients.
+ *
+ * Each client sends from it's own position in the stream. A client with
+ * data in it's private Mongoose send-buffer (after `net_stream_backpressure()`)
+ * waits until Mongoose has sent that.
+ */
+static void net_stream_flush (intptr_t service)
+{
+  net_stream *s = net_streams + service;
+  connection *conn, *slowest = NULL, *largest = NULL;
+  size_t      limit = 1024 * (size_t) Modes.net_send_max;
+  uint64_t    depth, now = MSEC_TIME(), total = 0;
+  int         found = 0;
+
+  if (s->pos > s->flushed)
+  {
+    NET_STAT_ADD (Modes.stat.net_flushes, 1);
+    NET_STAT_ADD (Modes.stat.net_flush_bytes, s->pos - s->flushed);
+  }
+  s->flushed    = s->pos;
+  s->flush_last = get_usec_now() / 1000.0;
+
+  for (conn = Modes.connections [service]; conn; conn = conn->next)
+  {
+    if (conn->c->is_closing || conn->c->is_connecting)
+       continue;
+
+    /* Wait until Mongoose has sent the private send-buffer.
+     * But it counts in the total and must drain in time.
+     */
+    if (conn->c->send.len > 0)
+    {
+      if (conn->send_stalled == 0)
+         conn->send_stalled = now;
+      else if (now - conn->send_stalled > NET_SEND_DRAIN_MAX)
+      {
+        net_send_evict (conn, "stalled");
+        continue;
+      }
+      total += conn->c->send.len;
+      if (!largest || conn->c->send.len > largest->c->send.len)
+         largest = conn;
+      if (conn->send_chunk && (!slowest || conn->send_pos < slowest->send_pos))
+         slowest = conn;
+      continue;
+    }
+    conn->send_stalled = 0;
+
+    if (!conn->send_chunk)
+    {
+      if (conn->send_resync)
+      {
+        conn->send_dropped += s->pos - conn->send_pos;
+        Modes.stat.send_dropped [service] += s->pos - conn->send_pos;
+        conn->send_resync = false;
+      }
+      net_stream_attach (s, conn);
+      continue;
+    }
+
+    depth = s->pos - conn->send_pos;
+    conn->send_max = max (conn->send_max, (size_t)depth);
+    Modes.stat.send_queue_max [service] = max (Modes.stat.send_queue_max[service], conn->send_max);
+
+    if (limit > 0 && depth > limit)
+    {
+      net_stream_backpressure (s, conn, limit);
+      if (conn->c->is_closing || !conn->send_chunk || conn->c->send.len > 0)
+         continue;
+    }
+
+    net_stream_send (s, conn);
+    found++;
+
+    if (!slowest || conn->send_pos < slowest->send_pos)
+       slowest = conn;
+  }
+
+  /* Keep the total memory bounded no matter how many clients stall
+   */
+  if (slowest)
+     total += s->pos - slowest->send_pos;
+  if (total > NET_SEND_TOTAL_MAX)
+  {
+    if (slowest && (!largest || s->pos - slowest->send_pos >= largest->c->send.len))
+         net_send_evict (slowest, "total");
+    else net_send_evict (largest, "total");
+  }
+
+  /* Keep flushing on the interval until every client has all of it
+   */
+  s->backlog = false;
+  for (conn = Modes.connections [service]; conn; conn = conn->next)
+  {
+    if (conn->send_chunk && conn->send_pos < s->pos && !conn->c->is_closing)
+    {
+      s->backlog = true;
+      break;
+    }
+  }
+
+  net_stream_trim (s);
+
+  if (found > 0)
+     DEBUG (DEBUG_NET2, "Flushed %llu bytes to %d clients in service \"%s\".\n",
+            s->pos, found, net_service_descr(service));
+}
+
+/**
+ * Flush the shared output of all RAW / SBS services.
+ */
+static void net_stream_flush_all (void)
+{
+  intptr_t service;
+
+  for (service = MODES_NET_SERVICE_FIRST; service <= MODES_NET_SERVICE_LAST; service++)
+  {
+    if (net_streams[service].head)
+       net_stream_flush (service);
+    net_udp_send (service);
+  }
+}
+
+/**
+ * Return the msec until the next RAW / SBS output flush is due.
+ * Or `MODES_INTERACTIVE_REFRESH_TIME / 2` if nothing is waiting to be sent.
+ */
+static int net_flush_timeout (bool *idle)
+{
+  double   now      = get_usec_now() / 1000.0;
+  double   interval = (double) max (Modes.net_flush_interval, 1);
+  double   due      = now + MODES_INTERACTIVE_REFRESH_TIME / 2;
+  intptr_t service;
+
+  *idle = true;
+  for (service = MODES_NET_SERVICE_FIRST; service <= MODES_NET_SERVICE_LAST; service++)
+  {
+    const net_stream *s = net_streams + service;
+
+    if (net_udp[service].len > 0)
+    {
+      due   = min (due, net_udp[service].first + interval);
+      *idle = false;
+    }
+    if (s->head && (s->pos > s->flushed || s->backlog))
+    {
+      due   = min (due, s->flush_last + interval);
+      *idle = false;
+    }
+  }
+  return (due <= now ? 0 : (int) (due - now + 0.999));
+}
+
+/**
+ * Flush the shared output of the RAW / SBS services which has a full batch
+ * or has not been flushed for `Modes.net_flush_interval` msec.
+ *
+ * A flush also retries the clients which could not take all
+ * of the previous batch.
+ */
+static void net_stream_flush_due (void)
+{
+  intptr_t service;
+  double   now = get_usec_now() / 1000.0;
+
+  for (service = MODES_NET_SERVICE_FIRST; service <= MODES_NET_SERVICE_LAST; service++)
   {
-    DEBUG (DEBUG_NET2, "No msg for %s.\n", is_server ? "server" : "client");
-    return;
-  }
+    const net_stream *s = net_streams + service;
 
-  for (loops = 0; msg->len > 0; loops++)
-     (*handler) (msg, loops);
+    if (net_udp[service].len > 0 && now - net_udp[service].first >= (double)Modes.net_flush_interval)
+       net_udp_send (service);
+
+    if (!s->head)
+       continue;
+
+    if (s->pos - s->flushed >= Modes.net_flush_size ||
+        now - s->flush_last >= (double)Modes.net_flush_interval)
+       net_stream_flush (service);
+  }
 }
 
 /**
- * Iterate over all the listening connections and send a `msg` to
- * all clients in the specified `service`.
- *
- * There can only be 1 service that matches this. But this
- * service can have many clients.
+ * Push the aircraft updates to the WebSocket clients of "/ws/aircraft".
  *
- * \note
- *  \li This function is not used for sending HTTP data.
- *  \li This function is not called when `--net-active` is used.
+ * Most clients have seen the same update, so a message is made once
+ * and sent to all of those. A client with more than `Modes.net_send_max`
+ * kBytes unsent, gets nothing until it has caught up. Then it gets
+ * a new snapshot.
  */
-void net_connection_send (intptr_t service, const void *msg, size_t len)
+static void net_ws_push (void)
 {
   connection *conn;
-  int         found = 0;
+  char       *msg = NULL;
+  size_t      msg_len = 0;
+  uint32_t    msg_from = 0, msg_seq = 0;
+  size_t      limit = 1024 * (size_t) Modes.net_send_max;
 
-  for (conn = Modes.connections [service]; conn; conn = conn->next)
+  for (conn = Modes.connections [MODES_NET_SERVICE_HTTP]; conn; conn = conn->next)
   {
-    if (conn->service != service)
+    uint32_t seq = conn->ws_seq;
+
+    if (!conn->ws_aircraft || !conn->c->is_websocket || conn->c->is_closing)
        continue;
 
-    mg_send (conn->c, msg, len);   /* if write fails, the client gets freed in net_handler() */
-    found++;
+    if (limit > 0 && conn->c->send.len > limit)
+       continue;
+
+    if (!msg || seq != msg_from)
+    {
+      free (msg);
+      msg_from = seq;
+      msg = aircraft_json_ws (&seq);
+      msg_seq = seq;
+      msg_len = msg ? strlen (msg) : 0;
+      if (!msg)
+         continue;
+    }
+    mg_ws_send (conn->c, msg, msg_len, WEBSOCKET_OP_TEXT);
+    conn->ws_seq = msg_seq;
+    Modes.stat.HTTP_ws_updates++;
+    Modes.stat.HTTP_ws_bytes += msg_len;
   }
-  if (found > 0)
-     DEBUG (DEBUG_NET2, "Sent %zd bytes to %d clients in service \"%s\".\n",
-            len, found, net_service_descr(service));
+  free (msg);
+}
+
+/**
+ * Free the shared output of all services.
+ */
+static void net_stream_free_all (void)
+{
+  intptr_t service;
+
+  for (service = MODES_NET_SERVICE_FIRST; service <= MODES_NET_SERVICE_LAST; service++)
+  {
+    net_stream *s = net_streams + service;
+
+    while (s->head)
+    {
+      net_chunk *next = s->head->next;
+
+      free (s->head);
+      s->head = next;
+    }
+    s->tail = NULL;
+  }
+}
+
+/**
+ * Disconnect a slow client.
+ */
+static void net_send_evict (connection *conn, const char *why)
+{
+  uint64_t depth = conn->c->send.len;
+
+  if (conn->send_chunk)
+     depth += net_streams [conn->service].pos - conn->send_pos;
+
+  conn->c->is_closing = 1;
+  Modes.stat.cli_evicted [conn->service]++;
+  LOG_FILEONLY ("Evicted slow client %s from \"%s\" (%s, %llu bytes queued).\n",
+                conn->rem_buf, net_service_descr(conn->service), why, depth);
+}
+
+/**
+ * \def CONN_HASH_BUCKETS
+ * Number of hash-buckets for `g_conn_hash`. Must be a power of 2.
+ */
+#define CONN_HASH_BUCKETS  256
+
+/**
+ * All connections in all services hashed on `mg_connection::id`.
+ */
+static connection *g_conn_hash [CONN_HASH_BUCKETS];
+
+/**
+ * Add a new `conn` to the list for it's service and to `g_conn_hash`.
+ */
+static void connection_add (connection *conn)
+{
+  connection **head = &Modes.connections [conn->service];
+  connection **bucket = &g_conn_hash [conn->id & (CONN_HASH_BUCKETS - 1)];
+
+  conn->prev = NULL;
+  conn->next = *head;
+  if (*head)
+     (*head)->prev = conn;
+  *head = conn;
+
+  conn->hash_next = *bucket;
+  *bucket = conn;
+}
+
+/**
+ * Remove a `conn` from the list for it's service and from `g_conn_hash`.
+ */
+static void connection_remove (connection *conn)
+{
+  connection **h = &g_conn_hash [conn->id & (CONN_HASH_BUCKETS - 1)];
+
+  if (conn->prev)
+       conn->prev->next = conn->next;
+  else Modes.connections [conn->service] = conn->next;
+  if (conn->next)
+     conn->next->prev = conn->prev;
+
+  while (*h && *h != conn)
+     h = &(*h)->hash_next;
+  if (*h)
+     *h = conn->hash_next;
 }
 
 /**
- * Returns a `connection *` based on the remote `addr` and `service`.
+ * Returns a `connection *` based on the `mg_connection::id` and `service`.
  * This can be either client or server.
  */
 connection *connection_get (mg_connection *c, intptr_t service, bool is_server)
@@ -324,9 +1848,9 @@ connection *connection_get (mg_connection *c, intptr_t service, bool is_server)
 
   ASSERT_SERVICE (service);
 
-  for (conn = Modes.connections [service]; conn; conn = conn->next)
+  for (conn = g_conn_hash [c->id & (CONN_HASH_BUCKETS - 1)]; conn; conn = conn->hash_next)
   {
-    if (conn->service == service && !memcmp(&conn->rem, &c->rem, sizeof(mg_addr)))
+    if (conn->id == c->id && conn->service == service)
        return (conn);
   }
 
@@ -382,6 +1906,508 @@ static void send_favicon (mg_connection *c,
   c->is_resp = 0;
 }
 
+/**
+ * \typedef web_file
+ *
+ * A static file from `Modes.web_root` (or the packed web-page) loaded into
+ * memory by `web_cache_init()`. With the headers made once.
+ *
+ * The gzip version is made on the first request from a client that accepts it.
+ * Or it is a `file.gz` next to the file.
+ * Only used by the network thread after `net_init()`, so no locking.
+ */
+typedef struct web_file {
+        char            *name;            /**< relative to `Modes.web_root`. E.g. "libs/ol.js" */
+        const char      *data;            /**< the file content */
+        size_t           size;            /**< size of `data` */
+        time_t           mtime;           /**< time-stamp of the file */
+        bool             is_packed;       /**< `data` is in the packed web-page; not malloced */
+        bool             compress;        /**< a file-type worth compressing */
+        char            *headers;         /**< the "Content-Type", "Last-Modified" and "Cache-Control" headers */
+        char             etag [30];       /**< the ETag without quotes */
+        char             last_modified [40];
+        char            *gzip;            /**< the gzip data. NULL if not worth compressing */
+        size_t           gzip_len;        /**< length of `gzip` */
+        bool             gzip_done;       /**< tried to make `gzip` */
+        bool             gzip_shared;     /**< `gzip` is the data of the `file.gz` entry */
+        struct web_file *next;            /**< next in the `g_web_cache.buckets[]` chain */
+      } web_file;
+
+/**
+ * \def WEB_CACHE_BUCKETS
+ * Number of hash-buckets in the web-cache. The largest web-root has ~1100 files.
+ *
+ * \def WEB_CACHE_MAX_AGE
+ * The "Cache-Control: max-age" for files that are not HTML.
+ * An HTML file gets "no-cache"; i.e. it is revalidated to a "304 Not Modified" every time.
+ */
+#define WEB_CACHE_BUCKETS  2048
+#define WEB_CACHE_MAX_AGE  3600
+
+static struct web_cache {
+       web_file *buckets [WEB_CACHE_BUCKETS];
+       size_t    files;        /**< number of files in the cache */
+       size_t    bytes;        /**< bytes loaded from disk */
+       size_t    gzip_bytes;   /**< bytes of compressed data */
+       bool      full;         /**< `Modes.web_cache_max` was reached; some files are served from disk */
+     } g_web_cache;
+
+/**
+ * The known file-types and whether they are worth compressing.
+ * Other file-types are "text/plain" as in Mongoose.
+ */
+static const struct web_mime {
+       const char *ext;
+       const char *content_type;
+       bool        compress;
+     } web_mimes[] = {
+       { ".html",  "text/html; charset=utf-8",       true  },
+       { ".htm",   "text/html; charset=utf-8",       true  },
+       { ".js",    "text/javascript; charset=utf-8", true  },
+       { ".css",   "text/css; charset=utf-8",        true  },
+       { ".json",  "application/json",               true  },
+       { ".geojson", "application/geo+json",         true  },
+       { ".map",   "application/json",               true  },
+       { ".svg",   "image/svg+xml",                  true  },
+       { ".txt",   "text/plain; charset=utf-8",      true  },
+       { ".xml",   "text/xml; charset=utf-8",        true  },
+       { ".csv",   "text/csv",                       true  },
+       { ".wasm",  "application/wasm",               true  },
+       { ".ttf",   "font/ttf",                       true  },
+       { ".woff",  "font/woff",                      false },
+       { ".woff2", "font/woff2",                     false },
+       { ".png",   "image/png",                      false },
+       { ".gif",   "image/gif",                      false },
+       { ".jpg",   "image/jpeg",                     false },
+       { ".jpeg",  "image/jpeg",                     false },
+       { ".webp",  "image/webp",                     false },
+       { ".ico",   "image/x-icon",                   false },
+       { ".gz",    "application/gzip",               false }
+     };
+
+/**
+ * Return a malloced gzip stream of `data`.
+ * Returns NULL if it is not smaller than `len`.
+ */
+static char *net_gzip (const void *data, size_t len, size_t *gz_len)
+{
+  static const uint8_t header[10] = { 0x1F, 0x8B, 8, 0, 0, 0, 0, 0, 0, 0xFF };
+  size_t   deflated_len = 0;
+  void    *deflated = zip_deflate_mem (data, len, &deflated_len, Modes.web_gzip_level);
+  uint32_t crc, isize = (uint32_t) len;
+  char    *gz;
+
+  if (!deflated)
+     return (NULL);
+
+  *gz_len = sizeof(header) + deflated_len + 8;
+  if (*gz_len >= len || (gz = malloc(*gz_len)) == NULL)
+  {
+    free (deflated);
+    return (NULL);
+  }
+
+  crc = (uint32_t) zip_crc32 (0, data, len);
+  memcpy (gz, header, sizeof(header));
+  memcpy (gz + sizeof(header), deflated, deflated_len);
+  memcpy (gz + sizeof(header) + deflated_len, &crc, 4);   /* little-endian */
+  memcpy (gz + sizeof(header) + deflated_len + 4, &isize, 4);
+  free (deflated);
+  return (gz);
+}
+
+/**
+ * Should we send a body of `len` bytes gzip compressed to this client?
+ */
+static bool net_gzip_wanted (const connection *cli, size_t len)
+{
+  return (cli->encoding_gzip && Modes.web_gzip_level > 0 && len >= Modes.web_gzip_min);
+}
+
+/**
+ * Send a HTTP 200 reply with `data`.
+ * gzip compressed if the client accepts that.
+ */
+static void send_reply (mg_connection *c, const connection *cli, const char *headers, const char *data)
+{
+  size_t len = strlen (data);
+  size_t gz_len = 0;
+  char  *gz = NULL;
+
+  if (net_gzip_wanted(cli, len))
+     gz = net_gzip (data, len, &gz_len);
+
+  if (!gz)
+  {
+    mg_http_reply (c, 200, headers, "%s", data);
+    return;
+  }
+
+  mg_printf (c, "HTTP/1.1 200 OK\r\n"
+                "%s"
+                "Content-Encoding: gzip\r\n"
+                "Vary: Accept-Encoding\r\n"
+                "Content-Length: %lu\r\n\r\n", headers, (unsigned long)gz_len);
+  mg_send (c, gz, gz_len);
+  c->is_resp = 0;
+  free (gz);
+  Modes.stat.HTTP_gzip_replies++;
+  Modes.stat.HTTP_gzip_saved += len - gz_len;
+}
+
+/**
+ * Send a shared JSON snapshot from `aircraft_json_get()`.
+ *
+ * The ETag is the sequence number of the snapshot. So a client polling
+ * faster than `Modes.json_interval` gets a "304 Not Modified".
+ * The gzip version is made once per snapshot by the first client that wants it.
+ */
+static int send_json (mg_connection *c, const mg_http_message *hm, const connection *cli,
+                      json_data *j, const char *headers, bool is_HEAD)
+{
+  const mg_str *inm;
+  const char   *body = j->data;
+  size_t        len  = j->len;
+  bool          gzip = net_gzip_wanted (cli, j->len);
+  char          etag [30];
+
+  if (gzip && !j->gzip)
+     j->gzip = net_gzip (j->data, j->len, &j->gzip_len);
+  gzip = (gzip && j->gzip);
+
+  mg_snprintf (etag, sizeof(etag), "\"%lx%s\"", (unsigned long)j->seq, gzip ? "-gz" : "");
+  inm = mg_http_get_header ((mg_http_message*)hm, "If-None-Match");
+  if (inm && j->seq > 0 && !mg_vcasecmp(inm, etag))
+  {
+    mg_printf (c, "HTTP/1.1 304 Not Modified\r\n"
+                  "ETag: %s\r\n"
+                  "Vary: Accept-Encoding\r\n"
+                  "Content-Length: 0\r\n\r\n", etag);
+    c->is_resp = 0;
+    Modes.stat.HTTP_304_responses++;
+    return (304);
+  }
+
+  if (gzip)
+  {
+    body = j->gzip;
+    len  = j->gzip_len;
+    Modes.stat.HTTP_gzip_replies++;
+    Modes.stat.HTTP_gzip_saved += j->len - j->gzip_len;
+  }
+
+  mg_printf (c, "HTTP/1.1 200 OK\r\n"
+                "%s"
+                "%s"
+                "ETag: %s\r\n"
+                "Cache-Control: no-cache\r\n"
+                "Vary: Accept-Encoding\r\n"
+                "Content-Length: %lu\r\n\r\n",
+                headers, gzip ? "Content-Encoding: gzip\r\n" : "", etag, (unsigned long)len);
+  if (!is_HEAD)
+     mg_send (c, body, len);
+  c->is_resp = 0;
+  return (200);
+}
+
+/**
+ * Return the hash-bucket for a file-name. Case-insensitive as the Windows file-system.
+ */
+static uint32_t web_cache_hash (const char *name)
+{
+  uint32_t h = 2166136261U;   /* FNV-1a */
+
+  for ( ; *name; name++)
+      h = (h ^ (uint8_t) tolower(*name)) * 16777619U;
+  return (h % WEB_CACHE_BUCKETS);
+}
+
+/**
+ * Return the cached `name` (without the leading '/').
+ */
+static web_file *web_cache_lookup (const char *name)
+{
+  web_file *f;
+
+  for (f = g_web_cache.buckets [web_cache_hash(name)]; f; f = f->next)
+      if (!stricmp(f->name, name))
+         return (f);
+  return (NULL);
+}
+
+/**
+ * Add a file to the web-cache and make it's headers.
+ */
+static bool web_cache_add (const char *name, const char *data, size_t size, time_t mtime, bool is_packed)
+{
+  const struct web_mime *mime = NULL;
+  const char            *ext = strrchr (name, '.');
+  const char            *content_type = "text/plain; charset=utf-8";
+  const struct tm       *tm = gmtime (&mtime);
+  web_file              *f;
+  uint32_t               h;
+  int                    i;
+
+  for (i = 0; ext && i < DIM(web_mimes); i++)
+      if (!stricmp(ext, web_mimes[i].ext))
+      {
+        mime = web_mimes + i;
+        content_type = mime->content_type;
+        break;
+      }
+
+  f = calloc (sizeof(*f), 1);
+  if (!f)
+     return (false);
+
+  f->name      = strdup (name);
+  f->data      = data;
+  f->size      = size;
+  f->mtime     = mtime;
+  f->is_packed = is_packed;
+  f->compress  = (mime && mime->compress);
+
+  mg_snprintf (f->etag, sizeof(f->etag), "%lx.%lx", (unsigned long)mtime, (unsigned long)size);
+  if (!tm || !strftime(f->last_modified, sizeof(f->last_modified), "%a, %d %b %Y %H:%M:%S GMT", tm))
+     strcpy (f->last_modified, "Thu, 01 Jan 1970 00:00:00 GMT");
+
+  if (!strncmp(content_type, "text/html", 9))
+       f->headers = mg_mprintf ("Content-Type: %s\r\n"
+                                "Last-Modified: %s\r\n"
+                                "Cache-Control: no-cache\r\n", content_type, f->last_modified);
+  else f->headers = mg_mprintf ("Content-Type: %s\r\n"
+                                "Last-Modified: %s\r\n"
+                                "Cache-Control: max-age=%d\r\n", content_type, f->last_modified, WEB_CACHE_MAX_AGE);
+
+  if (!f->name || !f->headers)
+  {
+    free (f->name);
+    free (f->headers);
+    free (f);
+    return (false);
+  }
+
+  h = web_cache_hash (f->name);
+  f->next = g_web_cache.buckets [h];
+  g_web_cache.buckets [h] = f;
+  g_web_cache.files++;
+  return (true);
+}
+
+/**
+ * The `walk_dir()` callback for `web_cache_init()`.
+ * Load a file from `Modes.web_root` unless the cache is full.
+ */
+static void web_cache_add_file (const char *file, void *arg)
+{
+  size_t       root_len = *(const size_t*) arg;
+  mg_file_path name;
+  mg_str       content;
+  size_t       size  = 0;
+  time_t       mtime = 0;
+  char        *p;
+
+  if (!mg_fs_posix.st(file, &size, &mtime))
+     return;
+
+  if (g_web_cache.bytes + size > 1024ULL * 1024ULL * Modes.web_cache_max)
+  {
+    g_web_cache.full = true;
+    return;
+  }
+
+  content = mg_file_read (&mg_fs_posix, file);
+  if (!content.ptr)
+     return;
+
+  /* The name relative to `Modes.web_root` with '/' as in the URI
+   */
+  strncpy (name, file + root_len + 1, sizeof(name)-1);
+  name [sizeof(name)-1] = '\0';
+  for (p = name; *p; p++)
+      if (*p == '\\')
+         *p = '/';
+
+  if (web_cache_add(name, content.ptr, content.len, mtime, false))
+       g_web_cache.bytes += content.len;
+  else free ((void*) content.ptr);
+}
+
+/**
+ * Use a precompressed `file.gz` as the gzip version of `file`.
+ */
+static void web_cache_add_gzip (void)
+{
+  web_file    *f, *base;
+  mg_file_path name;
+  size_t       len;
+  int          i;
+
+  for (i = 0; i < WEB_CACHE_BUCKETS; i++)
+      for (f = g_web_cache.buckets [i]; f; f = f->next)
+      {
+        len = strlen (f->name);
+        if (len <= 3 || len >= sizeof(name) || stricmp(f->name + len - 3, ".gz"))
+           continue;
+
+        strcpy (name, f->name);
+        name [len - 3] = '\0';
+        base = web_cache_lookup (name);
+        if (!base || !base->compress || base->gzip_done)
+           continue;
+
+        base->gzip        = (char*) f->data;
+        base->gzip_len    = f->size;
+        base->gzip_done   = true;
+        base->gzip_shared = true;
+      }
+}
+
+/**
+ * Load all files of the web-page into memory.
+ * Either from the packed web-page or from `Modes.web_root` up to `Modes.web_cache_max` MBytes.
+ * Then a static file is served with no file-system calls.
+ */
+static void web_cache_init (void)
+{
+  memset (&g_web_cache, '\0', sizeof(g_web_cache));
+  if (Modes.web_cache_max == 0)
+     return;
+
+#if defined(USE_PACKED_DLL)
+  if (use_packed_dll)
+  {
+    const char *name, *data;
+    size_t      i, size;
+    time_t      mtime;
+
+    for (i = 0; (name = (*p_mg_unlist)(i)) != NULL; i++)
+    {
+      data = mg_unpack (name, &size, &mtime);
+      if (data)
+         web_cache_add (name, data, size, mtime, true);
+    }
+  }
+  else
+#endif
+  {
+    size_t root_len = strlen (Modes.web_root);
+
+    walk_dir (Modes.web_root, web_cache_add_file, &root_len);
+  }
+
+  web_cache_add_gzip();
+  LOG_FILEONLY ("Web-cache: %zu files, %zu kB%s.\n", g_web_cache.files, g_web_cache.bytes / 1024,
+                g_web_cache.full ? " (full; the rest is served from disk)" : "");
+}
+
+/**
+ * Return the cached file with a gzip version if it's worth compressing.
+ * Returns NULL if not.
+ */
+static const web_file *web_cache_gzip (web_file *f)
+{
+  if (!f->gzip_done)
+  {
+    f->gzip_done = true;
+    if (f->compress && Modes.web_gzip_level > 0 && f->size >= Modes.web_gzip_min)
+       f->gzip = net_gzip (f->data, f->size, &f->gzip_len);
+    g_web_cache.gzip_bytes += f->gzip_len;
+    DEBUG (DEBUG_NET, "Compressed '%s': %zu -> %zu bytes.\n", f->name, f->size, f->gzip_len);
+  }
+  return (f->gzip ? f : NULL);
+}
+
+/**
+ * Send a static file from the web-cache. gzip compressed if the client accepts that.
+ * Handles a "If-None-Match" for the ETag and a "If-Modified-Since".
+ *
+ * Returns false if `uri` is not cached. Or it is a "Range" request.
+ * Then the caller should let Mongoose serve it.
+ */
+static bool send_cached_file (mg_connection *c, const mg_http_message *hm, const connection *cli,
+                              const char *uri, bool is_HEAD)
+{
+  web_file     *f;
+  const mg_str *inm, *ims;
+  const char   *body;
+  size_t        len;
+  bool          gzip;
+  char          etag [40];
+
+  if (mg_http_get_header((mg_http_message*)hm, "Range"))
+     return (false);
+
+  f = web_cache_lookup (uri + 1);
+  if (!f)
+     return (false);
+
+  gzip = (cli->encoding_gzip && web_cache_gzip(f));
+  body = gzip ? f->gzip : f->data;
+  len  = gzip ? f->gzip_len : f->size;
+  mg_snprintf (etag, sizeof(etag), "\"%s%s\"", f->etag, gzip ? ".gz" : "");
+
+  inm = mg_http_get_header ((mg_http_message*)hm, "If-None-Match");
+  ims = mg_http_get_header ((mg_http_message*)hm, "If-Modified-Since");
+  if ((inm && !mg_vcasecmp(inm, etag)) || (!inm && ims && !mg_vcasecmp(ims, f->last_modified)))
+  {
+    mg_printf (c, "HTTP/1.1 304 Not Modified\r\n"
+                  "ETag: %s\r\n"
+                  "%s"
+                  "%s"
+                  "Content-Length: 0\r\n\r\n",
+                  etag, f->compress ? "Vary: Accept-Encoding\r\n" : "", set_headers(cli, NULL));
+    c->is_resp = 0;
+    Modes.stat.HTTP_304_responses++;
+    return (true);
+  }
+
+  mg_printf (c, "HTTP/1.1 200 OK\r\n"
+                "%s"
+                "%s"
+                "%s"
+                "ETag: %s\r\n"
+                "%s"
+                "Content-Length: %lu\r\n\r\n",
+                f->headers, gzip ? "Content-Encoding: gzip\r\n" : "",
+                f->compress ? "Vary: Accept-Encoding\r\n" : "",
+                etag, set_headers(cli, NULL), (unsigned long)len);
+  if (!is_HEAD)
+     mg_send (c, body, len);
+  c->is_resp = 0;
+
+  Modes.stat.HTTP_cache_replies++;
+  if (gzip)
+  {
+    Modes.stat.HTTP_gzip_replies++;
+    Modes.stat.HTTP_gzip_saved += f->size - f->gzip_len;
+  }
+  return (true);
+}
+
+/**
+ * Free the web-cache.
+ */
+static void web_cache_free_all (void)
+{
+  web_file *f, *f_next;
+  int       i;
+
+  for (i = 0; i < WEB_CACHE_BUCKETS; i++)
+      for (f = g_web_cache.buckets [i]; f; f = f_next)
+      {
+        f_next = f->next;
+        if (!f->gzip_shared)
+           free (f->gzip);
+        if (!f->is_packed)
+           free ((void*) f->data);
+        free (f->name);
+        free (f->headers);
+        free (f);
+      }
+  memset (&g_web_cache, '\0', sizeof(g_web_cache));
+}
+
 /**
  * Return a description of the receiver in JSON.
  *  { "version" : "0.3", "refresh" : 1000, "history" : 3 }
@@ -399,7 +2425,9 @@ static char *receiver_to_json (void)
                       "\"refresh\": %llu, "
                       "\"history\": %d, "
                       "\"lat\": %.8g, "       /* if 'Modes.home_pos_ok == false', this is 0. */
-                      "\"lon\": %.8g}",       /* ditto */
+                      "\"lon\": %.8g, "       /* ditto */
+                      "\"binCraft\": true, "  /* Tar1090 should use "/data/aircraft.binCraft" */
+                      "\"zstd\": false}",
                       PROG_VERSION,
                       Modes.json_interval,
                       history_size,
@@ -414,7 +2442,7 @@ static int net_handler_http (mg_connection *c, mg_http_message *hm, mg_http_uri
 {
   mg_str      *header;
   connection  *cli;
-  bool         is_dump1090, is_extended, is_HEAD, is_GET;
+  bool         is_dump1090, is_extended, is_binCraft, is_HEAD, is_GET;
   const char  *content_type = NULL;
   const char  *uri, *dot, *first_nl;
   mg_host_name addr_buf;
@@ -467,11 +2495,9 @@ static int net_handler_http (mg_connection *c, mg_http_message *hm, mg_http_uri
   }
 
   header = mg_http_get_header (hm, "Accept-Encoding");
-  if (header && !mg_vcasecmp(header, "gzip"))
-  {
-    DEBUG (DEBUG_NET2, "Accept-Encoding: '%.*s'\n", (int)header->len, header->ptr);
-    cli->encoding_gzip = true;  /**\todo Add gzip compression */
-  }
+  cli->encoding_gzip = (header && mg_strstr(*header, mg_str("gzip")));
+  if (header)
+     DEBUG (DEBUG_NET2, "Accept-Encoding: '%.*s'\n", (int)header->len, header->ptr);
 
   /* Redirect a 'GET /' to a 'GET /' + 'web_page'
    */
@@ -485,13 +2511,26 @@ static int net_handler_http (mg_connection *c, mg_http_message *hm, mg_http_uri
     return (301);
   }
 
-  /**
-   * \todo Check header for a "Upgrade: websocket" and call mg_ws_upgrade()?
-   */
   if (!stricmp(uri, "/echo"))
   {
     DEBUG (DEBUG_NET, "Got WebSocket echo:\n'%.*s'.\n", (int)hm->head.len, hm->head.ptr);
     mg_ws_upgrade (c, hm, "WS test");
+    Modes.stat.HTTP_websockets++;
+    return (200);
+  }
+
+  /* The WebSocket for the default 'web_root/index.html'.
+   * It gets a snapshot of all aircrafts and then the changes in `net_ws_push()`.
+   */
+  if (!stricmp(uri, "/ws/aircraft"))
+  {
+    DEBUG (DEBUG_NET, "WebSocket aircraft client (conn-id: %lu).\n", c->id);
+    mg_ws_upgrade (c, hm, NULL);
+    if (!cli->ws_aircraft)
+       InterlockedIncrement (&Modes.ws_clients);
+    cli->ws_aircraft = true;
+    cli->ws_seq      = 0;
+    Modes.stat.HTTP_websockets++;
     return (200);
   }
 
@@ -501,7 +2540,7 @@ static int net_handler_http (mg_connection *c, mg_http_message *hm, mg_http_uri
 
     DEBUG (DEBUG_NET2, "Feeding conn-id %lu with receiver-data:\n%.100s\n", c->id, data);
 
-    mg_http_reply (c, 200, MODES_CONTENT_TYPE_JSON "\r\n", data);
+    send_reply (c, cli, "Content-Type: " MODES_CONTENT_TYPE_JSON "\r\n", data);
     free (data);
     return (200);
   }
@@ -512,12 +2551,14 @@ static int net_handler_http (mg_connection *c, mg_http_message *hm, mg_http_uri
 
   /* Or From an OpenLayers3/Tar1090/FlightAware web-client
    */
-  is_extended = (stricmp (uri, "/data/aircraft.json") == 0) ||
-                (stricmp (uri, "/chunks/chunks.json") == 0);
+  is_extended = stricmp (uri, "/data/aircraft.json") == 0;
+  is_binCraft = stricmp (uri, "/data/aircraft.binCraft") == 0;
 
-  if (is_dump1090 || is_extended)
+  if (is_dump1090 || is_extended || is_binCraft)
   {
-    char *data = aircraft_make_json (is_extended);
+    json_data *data = aircraft_json_get (is_binCraft ? JSON_BINCRAFT :
+                                         is_extended ? JSON_EXTENDED : JSON_DUMP1090);
+    int        rc;
 
     /* "Cross Origin Resource Sharing":
      * https://www.freecodecamp.org/news/access-control-allow-origin-header-explained/
@@ -531,14 +2572,16 @@ static int net_handler_http (mg_connection *c, mg_http_message *hm, mg_http_uri
       return (500);
     }
 
-    /* This is rather inefficient way to pump data over to the client.
+    /* The same snapshot is sent to all clients until the next one.
      * Better use a WebSocket instead.
      */
-    if (is_extended)
-         mg_http_reply (c, 200, CORS_HEADER, data);
-    else mg_http_reply (c, 200, CORS_HEADER MODES_CONTENT_TYPE_JSON "\r\n", data);
-    free (data);
-    return (200);
+    if (is_binCraft)
+         rc = send_json (c, hm, cli, data, CORS_HEADER "Content-Type: application/octet-stream\r\n", is_HEAD);
+    else if (is_extended)
+         rc = send_json (c, hm, cli, data, CORS_HEADER, is_HEAD);
+    else rc = send_json (c, hm, cli, data, CORS_HEADER "Content-Type: " MODES_CONTENT_TYPE_JSON "\r\n", is_HEAD);
+    aircraft_json_put (data);
+    return (rc);
   }
 
   dot = strrchr (uri, '.');
@@ -552,7 +2595,7 @@ static int net_handler_http (mg_connection *c, mg_http_message *hm, mg_http_uri
     else if (!stricmp(uri, "/favicon.ico"))   /* Some browsers may want a 'favicon.ico' file */
        send_favicon (c, cli, favicon_ico, favicon_ico_len, MODES_CONTENT_TYPE_ICON);
 
-    else
+    else if (!send_cached_file(c, hm, cli, uri, is_HEAD))
     {
       mg_http_serve_opts opts;
       mg_file_path       file;
@@ -626,7 +2669,6 @@ static int net_handler_websocket (mg_connection *c, const mg_ws_message *ws, int
   {
     DEBUG (DEBUG_MONGOOSE2, "WebSock control from conn-id: %lu:\n", c->id);
     HEX_DUMP (ws->data.ptr, ws->data.len);
-    Modes.stat.HTTP_websockets++;
   }
   return (1);
 }
@@ -903,7 +2945,7 @@ static void net_handler (mg_connection *c, int ev, void *ev_data)
     if (service == MODES_NET_SERVICE_RTL_TCP && !rtl_tcp_connect(c))
        return;
 
-    LIST_ADD_TAIL (connection, &Modes.connections [service], conn);
+    connection_add (conn);
     ++ (*net_num_connections (service));  /* should never go above 1 */
     net_mem_allocated (service, sizeof(*conn));
 
@@ -933,7 +2975,7 @@ static void net_handler (mg_connection *c, int ev, void *ev_data)
     conn->service = service;
     strcpy (conn->rem_buf, remote_buf);
 
-    LIST_ADD_TAIL (connection, &Modes.connections [service], conn);
+    connection_add (conn);
     ++ (*net_num_connections (service));
     net_mem_allocated (service, (int)sizeof(*conn));
 
@@ -944,7 +2986,7 @@ static void net_handler (mg_connection *c, int ev, void *ev_data)
   if (ev == MG_EV_READ)
   {
     bytes = *(const long*) ev_data;
-    Modes.stat.bytes_recv [service] += bytes;
+    NET_STAT_ADD (Modes.stat.bytes_recv [service], bytes);
 
     DEBUG (DEBUG_NET2, "MG_EV_READ: %lu bytes from %s (service \"%s\")\n",
            bytes, remote, net_service_descr(service));
@@ -973,7 +3015,7 @@ static void net_handler (mg_connection *c, int ev, void *ev_data)
   if (ev == MG_EV_WRITE)         /* Increment our own send() bytes */
   {
     bytes = *(const long*) ev_data;
-    Modes.stat.bytes_sent [service] += bytes;
+    NET_STAT_ADD (Modes.stat.bytes_sent [service], bytes);
     DEBUG (DEBUG_NET2, "MG_EV_WRITE: %ld bytes to %s (\"%s\").\n",
            bytes, remote, net_service_descr(service));
     return;
@@ -1062,44 +3104,39 @@ static bool connection_setup_listen (intptr_t service, mg_connection **c, bool s
 /**
  * Free a specific connection, client or server.
  */
-static void net_conn_free (connection *this_conn, intptr_t service)
+static void net_conn_free (connection *conn, intptr_t service)
 {
-  connection  *conn;
-  int          is_server = -1;
-  ULONG        id = 0;
-  uint64_t     mem_now = 0ULL;
+  bool         is_server;
+  ULONG        id;
+  uint64_t     mem_now;
   mg_host_name addr;
 
-  if (!this_conn)
-     return;
-
-  for (conn = Modes.connections[service]; conn; conn = conn->next)
-  {
-    if (conn != this_conn)
-       continue;
-
-    LIST_DELETE (connection, &Modes.connections [service], conn);
-    if (this_conn->c->is_accepted)
-    {
-      Modes.stat.cli_removed [service]++;
-      is_server = 0;
-    }
-    else
-    {
-      Modes.stat.srv_removed [service]++;
-      is_server = 1;
-    }
-    id = conn->id;
-    strcpy (addr, conn->rem_buf);
-    free (conn);
+  if (!conn)
+     return;
 
-    mem_now = net_mem_allocated (service, - (int)sizeof(*conn));
-    break;
+  connection_remove (conn);
+  if (conn->c->is_accepted)
+  {
+    Modes.stat.cli_removed [service]++;
+    is_server = false;
+  }
+  else
+  {
+    Modes.stat.srv_removed [service]++;
+    is_server = true;
   }
+  if (conn->ws_aircraft)
+     InterlockedDecrement (&Modes.ws_clients);
+
+  id = conn->id;
+  strcpy (addr, conn->rem_buf);
+  net_stream_detach (conn);
+  free (conn);
+
+  mem_now = net_mem_allocated (service, - (int)sizeof(*conn));
 
   DEBUG (DEBUG_NET, "Freeing %s at %s (conn-id: %lu, url: %s, service: \"%s\", mem_now: %llu).\n",
-         is_server == 1 ? "server" :
-         is_server == 0 ? "client" : "?", addr, id,
+         is_server ? "server" : "client", addr, id,
          net_service_url(service), net_service_descr(service), mem_now);
 }
 
@@ -1225,12 +3262,62 @@ static void net_flush_all (void)
          num_active, num_passive, num_unknown, total_rx, total_tx, num_timers);
 }
 
+static unique_IP **unique_ip_bucket (uint32_t ip4, intptr_t service)
+{
+  uint32_t h = (ip4 ^ (uint32_t)service) * 2654435761U;   /* Knuth's multiplicative hash */
+
+  return (&g_unique_ips.buckets [(h >> 16) & (UNIQUE_IP_BUCKETS - 1)]);
+}
+
+/**
+ * Link `ip` in as the most recently seen.
+ */
+static void unique_ip_link (unique_IP *ip)
+{
+  ip->next = NULL;
+  ip->prev = g_unique_ips.newest;
+  if (g_unique_ips.newest)
+       g_unique_ips.newest->next = ip;
+  else g_unique_ips.oldest = ip;
+  g_unique_ips.newest = ip;
+}
+
+static void unique_ip_unlink (unique_IP *ip)
+{
+  if (ip->prev)
+       ip->prev->next = ip->next;
+  else g_unique_ips.oldest = ip->next;
+  if (ip->next)
+       ip->next->prev = ip->prev;
+  else g_unique_ips.newest = ip->prev;
+}
+
+/**
+ * Forget the least recently seen client.
+ */
+static void unique_ip_evict (void)
+{
+  unique_IP  *ip = g_unique_ips.oldest;
+  unique_IP **h  = unique_ip_bucket (*(uint32_t*)&ip->addr.ip, ip->service);
+
+  while (*h != ip)
+     h = &(*h)->hash_next;
+  *h = ip->hash_next;
+
+  unique_ip_unlink (ip);
+  free (ip);
+  g_unique_ips.num--;
+  Modes.stat.unique_evicted++;
+}
+
 /**
  * Check if the client `*addr` is unique.
  */
 static bool _client_is_unique (const mg_addr *addr, intptr_t service, unique_IP **ipp)
 {
-  unique_IP *ip;
+  unique_IP **bucket;
+  unique_IP  *ip;
+  uint32_t    ip4;
 
   *ipp = NULL;
 
@@ -1238,16 +3325,24 @@ static bool _client_is_unique (const mg_addr *addr, intptr_t service, unique_IP
       *(uint32_t*) &addr->ip == 0)  /* Ignore 0.0.0.0 */
      return (true);
 
-  for (ip = g_unique_ips; ip; ip = ip->next)
+  ip4 = *(const uint32_t*) &addr->ip;
+  bucket = unique_ip_bucket (ip4, service);
+
+  for (ip = *bucket; ip; ip = ip->hash_next)
   {
-    if (ip->service == service && *(uint32_t*)&ip->addr.ip == *(uint32_t*)&addr->ip)
+    if (ip->service == service && *(uint32_t*)&ip->addr.ip == ip4)
     {
       ip->accepted++;  /* accept() counter */
+      unique_ip_unlink (ip);
+      unique_ip_link (ip);
       *ipp = ip;
       return (false);
     }
   }
 
+  if (Modes.net_unique_max > 0 && g_unique_ips.num >= Modes.net_unique_max)
+     unique_ip_evict();
+
   ip = calloc (sizeof(*ip), 1);  /* assign a new element for this `*addr` */
   if (!ip)
      return (false);             /* cannot tell */
@@ -1256,7 +3351,10 @@ static bool _client_is_unique (const mg_addr *addr, intptr_t service, unique_IP
   ip->service  = service;
   ip->accepted = 1;
   get_FILETIME_now (&ip->seen);
-  LIST_ADD_TAIL (unique_IP, &g_unique_ips, ip);
+  ip->hash_next = *bucket;
+  *bucket = ip;
+  unique_ip_link (ip);
+  g_unique_ips.num++;
   *ipp = ip;
   return (true);
 }
@@ -1293,7 +3391,7 @@ static void unique_ips_print (intptr_t service)
   if (!Modes.log)
      return;
 
-  for (ip = g_unique_ips; ip; ip = ip->next)
+  for (ip = g_unique_ips.oldest; ip; ip = ip->next)
   {
     char denied [20] = "";
 
@@ -1320,76 +3418,400 @@ static void unique_ips_free (void)
 {
   unique_IP *ip, *ip_next;
 
-  for (ip = g_unique_ips; ip; ip = ip_next)
+  for (ip = g_unique_ips.oldest; ip; ip = ip_next)
   {
     ip_next = ip->next;
     free (ip);
   }
-  g_unique_ips = NULL;
+  memset (&g_unique_ips, '\0', sizeof(g_unique_ips));
+}
+
+/**
+ * Return bit `i` of an address or prefix. Bit 0 is the MSB of `key[0]`.
+ */
+static int acl_bit (const uint8_t *key, unsigned i)
+{
+  return ((key [i >> 3] >> (7 - (i & 7))) & 1);
+}
+
+/**
+ * Return the number of leading bits (max `bits`) that `a` and `b` have in common.
+ */
+static unsigned acl_common_bits (const uint8_t *a, const uint8_t *b, unsigned bits)
+{
+  unsigned i = 0;
+
+  while (i + 8 <= bits && a [i >> 3] == b [i >> 3])
+     i += 8;
+  while (i < bits && acl_bit(a, i) == acl_bit(b, i))
+     i++;
+  return (i);
+}
+
+static acl_node *acl_node_new (const uint8_t *key, unsigned bits, acl_verdict verdict)
+{
+  acl_node *n = calloc (sizeof(*n), 1);
+  unsigned  i;
+
+  if (n)
+  {
+    memcpy (n->prefix, key, (bits + 7) / 8);
+    if (bits & 7)                              /* clear the bits after the prefix */
+       n->prefix [bits >> 3] &= (uint8_t) (0xFF << (8 - (bits & 7)));
+    for (i = (bits + 7) / 8; i < sizeof(n->prefix); i++)
+        n->prefix [i] = 0;
+    n->bits    = (uint8_t) bits;
+    n->verdict = verdict;
+  }
+  return (n);
+}
+
+/**
+ * Insert a `key / bits` prefix with a `verdict` into the trie at `*root`.
+ * A node is only split where 2 prefixes differ, so the depth is bounded by the
+ * prefix length. A later entry for the same prefix replaces the verdict.
+ */
+static bool acl_insert (acl_node **root, const uint8_t *key, unsigned bits, acl_verdict verdict)
+{
+  acl_node **np = root;
+  acl_node  *n, *split;
+  unsigned   common;
+
+  while (1)
+  {
+    n = *np;
+    if (!n)
+    {
+      *np = acl_node_new (key, bits, verdict);
+      return (*np != NULL);
+    }
+
+    common = acl_common_bits (n->prefix, key, min(n->bits, bits));
+    if (common < n->bits)
+    {
+      /* Split `n` where it differs from `key`
+       */
+      split = acl_node_new (key, common, common == bits ? verdict : ACL_NONE);
+      if (!split)
+         return (false);
+
+      split->child [acl_bit(n->prefix, common)] = n;
+      *np = split;
+      if (common == bits)
+         return (true);
+
+      split->child [acl_bit(key, common)] = acl_node_new (key, bits, verdict);
+      return (split->child [acl_bit(key, common)] != NULL);
+    }
+
+    if (n->bits == bits)
+    {
+      n->verdict = verdict;
+      return (true);
+    }
+    np = &n->child [acl_bit(key, n->bits)];
+  }
+}
+
+/**
+ * Return the verdict of the longest prefix in the trie `n` matching `key`.
+ * At most one node is visited per prefix bit.
+ */
+static acl_verdict acl_lookup (const acl_node *n, const uint8_t *key, unsigned max_bits)
+{
+  acl_verdict verdict = ACL_NONE;
+
+  while (n && acl_common_bits(n->prefix, key, n->bits) == n->bits)
+  {
+    if (n->verdict != ACL_NONE)
+       verdict = n->verdict;
+    if (n->bits >= max_bits)
+       break;
+    n = n->child [acl_bit(key, n->bits)];
+  }
+  return (verdict);
+}
+
+static void acl_free (acl_node *n)
+{
+  if (n)
+  {
+    acl_free (n->child[0]);
+    acl_free (n->child[1]);
+    free (n);
+  }
+}
+
+/**
+ * Parse an ACL `spec` like `80.94/16`, `113.30.148.*`, `45.128.232.127` or `fe80::/64`.
+ * For IPv4, a partial address without a `/bits` is a prefix of the octets given.
+ */
+static bool acl_parse (const char *spec, bool is_ip6, uint8_t *key, unsigned *bits)
+{
+  const char *slash = strchr (spec, '/');
+  char       *end;
+  unsigned    n = 0, max_bits = is_ip6 ? 128 : 32;
+
+  memset (key, '\0', 16);
+
+  if (is_ip6)
+  {
+    mg_addr addr;
+    char    buf [sizeof(ip_address)];
+
+    memset (&addr, '\0', sizeof(addr));
+    snprintf (buf, sizeof(buf), "%.*s", slash ? (int)(slash - spec) : (int)strlen(spec), spec);
+    if (!mg_aton(mg_str(buf), &addr) || !addr.is_ip6)
+       return (false);
+    memcpy (key, &addr.ip, 16);
+    *bits = 128;
+  }
+  else
+  {
+    while (n < 4 && *spec != '*')
+    {
+      unsigned long octet = strtoul (spec, &end, 10);
+
+      if (end == spec || octet > 255)
+         return (false);
+      key [n++] = (uint8_t) octet;
+      spec = end;
+      if (*spec != '.')
+         break;
+      spec++;
+    }
+    if (*spec == '*')
+       spec++;
+    if (*spec && *spec != '/')
+       return (false);
+    *bits = 8 * n;
+  }
+
+  if (slash)
+  {
+    unsigned long val = strtoul (slash + 1, &end, 10);
+
+    if (end == slash + 1 || *end || val > max_bits)
+       return (false);
+    *bits = (unsigned) val;
+  }
+  return (true);
 }
 
-static bool add_deny (const char *val, bool is_ip6)
+/**
+ * Add one or more comma-separated ACLs in `val` to the tries in `acl`.
+ * A `+spec` (or just `spec`) denies. A `-spec` allows; an exception
+ * in a wider denied prefix.
+ */
+static bool add_deny (const char *val, bool is_ip6, acl_tries *acl)
 {
-  deny_element *deny = calloc (sizeof(*deny), 1);
+  char     buf [200];
+  char    *spec, *next;
+  uint8_t  key [16];
+  unsigned bits;
 
-  if (deny)
+  strncpy (buf, val, sizeof(buf)-1);
+  buf [sizeof(buf)-1] = '\0';
+
+  for (spec = buf; spec; spec = next)
   {
-    strncpy (deny->acl, val, sizeof(deny->acl)-1);
-    deny->is_ip6 = is_ip6;
-    LIST_ADD_TAIL (deny_element, &g_deny_list, deny);
+    acl_verdict verdict = ACL_DENY;
+
+    next = strchr (spec, ',');
+    if (next)
+       *next++ = '\0';
+    spec = str_trim (spec);
+    if (!*spec)
+       continue;
+
+    if (*spec == '+' || *spec == '-')
+    {
+      verdict = (*spec == '-') ? ACL_ALLOW : ACL_DENY;
+      spec++;
+    }
+
+    if (!acl_parse(spec, is_ip6, key, &bits))
+    {
+      LOG_STDERR ("Illegal deny%c ACL: '%s'.\n", is_ip6 ? '6' : '4', spec);
+      continue;
+    }
+    if (!acl_insert(is_ip6 ? &acl->ip6 : &acl->ip4, key, bits, verdict))
+       return (false);
+
+    if (is_ip6)
+         acl->num6++;
+    else acl->num4++;
   }
   return (true);
 }
 
+/**
+ * Remember the config-file with a `deny4` or `deny6` key for `deny_lists_reload()`.
+ */
+static void deny_file_add (void)
+{
+  const char *fname = cfg_current_file();
+  struct stat st;
+  int         i;
+
+  if (!fname)
+     return;
+
+  for (i = 0; i < g_deny_files_num; i++)
+      if (!stricmp(g_deny_files[i].name, fname))
+         return;
+
+  if (g_deny_files_num == DIM(g_deny_files))
+     return;
+
+  strncpy (g_deny_files [i].name, fname, sizeof(g_deny_files [i].name)-1);
+  g_deny_files [i].mtime = (stat(fname, &st) == 0) ? st.st_mtime : 0;
+  g_deny_files_num++;
+}
+
 /**
  * Callbacks from cfg_file.c
  */
 bool net_deny4 (const char *val)
 {
-  return add_deny (val, false);
+  deny_file_add();
+  return add_deny (val, false, &g_deny);
 }
 
 bool net_deny6 (const char *val)
 {
-  return add_deny (val, true);
+  deny_file_add();
+  return add_deny (val, true, &g_deny);
 }
 
 /**
- * Loop over `g_deny_list` to check if client `addr` should be denied.
- * `mg_check_ip_acl()` accepts netmasks.
+ * Parse the `deny4` and `deny6` keys in `fname` into `acl`.
+ * Other keys and `include` files are ignored.
  */
-static bool client_deny (const mg_addr *addr, int *rc)
+static bool deny_file_parse (const char *fname, acl_tries *acl)
 {
-  const deny_element *d;
+  FILE *file = fopen (fname, "rt");
+  char  buf [500];
 
-  *rc = -3;      /* unknown */
+  if (!file)
+  {
+    LOG_FILEONLY ("Failed to open \"%s\" for reloading the deny-lists.\n", fname);
+    return (false);
+  }
 
-  for (d = g_deny_list; d; d = d->next)
+  while (fgets(buf, sizeof(buf), file))
   {
-    if (d->is_ip6)    /* Mongoose does not support IPv6 here yet */
+    char *key, *value, *p = strchr (buf, '#');
+
+    if (p)
+       *p = '\0';
+    p = strchr (buf, '=');
+    if (!p)
        continue;
 
-    *rc = mg_check_ip_acl (mg_str(d->acl), (struct mg_addr*)addr);
-    if (*rc == 1)
-       return (true);
+    *p++  = '\0';
+    key   = str_trim (buf);
+    value = str_trim (p);
+    if (!stricmp(key, "deny4"))
+       add_deny (value, false, acl);
+    else if (!stricmp(key, "deny6"))
+       add_deny (value, true, acl);
   }
-  return (false);
+  fclose (file);
+  return (true);
 }
 
-static size_t deny_list_dump (bool is_ip6)
+/**
+ * Called from the network thread every `Modes.deny_reload` seconds.
+ *
+ * If a config-file with `deny4` or `deny6` keys was modified, parse them all
+ * into new tries and replace the old. `client_deny()` is also called from this
+ * thread, so no locking is needed. If a file cannot be read (e.g. while it's
+ * being written), the old tries are kept and it's tried again the next time.
+ */
+static void deny_lists_reload (void)
 {
-  const deny_element *d;
-  size_t              num = 0;
+  static uint64_t last_check = 0;
+  uint64_t        now = MSEC_TIME();
+  struct stat     st;
+  acl_tries       acl;
+  bool            changed = false;
+  int             i;
+
+  if (Modes.deny_reload == 0 || g_deny_files_num == 0 ||
+      now - last_check < 1000ULL * Modes.deny_reload)
+     return;
 
-  for (d = g_deny_list; d; d = d->next)
+  last_check = now;
+  for (i = 0; i < g_deny_files_num; i++)
   {
-    if (d->is_ip6 == is_ip6)
+    if (stat(g_deny_files[i].name, &st) == 0 && st.st_mtime != g_deny_files[i].mtime)
     {
-      printf ("  Added deny ACL: %s.\n", d->acl);
-      num++;
+      g_deny_files [i].mtime = st.st_mtime;
+      changed = true;
     }
   }
-  return (num);
+  if (!changed)
+     return;
+
+  memset (&acl, '\0', sizeof(acl));
+  for (i = 0; i < g_deny_files_num; i++)
+  {
+    if (!deny_file_parse(g_deny_files[i].name, &acl))
+    {
+      acl_free (acl.ip4);
+      acl_free (acl.ip6);
+      g_deny_files [i].mtime = 0;   /* retry next time */
+      return;
+    }
+  }
+
+  acl_free (g_deny.ip4);
+  acl_free (g_deny.ip6);
+  g_deny = acl;
+  Modes.stat.deny_reloads++;
+  LOG_FILEONLY ("Reloaded deny-lists: %zu IPv4 and %zu IPv6 ACLs.\n", g_deny.num4, g_deny.num6);
+}
+
+/**
+ * Check if client `addr` should be denied.
+ * The longest matching prefix in the IPv4 or IPv6 trie decides.
+ *
+ * `*rc` is 1 if denied, 0 if allowed by a `-spec` and -3 if no prefix matched.
+ */
+static bool client_deny (const mg_addr *addr, int *rc)
+{
+  acl_verdict verdict;
+
+  if (addr->is_ip6)
+       verdict = acl_lookup (g_deny.ip6, (const uint8_t*)&addr->ip, 128);
+  else verdict = acl_lookup (g_deny.ip4, (const uint8_t*)&addr->ip, 32);
+
+  *rc = (verdict == ACL_DENY)  ?  1 :
+        (verdict == ACL_ALLOW) ?  0 : -3;
+  return (verdict == ACL_DENY);
+}
+
+static size_t deny_list_dump (const acl_node *n, bool is_ip6)
+{
+  mg_addr    addr;
+  ip_address abuf;
+  size_t     num;
+
+  if (!n)
+     return (0);
+
+  num = deny_list_dump (n->child[0], is_ip6);
+  if (n->verdict != ACL_NONE)
+  {
+    memset (&addr, '\0', sizeof(addr));
+    memcpy (&addr.ip, n->prefix, is_ip6 ? 16 : 4);
+    addr.is_ip6 = is_ip6;
+    mg_snprintf (abuf, sizeof(abuf), "%M", mg_print_ip, &addr);
+    printf ("  Added %s ACL: %s/%u.\n", n->verdict == ACL_DENY ? "deny" : "allow", abuf, n->bits);
+    num++;
+  }
+  return (num + deny_list_dump (n->child[1], is_ip6));
 }
 
 static void deny_lists_dump (void)
@@ -1397,8 +3819,8 @@ static void deny_lists_dump (void)
   size_t num4, num6;
 
   printf ("\n%s():\n", __FUNCTION__);
-  num4 = deny_list_dump (false);
-  num6 = deny_list_dump (true);
+  num4 = deny_list_dump (g_deny.ip4, false);
+  num6 = deny_list_dump (g_deny.ip6, true);
   printf ("  num4 ACL: %zu, num6 ACL: %zu.\n", num4, num6);
 }
 
@@ -1446,36 +3868,10 @@ static void deny_lists_tests (void)
 
 static void deny_list_free (void)
 {
-  deny_element *d, *d_next;
-
-  for (d = g_deny_list; d; d = d_next)
-  {
-    d_next = d->next;
-    free (d);
-  }
-  g_deny_list = NULL;
-}
-
-static size_t deny_list_num4 (void)
-{
-  const deny_element *d;
-  size_t              num = 0;
-
-  for (d = g_deny_list; d; d = d->next)
-      if (!d->is_ip6)
-         num++;
-  return (num);
-}
-
-static size_t deny_list_num6 (void)
-{
-  const deny_element *d;
-  size_t              num = 0;
-
-  for (d = g_deny_list; d; d = d->next)
-      if (d->is_ip6)
-         num++;
-  return (num);
+  acl_free (g_deny.ip4);
+  acl_free (g_deny.ip6);
+  memset (&g_deny, '\0', sizeof(g_deny));
+  g_deny_files_num = 0;
 }
 
 static bool client_is_extern (const mg_addr *addr)
@@ -1881,6 +4277,9 @@ static void show_raw_RAW_IN_stats (void)
     LOG_STDOUT ("  %8llu good messages.\n", Modes.stat.RAW_good);
     LOG_STDOUT ("  %8llu empty messages.\n", Modes.stat.RAW_empty);
     LOG_STDOUT ("  %8llu unrecognized messages.\n", Modes.stat.RAW_unrecognized);
+    if (Modes.stat.udp_recv [MODES_NET_SERVICE_RAW_IN] > 0)
+       LOG_STDOUT ("  %8llu UDP datagrams (%llu lost).\n",
+                   Modes.stat.udp_recv [MODES_NET_SERVICE_RAW_IN], Modes.stat.udp_lost [MODES_NET_SERVICE_RAW_IN]);
   }
 }
 
@@ -1893,6 +4292,9 @@ static void show_raw_SBS_IN_stats (void)
     LOG_STDOUT ("  %8llu AIR messages.\n", Modes.stat.SBS_AIR_msg);
     LOG_STDOUT ("  %8llu STA messages.\n", Modes.stat.SBS_STA_msg);
     LOG_STDOUT ("  %8llu unrecognized messages.\n", Modes.stat.SBS_unrecognized);
+    if (Modes.stat.udp_recv [MODES_NET_SERVICE_SBS_IN] > 0)
+       LOG_STDOUT ("  %8llu UDP datagrams (%llu lost).\n",
+                   Modes.stat.udp_recv [MODES_NET_SERVICE_SBS_IN], Modes.stat.udp_lost [MODES_NET_SERVICE_SBS_IN]);
   }
 }
 
@@ -1900,7 +4302,35 @@ static void show_rtl_tcp_IN_stats (void)
 {
   if (show_raw_common(MODES_NET_SERVICE_RTL_TCP))
   {
-//  LOG_STDOUT ("  %8llu packets.\n", Modes.stat.rtltcp.packets);
+    uint64_t decoded = Modes.stat.rtltcp_blocks - min (Modes.stat.rx_overruns, Modes.stat.rtltcp_blocks);
+
+    LOG_STDOUT ("    %8llu sample blocks received, %llu (%s samples) decoded.\n", Modes.stat.rtltcp_blocks,
+                decoded, qword_str(decoded * (MODES_ASYNC_BUF_SIZE / 2)));
+    LOG_STDOUT ("    %8u bytes left in the last block.\n", Modes.rtltcp.block_len);
+    LOG_STDOUT ("    %8llu blocks overwritten before decoding.\n", Modes.stat.rx_overruns);
+  }
+}
+
+/**
+ * Show the send-queue statistics for a RAW / SBS output service.
+ * And the queue depths of the clients still connected.
+ */
+static void net_show_send_queues (intptr_t service)
+{
+  const connection *conn;
+  uint64_t          depth;
+
+  LOG_STDOUT ("    %8llu slow clients evicted.\n", Modes.stat.cli_evicted [service]);
+  LOG_STDOUT ("    %8llu bytes dropped for slow clients.\n", Modes.stat.send_dropped [service]);
+  LOG_STDOUT ("    %8llu bytes max queued for a client.\n", Modes.stat.send_queue_max [service]);
+
+  for (conn = Modes.connections [service]; conn; conn = conn->next)
+  {
+    depth = conn->c->send.len;
+    if (conn->send_chunk)
+       depth += net_streams [service].pos - conn->send_pos;
+    LOG_STDOUT ("      %-25s queued now: %llu, max: %zu, dropped: %llu bytes.\n",
+                conn->rem_buf, depth, conn->send_max, conn->send_dropped);
   }
 }
 
@@ -1927,6 +4357,7 @@ void net_show_stats (void)
     else sum = Modes.stat.cli_accepted [s]  + Modes.stat.cli_removed [s] + Modes.stat.cli_unknown [s];
 
     sum += Modes.stat.bytes_sent [s] + Modes.stat.bytes_recv [s] + *net_num_connections (s);
+    sum += Modes.stat.udp_datagrams [s] + Modes.stat.udp_dropped [s];
     if (sum == 0ULL)
     {
       LOG_STDOUT ("    Nothing.\n");
@@ -1940,8 +4371,16 @@ void net_show_stats (void)
     {
       LOG_STDOUT ("    %8llu HTTP GET requests received.\n", Modes.stat.HTTP_get_requests);
       LOG_STDOUT ("    %8llu HTTP 400 replies sent.\n", Modes.stat.HTTP_400_responses);
+      LOG_STDOUT ("    %8llu HTTP 304 replies sent.\n", Modes.stat.HTTP_304_responses);
       LOG_STDOUT ("    %8llu HTTP 404 replies sent.\n", Modes.stat.HTTP_404_responses);
+      LOG_STDOUT ("    %8llu HTTP gzip replies sent (%llu bytes saved).\n",
+                  Modes.stat.HTTP_gzip_replies, Modes.stat.HTTP_gzip_saved);
+      LOG_STDOUT ("    %8llu HTTP replies from the web-cache (%zu files, %zu kB, %zu kB gzip).\n",
+                  Modes.stat.HTTP_cache_replies, g_web_cache.files,
+                  g_web_cache.bytes / 1024, g_web_cache.gzip_bytes / 1024);
       LOG_STDOUT ("    %8llu HTTP/WebSocket upgrades.\n", Modes.stat.HTTP_websockets);
+      LOG_STDOUT ("    %8llu WebSocket aircraft updates (%llu bytes).\n",
+                  Modes.stat.HTTP_ws_updates, Modes.stat.HTTP_ws_bytes);
       LOG_STDOUT ("    %8llu server connection \"keep-alive\".\n", Modes.stat.HTTP_keep_alive_sent);
       LOG_STDOUT ("    %8llu client connection \"keep-alive\".\n", Modes.stat.HTTP_keep_alive_recv);
     }
@@ -1960,12 +4399,41 @@ void net_show_stats (void)
       LOG_STDOUT ("    %8llu client connections unknown.\n", Modes.stat.cli_unknown [s]);
       LOG_STDOUT ("    %8u client(s) now.\n", *net_num_connections(s));
     }
+
+    if (net_handler_sending(s) && s != MODES_NET_SERVICE_HTTP)
+       net_show_send_queues (s);
+
+    if (net_udp[s].url)
+       LOG_STDOUT ("    %8llu UDP datagrams sent to %s (%llu dropped).\n",
+                   Modes.stat.udp_datagrams [s], net_udp[s].url, Modes.stat.udp_dropped [s]);
     unique_ips_print (s);
   }
 
   show_raw_SBS_IN_stats();
   show_raw_RAW_IN_stats();
   show_rtl_tcp_IN_stats();
+  net_upstream_show_stats();
+
+  if (Modes.stat.deny_reloads > 0)
+     LOG_STDOUT ("  %llu deny-list reloads (%zu IPv4 and %zu IPv6 ACLs now).\n",
+                 Modes.stat.deny_reloads, g_deny.num4, g_deny.num6);
+
+  if (Modes.stat.unique_evicted > 0)
+     LOG_STDOUT ("  %llu least recently seen client addresses forgotten (net-unique-max: %u).\n",
+                 Modes.stat.unique_evicted, Modes.net_unique_max);
+
+  if (Modes.stat.net_out_queued + Modes.stat.net_in_queued > 0)
+  {
+    LOG_STDOUT ("  Network thread:\n");
+    LOG_STDOUT ("    %8llu messages queued for sending (%llu dropped).\n",
+                Modes.stat.net_out_queued, Modes.stat.net_out_dropped);
+    LOG_STDOUT ("    %8llu input chunks queued for decoding (%llu deferred).\n",
+                Modes.stat.net_in_queued, Modes.stat.net_in_deferred);
+  }
+  if (Modes.stat.net_flushes > 0)
+     LOG_STDOUT ("    %8llu output batches (avg %llu bytes) sent in %llu writes.\n",
+                 Modes.stat.net_flushes, Modes.stat.net_flush_bytes / Modes.stat.net_flushes,
+                 Modes.stat.net_writes);
 
   net_show_server_errors();
 }
@@ -2025,7 +4493,7 @@ static void unique_ip_tests (void)
   if (client_is_unique(&addr, service, &ip2))
      Modes.stat.unique_clients [service]++;
 
-  for (num = 0, ip = g_unique_ips; ip; ip = ip->next)
+  for (num = 0, ip = g_unique_ips.oldest; ip; ip = ip->next)
       num++;
   assert (num == Modes.stat.unique_clients [service]);
 }
@@ -2081,6 +4549,7 @@ static char *net_init_dns (void)
  *  \li Start the 2 active network services (RAW_IN + SBS_IN).
  *  \li Or start the 4 listening (passive) network services.
  *  \li If HTTP-server is enabled, check the precence of the Web-page.
+ *  \li And load it into the web-cache.
  *  \li If `--test` was used, do some tests.
  */
 bool net_init (void)
@@ -2182,8 +4651,7 @@ bool net_init (void)
   if (Modes.dns)
      Modes.mgr.dns4.url = Modes.dns;
 
-  LOG_FILEONLY ("Added %zu IPv4 and %zu IPv6 addresses to deny.\n",
-               deny_list_num4(), deny_list_num6());
+  LOG_FILEONLY ("Added %zu IPv4 and %zu IPv6 ACLs to deny.\n", g_deny.num4, g_deny.num6);
 
   /* Setup the RTL_TCP service and possibly rename if '--device udp://host:port' was used.
    */
@@ -2199,34 +4667,45 @@ bool net_init (void)
     }
   }
 
-  /* If RAW-IN is UDP, rename description and protocol.
-   */
-  if (modeS_net_services [MODES_NET_SERVICE_RAW_IN].is_udp)
-  {
-    strcpy (modeS_net_services [MODES_NET_SERVICE_RAW_IN].descr, "Raw UDP input");
-    strcpy (modeS_net_services [MODES_NET_SERVICE_RAW_IN].protocol, "udp");
-  }
-
   if (Modes.net_active)
   {
     if (!modeS_net_services [MODES_NET_SERVICE_RAW_IN].host [0] &&
-        !modeS_net_services [MODES_NET_SERVICE_SBS_IN].host [0])
+        !modeS_net_services [MODES_NET_SERVICE_SBS_IN].host [0] && net_upstreams_num == 0)
     {
       LOG_STDERR ("No hosts for any `--net-active' services specified.\n");
       return (false);
     }
 
-    if (modeS_net_services [MODES_NET_SERVICE_RAW_IN].host [0] &&
-        !connection_setup_active(MODES_NET_SERVICE_RAW_IN, &Modes.raw_in))
+    if (modeS_net_services [MODES_NET_SERVICE_RAW_IN].is_udp)
+    {
+      if (!net_udp_listen(MODES_NET_SERVICE_RAW_IN, &Modes.raw_in))
+         return (false);
+    }
+    else if (modeS_net_services [MODES_NET_SERVICE_RAW_IN].host [0] &&
+             !connection_setup_active(MODES_NET_SERVICE_RAW_IN, &Modes.raw_in))
        return (false);
 
-    if (modeS_net_services [MODES_NET_SERVICE_SBS_IN].host [0] &&
-        !connection_setup_active(MODES_NET_SERVICE_SBS_IN, &Modes.sbs_in))
+    if (modeS_net_services [MODES_NET_SERVICE_SBS_IN].is_udp)
+    {
+      if (!net_udp_listen(MODES_NET_SERVICE_SBS_IN, &Modes.sbs_in))
+         return (false);
+    }
+    else if (modeS_net_services [MODES_NET_SERVICE_SBS_IN].host [0] &&
+             !connection_setup_active(MODES_NET_SERVICE_SBS_IN, &Modes.sbs_in))
        return (false);
   }
   else
   {
-    if (!connection_setup_listen(MODES_NET_SERVICE_RAW_IN, &Modes.raw_in, false))
+    if (modeS_net_services [MODES_NET_SERVICE_RAW_IN].is_udp)
+    {
+      if (!net_udp_listen(MODES_NET_SERVICE_RAW_IN, &Modes.raw_in))
+         return (false);
+    }
+    else if (!connection_setup_listen(MODES_NET_SERVICE_RAW_IN, &Modes.raw_in, false))
+       return (false);
+
+    if (modeS_net_services [MODES_NET_SERVICE_SBS_IN].is_udp &&
+        !net_udp_listen(MODES_NET_SERVICE_SBS_IN, &Modes.sbs_in))
        return (false);
 
     if (!connection_setup_listen(MODES_NET_SERVICE_RAW_OUT, &Modes.raw_out, true))
@@ -2239,23 +4718,42 @@ bool net_init (void)
        return (false);
   }
 
+  /* UDP output works with and without `--net-active`
+   */
+  if (!net_udp_init(MODES_NET_SERVICE_RAW_OUT) || !net_udp_init(MODES_NET_SERVICE_SBS_OUT))
+     return (false);
+
   if (Modes.http_out && !check_packed_web_page() && !check_web_page())
      return (false);
 
+  if (Modes.http_out)
+     web_cache_init();
+
   if (test_contains(Modes.tests, "net"))
   {
     unique_ip_tests();
     deny_lists_tests();
   }
 
+  /* Start connecting the upstream sources; `net_upstream_poll()` does the rest
+   */
+  net_upstream_poll();
+  net_thread_start();
   return (true);
 }
 
 bool net_exit (void)
 {
-  uint32_t num = net_conn_free_all();
+  uint32_t num;
+
+  net_thread_stop();
+  num = net_conn_free_all();
+  net_stream_free_all();
 
   net_timer_del_all();
+  web_cache_free_all();
+  net_udp_free_all();
+  net_upstream_free_all();
   unique_ips_free();
   deny_list_free();
 
@@ -2272,6 +4770,11 @@ bool net_exit (void)
 
   if (Modes.rtltcp.info)
      free (Modes.rtltcp.info);
+  FREE (Modes.rtltcp.block);
+
+  FREE (net_thread.out_buf);
+  FREE (net_thread.in_buf);
+  mg_iobuf_free (&net_thread.in_msg);
 
   Modes.mgr.conns = NULL;
   Modes.dns = NULL;
@@ -2281,14 +4784,50 @@ bool net_exit (void)
   return (num > 0);
 }
 
+/**
+ * Called from `background_tasks()` in the main thread.
+ *
+ * Decode the RAW / SBS input queued by the network thread.
+ * This never blocks; Mongoose is polled in `net_thread_fn()`.
+ */
 void net_poll (void)
 {
   static uint64_t tc_last = 0;
   uint64_t        tc_now;
+  char           *buf;
+  size_t          len;
+  int             loops;
 
-  /* Poll Mongoose for network events
+  /* Poll Mongoose for network events if the network thread failed to start
    */
-  mg_mgr_poll (&Modes.mgr, MODES_INTERACTIVE_REFRESH_TIME / 2);   /* == 125 msec max */
+  if (!net_thread.thread)
+  {
+    mg_mgr_poll (&Modes.mgr, MODES_INTERACTIVE_REFRESH_TIME / 2);   /* == 125 msec max */
+    net_stream_flush_due();
+    net_ws_push();
+    net_upstream_poll();
+    deny_lists_reload();
+  }
+
+  else
+  {
+    EnterCriticalSection (&Modes.data_mutex);
+    Modes.net_input = false;    /* `net_queue_in()` sets it again for input queued after this */
+    LeaveCriticalSection (&Modes.data_mutex);
+
+    while ((len = mg_queue_next(&net_thread.in_queue, &buf)) > 0)
+    {
+      net_msg_handler handler = (*buf == MODES_NET_SERVICE_RAW_IN) ? decode_RAW_message : decode_SBS_message;
+
+      Modes.net_source = (uint8_t) buf[1];
+      mg_iobuf_add (&net_thread.in_msg, net_thread.in_msg.len, buf + 2, len - 2);
+      mg_queue_del (&net_thread.in_queue, len);
+
+      for (loops = 0; net_thread.in_msg.len > 0; loops++)
+         (*handler) (&net_thread.in_msg, loops);
+      Modes.net_source = 0;
+    }
+  }
 
   /* If the RTL_TCP server went away, that's fatal
    */
@@ -2454,11 +4993,42 @@ static void rtl_tcp_recv_info (mg_iobuf *msg)
 
 /**
  * The read event handler for the RTL_TCP raw IQ data.
+ *
+ * Mongoose hands us reads of any length. But `rx_callback()` expects a whole
+ * block of `MODES_ASYNC_BUF_SIZE` bytes like a local RTLSDR device gives.
+ * So collect the data in `Modes.rtltcp.block` and pass it on only when full.
+ * No bytes are dropped here and a block is an even number of bytes, so each
+ * block starts on an I/Q pair even if a read splits one.
  */
 static void rtl_tcp_recv_data (mg_iobuf *msg)
 {
-  rx_callback (msg->buf, msg->len, (void*)&Modes.exit);
-  mg_iobuf_del (msg, 0, msg->len);
+  size_t len;
+
+  if (!Modes.rtltcp.block)
+  {
+    Modes.rtltcp.block = malloc (MODES_ASYNC_BUF_SIZE);
+    Modes.rtltcp.block_len = 0;
+    if (!Modes.rtltcp.block)
+    {
+      mg_iobuf_del (msg, 0, msg->len);
+      return;
+    }
+  }
+
+  while (msg->len > 0)
+  {
+    len = min (msg->len, MODES_ASYNC_BUF_SIZE - Modes.rtltcp.block_len);
+    memcpy (Modes.rtltcp.block + Modes.rtltcp.block_len, msg->buf, len);
+    Modes.rtltcp.block_len += (uint32_t) len;
+    mg_iobuf_del (msg, 0, len);
+
+    if (Modes.rtltcp.block_len == MODES_ASYNC_BUF_SIZE)
+    {
+      rx_callback (Modes.rtltcp.block, MODES_ASYNC_BUF_SIZE, (void*)&Modes.exit);
+      Modes.rtltcp.block_len = 0;
+      Modes.stat.rtltcp_blocks++;
+    }
+  }
 }
 
 /**
@@ -2486,6 +5056,11 @@ static bool rtl_tcp_command (mg_connection *c, uint8_t command, uint32_t param)
 
   cmd.cmd   = command;
   cmd.param = htonl (param);
+
+  /* From `interactive.c` in the main thread
+   */
+  if (!net_in_thread())
+     return net_queue_out (MODES_NET_SERVICE_RTL_TCP, &cmd, sizeof(cmd));
   return mg_send (c, &cmd, sizeof(cmd));
 }
 
@@ -2497,6 +5072,8 @@ static bool rtl_tcp_connect (mg_connection *c)
 {
   INT_PTR service = MODES_NET_SERVICE_RTL_TCP;
 
+  Modes.rtltcp.block_len = 0;   /* the samples start after the welcome message */
+
   DEBUG (DEBUG_NET, "Setting sample-rate: %.2f MS/s.\n", (double)Modes.sample_rate/1E6);
   if (!rtl_tcp_command (c, RTL_SET_SAMPLE_RATE, Modes.sample_rate))
      goto failed;
@@ -59,12 +59,18 @@ typedef bool (*net_msg_handler) (mg_iobuf *msg, int loop_cnt);
 bool        net_init (void);
 bool        net_exit (void);
 void        net_poll (void);
+void        net_thread_stop (void);
 void        net_show_stats (void);
 uint16_t    net_handler_port (intptr_t service);
 const char *net_handler_protocol (intptr_t service);
 bool        net_handler_sending (intptr_t service);
 void        net_connection_send (intptr_t service, const void *msg, size_t len);
 bool        net_set_host_port (const char *host_port, net_service *serv, uint16_t def_port);
+bool        net_udp_set_output (intptr_t service, const char *host_port);
+bool        net_udp_output (intptr_t service);
+bool        net_udp_seq (intptr_t service, const char *line);
+bool        net_upstream_add (const char *arg);
+void        net_upstream_count (uint8_t source);
 bool        net_deny4 (const char *val);
 bool        net_deny6 (const char *val);
 
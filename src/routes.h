@@ -1,10 +1,27 @@
 /**\file    routes.h
  * \ingroup Main
  *
- * Lookup of generated routes[] data.
+ * Lookup of routes in the compressed `routes.bin` file
+ * generated by `tools/gen_routes_data.py`.
  */
 #pragma once
 
+#include <stdint.h>
+
+/**
+ * \def ROUTES_DATABASE_BIN
+ * Our default route-database relative to `Modes.where_am_I`.
+ */
+#define ROUTES_DATABASE_BIN  "routes.bin"
+
+/**
+ * \def ROUTES_FILE_MAGIC
+ * \def ROUTES_FILE_VERSION
+ * Must match `MAGIC` and `VERSION` in `tools/gen_routes_data.py`.
+ */
+#define ROUTES_FILE_MAGIC    "D1090RTS"
+#define ROUTES_FILE_VERSION  1
+
 typedef struct route_record {
         char  call_sign    [10];  /**< Call-sign for this route (or flight) */
         char  departure    [10];  /**< ICAO departure airport for this route */
@@ -12,5 +29,30 @@ typedef struct route_record {
         char  stop_over [5][10];  /**< 5 possible stop-over airports. Or "" for none */
       } route_record;
 
-extern const route_record route_records[];
-extern size_t             route_records_num;
+/**
+ * \typedef routes_file_hdr
+ *
+ * The header of a `routes.bin` file.
+ * Followed by `num_blocks` of `routes_block` and the compressed blocks.
+ */
+typedef struct routes_file_hdr {
+        char      magic [8];       /**< `ROUTES_FILE_MAGIC` */
+        uint32_t  version;         /**< `ROUTES_FILE_VERSION` */
+        uint32_t  num_routes;      /**< total number of routes */
+        uint32_t  num_blocks;      /**< number of blocks */
+        uint32_t  block_records;   /**< number of routes in a block; the last block may have fewer */
+      } routes_file_hdr;
+
+/**
+ * \typedef routes_block
+ *
+ * The index-entry for a zlib-compressed block of routes.
+ * A block is lines of `"call-sign,DEP-STOP-..-DEST\n"` sorted on the upper-case call-sign.
+ */
+typedef struct routes_block {
+        char      first [16];      /**< the upper-case call-sign of the first route in this block */
+        uint32_t  offset;          /**< file offset of the compressed block */
+        uint32_t  comp_size;       /**< compressed size */
+        uint32_t  raw_size;        /**< decompressed size */
+        uint32_t  num;             /**< number of routes in this block */
+      } routes_block;
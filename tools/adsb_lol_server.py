@@ -0,0 +1,152 @@
+#!/usr/bin/env python3
+
+"""
+A local stand-in for the ADSB-LOL route service for Dump1090 testing.
+
+Serves '/routes/XX/CALLSIGN.json' like 'https://vrs-standing-data.adsb.lol'.
+And a POST to '/api/0/routeset' like 'https://api.adsb.lol'.
+Returns "429 Too Many Requests" when the client exceeds '--rate' requests per sec
+and a random "404 Not Found" for '--p404' of the requests. In a routeset response,
+such call-signs are missing or "unknown".
+
+Use it with these settings in 'dump1090.cfg':
+  adsb-lol-url          = http://localhost:8000/routes/%.2s/%s.json
+  adsb-lol-routeset-url = http://localhost:8000/api/0/routeset
+"""
+
+import sys, time, json, random, argparse, threading
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+AIRPORTS = [ "OSL", "BGO", "TRD", "SVG", "CPH", "ARN", "LHR", "AMS", "FRA", "CDG", "JFK", "LAX" ]
+
+class cfg():
+  rate     = 5
+  burst    = 10
+  delay    = 0.2
+  p404     = 0.1
+  tokens   = 10
+  last     = time.monotonic()
+  lock     = threading.Lock()
+  requests = 0
+  resp_429 = 0
+  resp_404 = 0
+  routes   = 0
+
+#
+# A token-bucket like in 'airports.c'
+#
+def rate_exceeded():
+  with cfg.lock:
+    now = time.monotonic()
+    cfg.tokens = min (cfg.burst, cfg.tokens + (now - cfg.last) * cfg.rate)
+    cfg.last = now
+    cfg.requests += 1
+    if cfg.tokens < 1:
+      cfg.resp_429 += 1
+      return True
+    cfg.tokens -= 1
+    return False
+
+class handler (BaseHTTPRequestHandler):
+  def reply (self, code, body):
+    body = body.encode()
+    self.send_response (code)
+    self.send_header ("Content-Type", "application/json")
+    self.send_header ("Content-Length", str(len(body)))
+    self.end_headers()
+    self.wfile.write (body)
+
+  def do_GET (self):
+    parts = self.path.strip("/").split("/")
+    if len(parts) != 3 or parts[0] != "routes" or not parts[2].endswith(".json"):
+      self.reply (404, "Not Found")
+      return
+
+    if rate_exceeded():
+      self.reply (429, "Too Many Requests")
+      return
+
+    time.sleep (cfg.delay)  # a slow service
+    if random.random() < cfg.p404:
+      with cfg.lock:
+        cfg.resp_404 += 1
+      self.reply (404, "Not Found")
+      return
+
+    call_sign = parts[2][:-5]
+    dep, dest = random.sample (AIRPORTS, 2)
+    self.reply (200, '{"callsign": "%s", "_airport_codes_iata": "%s-%s", "airport_codes": "?"}' %
+                (call_sign, dep, dest))
+
+  #
+  # A routeset request like:
+  #   {"planes": [{"callsign": "SAS123", "lat": 0, "lng": 0}, ...]}
+  #
+  # The keys in each response object are sorted like the real service.
+  #
+  def do_POST (self):
+    if self.path != "/api/0/routeset":
+      self.reply (404, "Not Found")
+      return
+
+    try:
+      length = int (self.headers.get("Content-Length", 0))
+      planes = json.loads (self.rfile.read(length))["planes"]
+    except (ValueError, KeyError, TypeError):
+      self.reply (400, "Bad Request")
+      return
+
+    if rate_exceeded():
+      self.reply (429, "Too Many Requests")
+      return
+
+    time.sleep (cfg.delay)
+    routes = []
+    for plane in planes:
+      call_sign = plane.get ("callsign", "")
+      r = random.random()
+      with cfg.lock:
+        cfg.routes += 1
+        if r < cfg.p404:
+          cfg.resp_404 += 1
+      if r < cfg.p404 / 2:
+        continue                       # missing from the response
+      if r < cfg.p404:
+        iata = icao = "unknown"
+      else:
+        iata = "-".join (random.sample (AIRPORTS, 2))
+        icao = "?"
+      routes.append ({ "_airport_codes_iata": iata,
+                       "_airports": [ { "iata": code, "name": "Airport %s" % code } for code in iata.split("-") ],
+                       "airline_code": call_sign[:3],
+                       "airport_codes": icao,
+                       "callsign": call_sign,
+                       "plausible": False })
+
+    self.reply (200, json.dumps (routes, separators = (",", ":")))
+
+  def log_message (self, fmt, *args):
+    print ("%s  (requests: %d, routes: %d, 429: %d, 404: %d)" %
+           (fmt % args, cfg.requests, cfg.routes, cfg.resp_429, cfg.resp_404))
+
+def main():
+  parser = argparse.ArgumentParser (description = "Local ADSB-LOL route service stand-in.")
+  parser.add_argument ("-p", "--port",  type = int,   default = 8000, help = "port to listen on (default: %(default)s)")
+  parser.add_argument ("-r", "--rate",  type = float, default = cfg.rate, help = "max requests per sec before a 429 (default: %(default)s)")
+  parser.add_argument ("-b", "--burst", type = int,   default = cfg.burst, help = "max requests in a burst (default: %(default)s)")
+  parser.add_argument ("-d", "--delay", type = float, default = cfg.delay, help = "response delay in sec (default: %(default)s)")
+  parser.add_argument ("--p404",        type = float, default = cfg.p404, help = "probability of a 404 (default: %(default)s)")
+  args = parser.parse_args()
+
+  cfg.rate, cfg.burst, cfg.tokens, cfg.delay, cfg.p404 = args.rate, args.burst, args.burst, args.delay, args.p404
+
+  server = ThreadingHTTPServer (("localhost", args.port), handler)
+  print ("Listening on http://localhost:%d/routes/ and http://localhost:%d/api/0/routeset" % (args.port, args.port))
+  try:
+    server.serve_forever()
+  except KeyboardInterrupt:
+    pass
+  return 0
+
+if __name__ == "__main__":
+  sys.exit (main())
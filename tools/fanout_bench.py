@@ -0,0 +1,107 @@
+#!/usr/bin/env python3
+
+"""
+A fan-out benchmark for Dump1090's RAW-OUT / SBS output.
+
+A feeder connects to the RAW-IN port (30001) and sends '*...;' messages at '--rate'
+messages per sec. These are relayed to all clients on the RAW-OUT port (30002).
+'--clients' readers connect to '--port' (30002 or 30003) and count the lines received.
+Some readers can be made slow with '--slow' to show the effect of 'net-send-policy'.
+
+Prints the messages sent and the lines/sec received per client and in total.
+Run Dump1090 with e.g. '--net --device tcp://localhost' or with a RAW-IN source.
+"""
+
+import sys, time, argparse, socket, threading
+
+REMOTE_HOST  = "localhost"
+RAW_IN_PORT  = 30001
+RAW_OUT_PORT = 30002
+RAW_OUT_MSG  = b"*8d4b969699155600e87406f5b69f;\n"
+
+class cfg():
+  quit  = False
+  sent  = 0
+  lines = []
+  bytes = []
+
+def feeder (host, rate, batch):
+  sock = socket.create_connection ((host, RAW_IN_PORT))
+  data = RAW_OUT_MSG * batch
+  start = time.monotonic()
+  while not cfg.quit:
+    sock.sendall (data)
+    cfg.sent += batch
+    delay = start + cfg.sent / rate - time.monotonic()
+    if delay > 0:
+       time.sleep (delay)
+  sock.close()
+
+def reader (idx, host, port, slow):
+  sock = socket.create_connection ((host, port))
+  sock.settimeout (0.5)
+  if slow:
+     sock.setsockopt (socket.SOL_SOCKET, socket.SO_RCVBUF, 4096)
+  while not cfg.quit:
+    try:
+      data = sock.recv (65536)
+    except socket.timeout:
+      continue
+    except OSError:
+      break
+    if not data:
+       break
+    cfg.lines[idx] += data.count (b"\n")
+    cfg.bytes[idx] += len (data)
+    if slow:
+       time.sleep (0.1)
+  sock.close()
+
+def main():
+  parser = argparse.ArgumentParser (description = "Dump1090 RAW / SBS fan-out benchmark.")
+  parser.add_argument ("-H", "--host",    default = REMOTE_HOST, help = "host running Dump1090 (default: %(default)s)")
+  parser.add_argument ("-p", "--port",    type = int,   default = RAW_OUT_PORT, help = "port to read from (default: %(default)s)")
+  parser.add_argument ("-c", "--clients", type = int,   default = 50, help = "number of reading clients (default: %(default)s)")
+  parser.add_argument ("-s", "--slow",    type = int,   default = 0, help = "number of slow clients (default: %(default)s)")
+  parser.add_argument ("-r", "--rate",    type = float, default = 20000, help = "messages per sec to send (default: %(default)s)")
+  parser.add_argument ("-b", "--batch",   type = int,   default = 20, help = "messages per send (default: %(default)s)")
+  parser.add_argument ("-t", "--time",    type = float, default = 10, help = "seconds to run (default: %(default)s)")
+  args = parser.parse_args()
+
+  cfg.lines = [0] * args.clients
+  cfg.bytes = [0] * args.clients
+  threads = []
+  for i in range (args.clients):
+    t = threading.Thread (target = reader, args = (i, args.host, args.port, i < args.slow), daemon = True)
+    t.start()
+    threads.append (t)
+
+  time.sleep (0.5)   # let Dump1090 accept all readers
+  t = threading.Thread (target = feeder, args = (args.host, args.rate, args.batch), daemon = True)
+  t.start()
+  threads.append (t)
+
+  start = time.monotonic()
+  try:
+    time.sleep (args.time)
+  except KeyboardInterrupt:
+    pass
+  cfg.quit = True
+  elapsed = time.monotonic() - start
+  for t in threads:
+    t.join (1)
+
+  fast  = cfg.lines [args.slow:] or cfg.lines
+  total = sum (cfg.lines)
+  print ("Sent %d messages in %.1f sec (%.0f msg/sec) to %d clients (%d slow)." %
+         (cfg.sent, elapsed, cfg.sent / elapsed, args.clients, args.slow))
+  print ("Received %d lines, %d kB: %.0f lines/sec in total." %
+         (total, sum(cfg.bytes) // 1024, total / elapsed))
+  print ("Per fast client: min %.0f, max %.0f, avg %.0f lines/sec." %
+         (min(fast) / elapsed, max(fast) / elapsed, sum(fast) / len(fast) / elapsed))
+  if args.slow:
+     print ("Per slow client: %s lines." % ", ".join(str(n) for n in cfg.lines[:args.slow]))
+  return 0
+
+if __name__ == "__main__":
+  sys.exit (main())
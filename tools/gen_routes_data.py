@@ -1,83 +1,78 @@
 #!/usr/bin/env python3
 """
-A tool to generate a 'routes.c' file from
+A tool to generate a compressed 'routes.bin' file from
   https://vrs-standing-data.adsb.lol/routes.csv
   https://vrs-standing-data.adsb.lol/routes.csv.gz
 
-"""
-import os, sys, csv, time, operator
-
-max_rec = 0
-data    = dict()
-out     = sys.stdout
+The routes are sorted on the upper-case call-sign and split into blocks
+of 'BLOCK_RECORDS' routes. Each block is a zlib-compressed text of lines like:
+  "VXP101,KBUR-KSTS\n"
 
+Layout of the file (all numbers are little-endian 'uint32_t'):
+  header:  magic "D1090RTS", version, num_routes, num_blocks, block_records
+  index:   num_blocks * (char first[16], offset, comp_size, raw_size, num)
+  blocks:  the compressed blocks
 
-C_TOP = """/*
- * Generated at %s by
- * %s %s
- * DO NOT EDIT!
- */
-#include "routes.h"
-
+'airports.c' memory-maps this file and decompresses a block only when needed.
 """
+import os, sys, csv, gzip, zlib, time, struct
 
-C_BOTTOM = "size_t route_records_num = %d;\n"
-
-def split_airports (airports):
-  #
-  # Split an airport string like "KBUR-KSTS" into departure == "KBUR", and
-  # destination == "KSTS". Handle max 5 possible stop-overs. Like:
-  # "PANC-PASI-PABE-KSEA-PABE-PACV-PAJN"
-  #  ^    ^    ^              ^    ^
-  #  |    |    |_s[1]         |    |_ a[-1]
-  #  a[0] |_s[0]              |_ s[4]
-  #
-  a = airports.split ("-")
-  s = a [1:-1]
-  dep_dest = r'"%s", "%s", { ' % (a[0], a[-1])
+MAGIC         = b"D1090RTS"
+VERSION       = 1
+BLOCK_RECORDS = 128
+HDR_FMT       = "<8sIIII"
+INDEX_FMT     = "<16sIIII"
 
-  if len(s) >= 5:
-     return dep_dest + r'"%s", "%s", "%s", "%s", "%s"' % (s[0], s[1], s[2], s[3], s[4])
-  if len(s) == 4:
-     return dep_dest + r'"%s", "%s", "%s", "%s", ""' % (s[0], s[1], s[2], s[3])
-  if len(s) == 3:
-     return dep_dest + r'"%s", "%s", "%s", "", ""' % (s[0], s[1], s[2])
-  if len(s) == 2:
-     return dep_dest + r'"%s", "%s", "", "", ""' % (s[0], s[1])
-  if len(s) == 1:
-     return dep_dest + r'"%s", "", "", "", ""' % (s[0])
-  return dep_dest + r'"", "", "", "", ""'
+max_rec = 0
 
-#
-# Dump all 'route_records' in 'data' to 'out'
-# Sorted on "callsign".
-#
-def dump_records (out, data):
-  out.write ("const route_record route_records [%d] = {\n" % len(data))
-  for i, _ in enumerate(data):
-      c = data[i] [0]
-      a = data[i] [4]
-      if c != "Callsign":  # Ignore the header record
-         out.write ("    { \"%s\", %s } },\n" % (c, split_airports(a)))
-      if max_rec and i > max_rec:
+def read_routes (fname):
+  if fname.endswith(".gz"):
+     f = gzip.open (fname, "rt", newline="", encoding="utf-8-sig")
+  else:
+     f = open (fname, "r", newline="", encoding="utf-8-sig")
+
+  routes = []
+  with f:
+    for row in csv.reader (f, delimiter = ","):
+      if len(row) < 5 or row[0] == "Callsign":  # Ignore the header record
+         continue
+      call_sign = row[0].strip()
+      if not call_sign or len(call_sign) > 9:
+         continue
+      routes.append ((call_sign.upper(), call_sign, row[4].strip()))
+      if max_rec and len(routes) >= max_rec:
          break
 
-  out.write ("};\n\n")
-
-if len(sys.argv) == 3 and (sys.argv[1] == "-t" or sys.argv[1] == "--test"):
-   max_rec = 10
+  routes.sort (key = lambda r: r[0])
+  return routes
+
+def write_routes (fname, routes):
+  blocks = []
+  for i in range (0, len(routes), BLOCK_RECORDS):
+    chunk = routes [i:i+BLOCK_RECORDS]
+    raw   = "".join ("%s,%s\n" % (r[1], r[2]) for r in chunk).encode ("utf-8")
+    blocks.append ((chunk[0][0].encode("ascii", "replace"), len(chunk), raw, zlib.compress(raw, 9)))
+
+  offset = struct.calcsize (HDR_FMT) + len(blocks) * struct.calcsize(INDEX_FMT)
+  with open (fname, "wb") as out:
+    out.write (struct.pack (HDR_FMT, MAGIC, VERSION, len(routes), len(blocks), BLOCK_RECORDS))
+    for first, num, raw, comp in blocks:
+      out.write (struct.pack (INDEX_FMT, first, offset, len(comp), len(raw), num))
+      offset += len (comp)
+    for _, _, _, comp in blocks:
+      out.write (comp)
+  return offset
+
+if len(sys.argv) == 4 and (sys.argv[1] == "-t" or sys.argv[1] == "--test"):
+   max_rec = 1000
    del sys.argv[1]
 
-if len(sys.argv) < 2:
-   print ("Usage: %s [-t|--test] path-of-routes.csv" % __file__)
-   sys.exit(1)
-
-with open (sys.argv[1], "r", newline="",  encoding="utf-8-sig") as f:
-  data = csv.reader (f, delimiter = ",")
-  data = sorted (data, key=operator.itemgetter(0))
-
-out.write (C_TOP % (time.ctime(), sys.executable, " ".join(sys.argv)))
-dump_records (out, data)
-out.write (C_BOTTOM % len(data))
-
+if len(sys.argv) != 3:
+   print ("Usage: %s [-t|--test] path-of-routes.csv[.gz] routes.bin" % __file__)
+   sys.exit (1)
 
+start  = time.time()
+routes = read_routes (sys.argv[1])
+size   = write_routes (sys.argv[2], routes)
+print ("Wrote %d routes in %d blocks (%d kB) to '%s' in %.1f sec." %
+       (len(routes), (len(routes) + BLOCK_RECORDS - 1) // BLOCK_RECORDS, size // 1024, sys.argv[2], time.time() - start))